@@ -12,7 +12,7 @@ INCLUDEPATH += ./GeneratedFiles \
     ./GeneratedFiles/Debug \
     ./external/eigen-3.3.9
 LIBS += -lopengl32 -lglu32
-CONFIG += c++11
+CONFIG += c++17
 RESOURCES += resources.qrc
 DEPENDPATH += .
 MOC_DIR += ./GeneratedFiles/debug
@@ -23,9 +23,15 @@ RCC_DIR += ./GeneratedFiles
 HEADERS += ./glwidget.h \
     ./mainwindow.h \
     ./camera.h\
-    Node.h \
-    Node.h \
+    cloudcache.h \
+    cloudloader.h \
+    forest.h \
+    morton.h \
     octtree.h \
+    parallel.h \
+    plyheader.h \
+    plystreamreader.h \
+    pointblocks.h \
     pointcloud.h \
     pointcloud.h \
     tree.h
@@ -33,8 +39,14 @@ SOURCES += ./glwidget.cpp \
      ./mainwindow.cpp \
     ./camera.cpp \
     ./main.cpp \
-    node.cpp \
+    cloudcache.cpp \
+    cloudloader.cpp \
+    forest.cpp \
+    morton.cpp \
     octtree.cpp \
+    plyheader.cpp \
+    plystreamreader.cpp \
+    pointblocks.cpp \
     pointcloud.cpp \
     tree.cpp
 
@@ -44,8 +56,15 @@ FORMS += ./mainwindow.ui
 HEADERS += ./glwidget.h \
     ./mainwindow.h \
     ./camera.h\
-    Node.h \
+    cloudcache.h \
+    cloudloader.h \
+    forest.h \
+    morton.h \
     octtree.h \
+    parallel.h \
+    plyheader.h \
+    plystreamreader.h \
+    pointblocks.h \
     pointcloud.h \
     pointcloud.h \
     tree.h
@@ -53,8 +72,14 @@ SOURCES += ./glwidget.cpp \
      ./mainwindow.cpp \
     ./camera.cpp \
     ./main.cpp \
-    node.cpp \
+    cloudcache.cpp \
+    cloudloader.cpp \
+    forest.cpp \
+    morton.cpp \
     octtree.cpp \
+    plyheader.cpp \
+    plystreamreader.cpp \
+    pointblocks.cpp \
     pointcloud.cpp \
     tree.cpp
 
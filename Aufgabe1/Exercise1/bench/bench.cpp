@@ -0,0 +1,114 @@
+#include "bench.h"
+#include <QFileInfo>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#endif
+
+// value of a "VmRSS:   123 kB" line of /proc/self/status
+static size_t statusMemory(const char* key)
+{
+#if defined(__linux__)
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    const std::string prefix = std::string(key) + ":";
+    while (std::getline(status, line)) {
+        if (line.compare(0, prefix.size(), prefix) == 0) {
+            return static_cast<size_t>(std::stoull(line.substr(prefix.size()))) * 1024;
+        }
+    }
+#else
+    (void)key;
+#endif
+    return 0;
+}
+
+size_t currentMemory()
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.WorkingSetSize : 0;
+#else
+    return statusMemory("VmRSS");
+#endif
+}
+
+size_t peakMemory()
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.PeakWorkingSetSize : 0;
+#else
+    return statusMemory("VmHWM");
+#endif
+}
+
+double benchNow()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool writeSyntheticPly(const QString& filePath, size_t count, uint32_t seed)
+{
+    std::ofstream os(filePath.toStdString().c_str(), std::ios::out | std::ios::binary);
+    if (!os.is_open()) {
+        return false;
+    }
+    os << "ply\nformat binary_little_endian 1.0\nelement vertex " << count
+       << "\nproperty float x\nproperty float y\nproperty float z\nend_header\n";
+
+    // a surface like a scan, not a uniform cube: spheres with a little noise
+    static const float centers[4][4] = {
+        { 0.3f, 0.3f, 0.3f, 0.25f }, { 0.7f, 0.4f, 0.6f, 0.2f },
+        { 0.4f, 0.7f, 0.7f, 0.15f }, { 0.7f, 0.7f, 0.25f, 0.2f } };
+    std::mt19937 random(seed);
+    std::normal_distribution<float> normal(0.0f, 1.0f);
+    std::vector<float> buffer;
+    const size_t batch = 1 << 20;
+    for (size_t first = 0; first < count; first += batch) {
+        const size_t n = std::min(batch, count - first);
+        buffer.resize(n * 3);
+        for (size_t i = 0; i < n; ++i) {
+            const float* sphere = centers[random() % 4];
+            float d[3] = { normal(random), normal(random), normal(random) };
+            const float length = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]) + 1e-12f;
+            const float radius = sphere[3] * (1.0f + 0.01f * normal(random));
+            for (int k = 0; k < 3; ++k) {
+                buffer[i * 3 + k] = sphere[k] + d[k] / length * radius;
+            }
+        }
+        os.write(reinterpret_cast<const char*>(buffer.data()), static_cast<std::streamsize>(buffer.size() * sizeof(float)));
+    }
+    return os.good();
+}
+
+QString syntheticPly(const QString& filePath, size_t count)
+{
+    if (!QFileInfo(filePath).exists()) {
+        std::printf("writing %zu synthetic points to %s\n", count, filePath.toStdString().c_str());
+        if (!writeSyntheticPly(filePath, count)) {
+            std::printf("could not write %s\n", filePath.toStdString().c_str());
+        }
+    }
+    return filePath;
+}
+
+double benchArgument(const QStringList& args, int i, double fallback)
+{
+    bool ok = false;
+    const double value = i < args.size() ? args[i].toDouble(&ok) : 0;
+    return ok ? value : fallback;
+}
+
+QString benchArgument(const QStringList& args, int i, const QString& fallback)
+{
+    return i < args.size() ? args[i] : fallback;
+}
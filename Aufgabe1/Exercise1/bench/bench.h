@@ -0,0 +1,37 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <QString>
+#include <QStringList>
+
+#include <cstddef>
+#include <cstdint>
+
+// resident memory of the process and its peak so far in bytes, 0 where unknown
+size_t currentMemory();
+size_t peakMemory();
+
+// milliseconds since an arbitrary start
+double benchNow();
+
+// writes a binary little endian ply of count points on a few noisy spheres inside the unit
+// cube, the same points for the same seed. returns false if the file cannot be written
+bool writeSyntheticPly(const QString& filePath, size_t count, uint32_t seed = 1);
+// the ply at the path, written first if it does not exist
+QString syntheticPly(const QString& filePath, size_t count);
+
+// argument i as a number, fallback if it is missing
+double benchArgument(const QStringList& args, int i, double fallback);
+QString benchArgument(const QStringList& args, int i, const QString& fallback);
+
+// every benchmark prints its results to std::cout and returns 0, or 1 if a check failed
+int benchStream(const QStringList& args);
+int benchMorton(const QStringList& args);
+int benchBuild(const QStringList& args);
+int benchQueries(const QStringList& args);
+int benchKdTree(const QStringList& args);
+int benchLod(const QStringList& args);
+int benchRepaint(const QStringList& args);
+int benchForest(const QStringList& args);
+
+#endif // BENCH_H
@@ -0,0 +1,44 @@
+# ----------------------------------------------------
+# Benchmarks of the loaders and spatial indexes, built next to Exercise1.
+# Run as: bench <name> [arguments], bench alone lists them.
+# ----------------------------------------------------
+
+TEMPLATE = app
+TARGET = bench
+QT += core gui
+CONFIG += console c++17
+CONFIG -= app_bundle
+INCLUDEPATH += ..
+DEPENDPATH += ..
+win32: LIBS += -lpsapi
+
+HEADERS += bench.h \
+    ../cloudcache.h \
+    ../forest.h \
+    ../morton.h \
+    ../octtree.h \
+    ../parallel.h \
+    ../plyheader.h \
+    ../plystreamreader.h \
+    ../pointblocks.h \
+    ../pointcloud.h \
+    ../tree.h
+SOURCES += main.cpp \
+    bench.cpp \
+    benchbuild.cpp \
+    benchforest.cpp \
+    benchkdtree.cpp \
+    benchlod.cpp \
+    benchmorton.cpp \
+    benchqueries.cpp \
+    benchrepaint.cpp \
+    benchstream.cpp \
+    ../cloudcache.cpp \
+    ../forest.cpp \
+    ../morton.cpp \
+    ../octtree.cpp \
+    ../plyheader.cpp \
+    ../plystreamreader.cpp \
+    ../pointblocks.cpp \
+    ../pointcloud.cpp \
+    ../tree.cpp
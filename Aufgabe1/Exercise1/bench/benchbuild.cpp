@@ -0,0 +1,72 @@
+#include "bench.h"
+#include <algorithm>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "octtree.h"
+#include "parallel.h"
+#include "pointcloud.h"
+
+// the same nodes and rows in the same order
+static bool sameTree(const Octtree& a, const Octtree& b)
+{
+    const std::vector<OcttreeNode>& x = a.get_nodes();
+    const std::vector<OcttreeNode>& y = b.get_nodes();
+    if (x.size() != y.size() || a.get_rows() != b.get_rows()) {
+        return false;
+    }
+    for (size_t i = 0; i < x.size(); ++i) {
+        if (x[i].first_child != y[i].first_child || x[i].first != y[i].first || x[i].count != y[i].count
+                || x[i].child_mask != y[i].child_mask || x[i].depth != y[i].depth) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// fastest of a few builds in ms
+static double buildTime(Octtree& octtree, const PointCloud& cloud, bool parallel, int runs)
+{
+    double best = 0;
+    for (int run = 0; run < runs; ++run) {
+        const double start = benchNow();
+        octtree.build(cloud, parallel);
+        const double time = benchNow() - start;
+        best = run == 0 ? time : std::min(best, time);
+    }
+    return best;
+}
+
+// Octtree::build serial and in parallel on 1, 2, 4, ... threads, every parallel tree is
+// compared to the serial one
+int benchBuild(const QStringList& args)
+{
+    const QString path = args.isEmpty() ? syntheticPly("synthetic_10m.ply", 10000000) : args[0];
+    const unsigned hardware = std::max(1u, std::thread::hardware_concurrency());
+    const unsigned maxThreads = static_cast<unsigned>(benchArgument(args, 1, static_cast<double>(hardware)));
+    const int runs = static_cast<int>(benchArgument(args, 2, 3.0));
+
+    PointCloud cloud;
+    if (!cloud.loadPLY(path)) {
+        return 1;
+    }
+    Octtree serial;
+    const double serialTime = buildTime(serial, cloud, false, runs);
+    std::printf("%s: %zu points, %zu nodes, %u hardware threads, best of %d\n",
+                path.toStdString().c_str(), cloud.getCount(), serial.get_nodes().size(), hardware, runs);
+    std::printf("threads      build   speedup   same tree\n");
+    std::printf("serial  %8.1f ms\n", serialTime);
+
+    int failed = 0;
+    Octtree octtree;
+    for (unsigned threads = 1; threads <= maxThreads; threads *= 2) {
+        workerLimit() = threads;
+        const double time = buildTime(octtree, cloud, true, runs);
+        const bool same = sameTree(serial, octtree);
+        failed += same ? 0 : 1;
+        std::printf("%6u  %8.1f ms %8.2fx   %s\n", threads, time, serialTime / time, same ? "yes" : "NO");
+    }
+    workerLimit() = 0;
+    return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,123 @@
+#include "bench.h"
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "forest.h"
+#include "pointcloud.h"
+#include "tree.h"
+
+// the mean distance of a point to its nearest other point, on a sample of the cloud
+static float meanSpacing(const PointCloud& cloud, const Tree& tree)
+{
+    std::vector<uint32_t> rows;
+    std::vector<float> distances;
+    const size_t step = std::max<size_t>(1, cloud.getCount() / 1000);
+    double sum = 0;
+    size_t count = 0;
+    for (size_t i = 0; i < cloud.getCount(); i += step) {
+        tree.knn(cloud.getPoint(i), 2, rows, distances);
+        if (distances.size() == 2) {
+            sum += distances[1];
+            ++count;
+        }
+    }
+    return count > 0 ? static_cast<float>(sum / count) : 0.0f;
+}
+
+// the share of the exact rows of every query that were found
+static double recall(const std::vector<uint32_t>& exact, const std::vector<uint32_t>& rows, int k)
+{
+    size_t hits = 0;
+    for (size_t q = 0; q < exact.size(); q += k) {
+        std::vector<uint32_t> expected(exact.begin() + q, exact.begin() + q + k);
+        std::sort(expected.begin(), expected.end());
+        for (int j = 0; j < k; ++j) {
+            hits += std::binary_search(expected.begin(), expected.end(), rows[q + j]) ? 1 : 0;
+        }
+    }
+    return exact.empty() ? 1.0 : double(hits) / exact.size();
+}
+
+// recall against the exact kd-tree and queries per second of the approximate searches, the
+// tree with eps or a leaf budget and forests of 4 and 8 trees, k = 8 on one thread each
+int benchForest(const QStringList& args)
+{
+    const QString path = args.isEmpty() ? syntheticPly("synthetic_2m.ply", 2000000) : args[0];
+    const size_t count = static_cast<size_t>(benchArgument(args, 1, 100000.0));
+    const int k = 8;
+
+    PointCloud cloud;
+    if (!cloud.loadPLY(path) || cloud.getCount() < static_cast<size_t>(k)) {
+        return 1;
+    }
+    Tree tree;
+    tree.build(cloud);
+    Forest forest4(4);
+    forest4.build(cloud);
+    Forest forest8(8);
+    forest8.build(cloud);
+
+    // points of the cloud moved by the mean point spacing
+    const float spacing = meanSpacing(cloud, tree);
+    std::mt19937 random(5);
+    std::uniform_real_distribution<float> jitter(-1.0f, 1.0f);
+    std::vector<QVector3D> queries(count);
+    for (QVector3D& query : queries) {
+        query = cloud.getPoint(random() % cloud.getCount())
+                + spacing * QVector3D(jitter(random), jitter(random), jitter(random)).normalized();
+    }
+    std::printf("%s: %zu points, %zu queries, k = %d, spacing %g\n", path.toStdString().c_str(),
+                cloud.getCount(), queries.size(), k, spacing);
+    std::printf("search               recall      queries/s\n");
+
+    std::vector<uint32_t> exact(queries.size() * k);
+    std::vector<uint32_t> rows;
+    std::vector<float> distances;
+    double start = benchNow();
+    for (size_t q = 0; q < queries.size(); ++q) {
+        tree.knn(queries[q], k, rows, distances);
+        std::copy(rows.begin(), rows.end(), exact.begin() + q * k);
+    }
+    std::printf("%-18s %8.2f %14.0f\n", "exact tree", 1.0, queries.size() / ((benchNow() - start) / 1000));
+
+    struct Setting
+    {
+        const char* name;
+        const Forest* forest;
+        float eps;
+        int leaves;
+    };
+    const Setting settings[] = {
+        { "tree eps 0.5", nullptr, 0.5f, 0 },
+        { "tree eps 1", nullptr, 1.0f, 0 },
+        { "tree eps 2", nullptr, 2.0f, 0 },
+        { "tree 1 leaf", nullptr, 0.0f, 1 },
+        { "tree 2 leaves", nullptr, 0.0f, 2 },
+        { "tree 4 leaves", nullptr, 0.0f, 4 },
+        { "tree 8 leaves", nullptr, 0.0f, 8 },
+        { "forest(4) 4 leaves", &forest4, 0.0f, 4 },
+        { "forest(4) 8", &forest4, 0.0f, 8 },
+        { "forest(4) 16", &forest4, 0.0f, 16 },
+        { "forest(8) 16", &forest8, 0.0f, 16 },
+    };
+    std::vector<uint32_t> found(queries.size() * k);
+    for (const Setting& setting : settings) {
+        TreeApproximation approximation;
+        approximation.eps = setting.eps;
+        approximation.max_leaves = setting.leaves;
+        start = benchNow();
+        for (size_t q = 0; q < queries.size(); ++q) {
+            if (setting.forest) {
+                setting.forest->knn(queries[q], k, rows, distances, approximation);
+            } else {
+                tree.knn(queries[q], k, rows, distances, approximation);
+            }
+            std::copy(rows.begin(), rows.end(), found.begin() + q * k);
+        }
+        const double time = benchNow() - start;
+        std::printf("%-18s %8.2f %14.0f\n", setting.name, recall(exact, found, k), queries.size() / (time / 1000));
+    }
+    return 0;
+}
@@ -0,0 +1,52 @@
+#include "bench.h"
+#include <cstdio>
+#include <vector>
+
+#include "octtree.h"
+#include "pointcloud.h"
+#include "tree.h"
+
+// Tree::knn_all, the nearest of every point of the cloud, in queries per second next to the
+// same queries one by one and through the octtree, those on every step-th point only
+int benchKdTree(const QStringList& args)
+{
+    const QString path = args.isEmpty() ? syntheticPly("synthetic_10m.ply", 10000000) : args[0];
+    const size_t step = static_cast<size_t>(benchArgument(args, 1, 10.0));
+
+    PointCloud cloud;
+    if (!cloud.loadPLY(path)) {
+        return 1;
+    }
+    double start = benchNow();
+    Tree tree;
+    tree.build(cloud);
+    const double treeBuild = benchNow() - start;
+    start = benchNow();
+    Octtree octtree;
+    octtree.build(cloud);
+    const double octtreeBuild = benchNow() - start;
+    std::vector<QVector3D> queries;
+    for (size_t i = 0; i < cloud.getCount(); i += step) {
+        queries.push_back(cloud.getPoint(i));
+    }
+    std::printf("%s: %zu points, kd-tree build %.0f ms, octtree build %.0f ms, every %zu. point for the others\n",
+                path.toStdString().c_str(), cloud.getCount(), treeBuild, octtreeBuild, step);
+    std::printf("  k   knn_all      knn_batch    octtree knn_batch   (queries/s)\n");
+
+    std::vector<uint32_t> rows;
+    std::vector<float> distances;
+    std::vector<OcttreeNeighbour> found;
+    for (int k : { 8, 16 }) {
+        start = benchNow();
+        tree.knn_all(k, rows, distances);
+        const double all = cloud.getCount() / ((benchNow() - start) / 1000);
+        start = benchNow();
+        tree.knn_batch(queries, k, rows, distances);
+        const double batch = queries.size() / ((benchNow() - start) / 1000);
+        start = benchNow();
+        octtree.knn_batch(queries, k, found);
+        const double octtreeBatch = queries.size() / ((benchNow() - start) / 1000);
+        std::printf("%3d %10.0f   %10.0f   %10.0f\n", k, all, batch, octtreeBatch);
+    }
+    return 0;
+}
@@ -0,0 +1,53 @@
+#include "bench.h"
+#include <QMatrix4x4>
+#include <cstdio>
+#include <vector>
+
+#include "octtree.h"
+#include "pointcloud.h"
+
+// Octtree::select_lod as GLWidget calls it every frame, 1920x1080 with a 70 degree field of
+// view, the camera on an axis of the cloud at a few multiples of its diagonal
+int benchLod(const QStringList& args)
+{
+    const QString path = args.isEmpty() ? syntheticPly("synthetic_10m.ply", 10000000) : args[0];
+    const float pixelError = static_cast<float>(benchArgument(args, 1, 1.0));
+    const int frames = 20;
+
+    PointCloud cloud;
+    if (!cloud.loadPLY(path)) {
+        return 1;
+    }
+    Octtree octtree;
+    octtree.build(cloud);
+    double start = benchNow();
+    octtree.build_samples();
+    const double samples = benchNow() - start;
+    std::printf("%s: %zu points, samples built in %.0f ms, pixel error %g, %d frames each\n",
+                path.toStdString().c_str(), cloud.getCount(), samples, pixelError, frames);
+    std::printf("distance   points drawn      ranges   nodes drawn    select\n");
+
+    const QVector3D center = (cloud.getMin() + cloud.getMax()) / 2;
+    const float diagonal = (cloud.getMax() - cloud.getMin()).length();
+    QMatrix4x4 projection;
+    projection.perspective(70.0f, 1920.0f / 1080.0f, diagonal * 0.001f, diagonal * 100.0f);
+    const float pixelsPerUnit = projection(1, 1) * 1080 / 2;
+    std::vector<OcttreeRange> ranges;
+    for (float distance : { 0.6f, 1.0f, 2.0f, 5.0f, 20.0f }) {
+        QMatrix4x4 camera;
+        camera.translate(0, 0, -distance * diagonal);
+        camera.translate(-center.x(), -center.y(), -center.z());
+        size_t nodes = 0;
+        start = benchNow();
+        for (int frame = 0; frame < frames; ++frame) {
+            nodes = octtree.select_lod(projection * camera, pixelsPerUnit, pixelError, ranges);
+        }
+        const double select = (benchNow() - start) / frames;
+        size_t points = 0;
+        for (const OcttreeRange& range : ranges) {
+            points += range.count;
+        }
+        std::printf("%8.1f %13.2f%% %11zu %13zu %8.3f ms\n", distance, 100.0 * points / cloud.getCount(), ranges.size(), nodes, select);
+    }
+    return 0;
+}
@@ -0,0 +1,86 @@
+#include "bench.h"
+#include <cstdio>
+#include <vector>
+
+#include "octtree.h"
+#include "pointcloud.h"
+#include "tree.h"
+
+// builds and queries of the indexes over a cloud in file order
+struct MortonTimes
+{
+    double kdTree = 0;
+    double octtree = 0;
+    double knn = 0;
+    double radius = 0;
+    size_t found = 0;
+};
+
+static MortonTimes measure(const PointCloud& cloud, size_t step, float radius)
+{
+    MortonTimes times;
+    double start = benchNow();
+    Tree tree;
+    tree.build(cloud);
+    times.kdTree = benchNow() - start;
+
+    start = benchNow();
+    Octtree octtree;
+    octtree.build(cloud);
+    times.octtree = benchNow() - start;
+
+    // queries in row order, the order a pass over the cloud such as a normal estimation takes,
+    // the same file rows in both orders
+    std::vector<QVector3D> queries;
+    for (size_t i = 0; i < cloud.getCount(); ++i) {
+        if (cloud.getOriginalRow(i) % step == 0) {
+            queries.push_back(cloud.getPoint(i));
+        }
+    }
+    std::vector<uint32_t> rows;
+    std::vector<float> distances;
+    start = benchNow();
+    tree.knn_batch(queries, 8, rows, distances);
+    times.knn = benchNow() - start;
+
+    std::vector<std::vector<OcttreeNeighbour>> neighbours;
+    start = benchNow();
+    octtree.radius_search_batch(queries, radius, neighbours);
+    times.radius = benchNow() - start;
+    for (const std::vector<OcttreeNeighbour>& found : neighbours) {
+        times.found += found.size();
+    }
+    return times;
+}
+
+// the same cloud in file order and in Morton order, PointCloud::reorderMorton
+int benchMorton(const QStringList& args)
+{
+    const QString path = args.isEmpty() ? syntheticPly("synthetic_10m.ply", 10000000) : args[0];
+    const size_t step = static_cast<size_t>(benchArgument(args, 1, 10.0));
+
+    PointCloud file;
+    PointCloud morton;
+    if (!file.loadPLY(path) || !morton.loadPLY(path)) {
+        return 1;
+    }
+    const double start = benchNow();
+    morton.reorderMorton();
+    const double reorder = benchNow() - start;
+
+    const float radius = (file.getMax() - file.getMin()).length() * 0.002f;
+    const MortonTimes a = measure(file, step, radius);
+    const MortonTimes b = measure(morton, step, radius);
+    std::printf("%s: %zu points, reorder %.0f ms, every %zu. row queried\n",
+                path.toStdString().c_str(), file.getCount(), reorder, step);
+    std::printf("                      file order   Morton order   speedup\n");
+    std::printf("kd-tree build      %12.1f ms %12.1f ms %8.2fx\n", a.kdTree, b.kdTree, a.kdTree / b.kdTree);
+    std::printf("octtree build      %12.1f ms %12.1f ms %8.2fx\n", a.octtree, b.octtree, a.octtree / b.octtree);
+    std::printf("kd-tree knn k=8    %12.1f ms %12.1f ms %8.2fx\n", a.knn, b.knn, a.knn / b.knn);
+    std::printf("octtree radius     %12.1f ms %12.1f ms %8.2fx\n", a.radius, b.radius, a.radius / b.radius);
+    if (a.found != b.found) {
+        std::printf("FAILED: %zu points found in file order, %zu in Morton order\n", a.found, b.found);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,87 @@
+#include "bench.h"
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "octtree.h"
+#include "pointcloud.h"
+
+// points of the cloud moved by up to a thousandth of the diagonal
+static std::vector<QVector3D> nearCloud(const PointCloud& cloud, size_t count)
+{
+    std::mt19937 random(3);
+    std::uniform_real_distribution<float> jitter(-1.0f, 1.0f);
+    const float size = (cloud.getMax() - cloud.getMin()).length() * 0.001f;
+    std::vector<QVector3D> queries(count);
+    for (QVector3D& query : queries) {
+        query = cloud.getPoint(random() % cloud.getCount())
+                + size * QVector3D(jitter(random), jitter(random), jitter(random));
+    }
+    return queries;
+}
+
+static void printRate(const char* name, size_t queries, double ms)
+{
+    std::printf("%-22s %10.0f queries/s\n", name, queries / (ms / 1000));
+}
+
+// Octtree::knn and radius_search in queries per second, one by one, batched and by brute force
+int benchQueries(const QStringList& args)
+{
+    const QString path = args.isEmpty() ? syntheticPly("synthetic_2m.ply", 2000000) : args[0];
+    const size_t count = static_cast<size_t>(benchArgument(args, 1, 20000.0));
+
+    PointCloud cloud;
+    if (!cloud.loadPLY(path)) {
+        return 1;
+    }
+    Octtree octtree;
+    octtree.build(cloud);
+    const std::vector<QVector3D> queries = nearCloud(cloud, count);
+    const float radius = (cloud.getMax() - cloud.getMin()).length() * 0.01f;
+    std::printf("%s: %zu points, %zu queries, radius %g\n", path.toStdString().c_str(), cloud.getCount(),
+                queries.size(), radius);
+
+    std::vector<OcttreeNeighbour> found;
+    size_t total = 0;
+    for (int k : { 1, 8, 32 }) {
+        const double start = benchNow();
+        for (const QVector3D& query : queries) {
+            octtree.knn(query, k, found);
+        }
+        char name[32];
+        std::snprintf(name, sizeof(name), "knn k=%d", k);
+        printRate(name, queries.size(), benchNow() - start);
+    }
+    double start = benchNow();
+    for (const QVector3D& query : queries) {
+        octtree.radius_search(query, radius, found);
+        total += found.size();
+    }
+    printRate("radius", queries.size(), benchNow() - start);
+
+    start = benchNow();
+    octtree.knn_batch(queries, 8, found);
+    printRate("knn_batch k=8", queries.size(), benchNow() - start);
+    std::vector<std::vector<OcttreeNeighbour>> lists;
+    start = benchNow();
+    octtree.radius_search_batch(queries, radius, lists);
+    printRate("radius_search_batch", queries.size(), benchNow() - start);
+
+    // a scan over all points per query, on a few of them
+    const size_t bruteCount = std::min<size_t>(queries.size(), 200);
+    float nearest = 0;
+    start = benchNow();
+    for (size_t q = 0; q < bruteCount; ++q) {
+        float best = -1;
+        for (size_t i = 0; i < cloud.getCount(); ++i) {
+            const float d = (cloud.getPoint(i) - queries[q]).lengthSquared();
+            best = best < 0 || d < best ? d : best;
+        }
+        nearest += best;
+    }
+    printRate("brute force 1nn", bruteCount, benchNow() - start);
+    std::printf("%.1f points per radius query, checksum %g\n", double(total) / queries.size(), nearest);
+    return 0;
+}
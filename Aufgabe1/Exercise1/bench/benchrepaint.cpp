@@ -0,0 +1,70 @@
+#include "bench.h"
+#include <QMatrix4x4>
+#include <cstdio>
+#include <vector>
+
+#include "octtree.h"
+#include "pointcloud.h"
+
+// the long run of the octtree_repaint_memory test: rebuild, samples, wireframe and level of
+// detail every frame with a turning camera, the tree arrays and the resident memory every
+// thousand frames have to stay where they were after the warmup
+int benchRepaint(const QStringList& args)
+{
+    const QString path = args.isEmpty() ? syntheticPly("synthetic_300k.ply", 300000) : args[0];
+    const int frames = static_cast<int>(benchArgument(args, 1, 10000));
+    const int warmup = 100;
+    const int report = 1000;
+
+    PointCloud cloud;
+    if (!cloud.loadPLY(path)) {
+        return 1;
+    }
+    std::printf("%s: %zu points, %d frames after %d warmup frames\n",
+                path.toStdString().c_str(), cloud.getCount(), frames, warmup);
+    std::printf("   frame   tree arrays      resident    per frame\n");
+
+    const QVector3D center = (cloud.getMin() + cloud.getMax()) / 2;
+    const float size = (cloud.getMax() - cloud.getMin()).length();
+    Octtree octtree;
+    std::vector<QVector3D> corners;
+    std::vector<uint32_t> indices;
+    std::vector<uint32_t> levelEnds;
+    std::vector<OcttreeRange> ranges;
+    size_t arrays = 0;
+    size_t resident = 0;
+    bool grown = false;
+    double start = benchNow();
+    for (int frame = 0; frame < warmup + frames; ++frame) {
+        if (frame >= warmup && (frame - warmup) % report == 0) {
+            const double perFrame = (benchNow() - start) / (frame == warmup ? warmup : report);
+            if (frame == warmup) {
+                arrays = octtree.memory_usage();
+                resident = currentMemory();
+            }
+            grown = grown || octtree.memory_usage() != arrays
+                    || (resident > 0 && currentMemory() > resident + 512 * 1024);
+            std::printf("%8d %10zu kB %10zu kB %9.2f ms\n", frame - warmup, octtree.memory_usage() / 1024,
+                        currentMemory() / 1024, perFrame);
+            start = benchNow();
+        }
+        octtree.build(cloud);
+        octtree.build_samples();
+        octtree.get_octtree_wireframe(5, corners, indices, levelEnds);
+
+        QMatrix4x4 projection;
+        projection.perspective(45.0f, 4.0f / 3.0f, size * 0.01f, size * 10.0f);
+        QMatrix4x4 camera;
+        camera.translate(0, 0, -1.5f * size);
+        camera.rotate(frame * 0.036f, 0, 1, 0);
+        camera.translate(-center.x(), -center.y(), -center.z());
+        octtree.select_lod(projection * camera, projection(1, 1) * 600 / 2, 1.0f, ranges);
+    }
+    grown = grown || octtree.memory_usage() != arrays || (resident > 0 && currentMemory() > resident + 512 * 1024);
+    std::printf("%8d %10zu kB %10zu kB\n", frames, octtree.memory_usage() / 1024, currentMemory() / 1024);
+    if (grown) {
+        std::printf("memory grew after the warmup\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,47 @@
+#include "bench.h"
+#include <QFileInfo>
+#include <cstdio>
+
+#include "plystreamreader.h"
+#include "pointcloud.h"
+
+// streams a file larger than the RAM with growing chunk sizes. The peak memory of the process
+// only grows, so every chunk size shows how much it adds on top of the smaller ones
+int benchStream(const QStringList& args)
+{
+    const double gigabytes = benchArgument(args, 1, 4.0);
+    const size_t count = static_cast<size_t>(gigabytes * 1e9 / (3 * sizeof(float)));
+    const QString path = syntheticPly(benchArgument(args, 0, QString("synthetic_stream.ply")), count);
+    const double megabytes = QFileInfo(path).size() / 1e6;
+    std::printf("%s: %.0f MB, peak memory before reading %.1f MB\n",
+                path.toStdString().c_str(), megabytes, peakMemory() / 1e6);
+
+    int failed = 0;
+    size_t points = 0;
+    for (size_t chunk : { size_t(1) << 14, size_t(1) << 16, size_t(1) << 18, size_t(1) << 20, size_t(1) << 22 }) {
+        const size_t before = peakMemory();
+        const double start = benchNow();
+        const PlyStatistics statistics = plyStatistics(path, chunk);
+        const double seconds = (benchNow() - start) / 1000;
+        std::printf("chunk %8zu points: %8.0f MB/s, peak memory %7.1f MB (+%.1f MB), %zu points, mean %.3f %.3f %.3f\n",
+                    chunk, megabytes / seconds, peakMemory() / 1e6, (peakMemory() - before) / 1e6, statistics.count,
+                    statistics.mean.x(), statistics.mean.y(), statistics.mean.z());
+        failed |= points != 0 && points != statistics.count;
+        points = statistics.count;
+    }
+
+    // both passes of a voxel downsampled load, the cloud grows with the occupied cells only
+    for (int resolution : { 64, 256 }) {
+        const size_t before = peakMemory();
+        const double start = benchNow();
+        PointCloud cloud;
+        cloud.loadPLYVoxels(QStringList(path), resolution);
+        const double seconds = (benchNow() - start) / 1000;
+        std::printf("voxels %4d: %zu points kept, %8.0f MB/s over two passes, peak memory %7.1f MB (+%.1f MB)\n",
+                    resolution, cloud.getCount(), 2 * megabytes / seconds, peakMemory() / 1e6, (peakMemory() - before) / 1e6);
+    }
+    if (failed) {
+        std::printf("FAILED: the chunk sizes read different point counts\n");
+    }
+    return failed;
+}
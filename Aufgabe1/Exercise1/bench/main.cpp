@@ -0,0 +1,46 @@
+//
+// Benchmarks of the loaders and spatial indexes, run as: bench <name> [arguments]
+//
+
+#include <QStringList>
+
+#include <cstdio>
+#include <cstring>
+
+#include "bench.h"
+
+struct Benchmark
+{
+    const char* name;
+    const char* usage;
+    int (*run)(const QStringList& args);
+};
+
+static const Benchmark benchmarks[] = {
+    { "stream", "[ply, written if missing] [gigabytes = 4]: chunked reader, peak memory by chunk size", benchStream },
+    { "build", "[ply = 10M synthetic points] [max threads = hardware] [runs = 3]: octtree build speedup by thread count", benchBuild },
+    { "queries", "[ply = 2M synthetic points] [queries = 20000]: octtree knn and radius search in queries per second", benchQueries },
+    { "kdtree", "[ply = 10M synthetic points] [step = 10]: kd-tree knn_all in queries per second", benchKdTree },
+    { "forest", "[ply = 2M synthetic points] [queries = 100000]: approximate kd-tree and forest knn, recall and queries per second", benchForest },
+    { "lod", "[ply = 10M synthetic points] [pixel error = 1]: octtree level of detail selection per frame", benchLod },
+    { "repaint", "[ply = 300k synthetic points] [frames = 10000]: octtree rebuild and level of detail per frame, memory after the warmup", benchRepaint },
+    { "morton", "[ply = 10M synthetic points] [query every nth row = 10]: indexes over file and Morton order", benchMorton },
+};
+
+int main(int argc, char* argv[])
+{
+    QStringList args;
+    for (int i = 2; i < argc; ++i) {
+        args.append(QString(argv[i]));
+    }
+    for (const Benchmark& benchmark : benchmarks) {
+        if (argc > 1 && std::strcmp(argv[1], benchmark.name) == 0) {
+            return benchmark.run(args);
+        }
+    }
+    std::printf("usage: bench <name> [arguments]\n");
+    for (const Benchmark& benchmark : benchmarks) {
+        std::printf("  %-10s %s\n", benchmark.name, benchmark.usage);
+    }
+    return 1;
+}
@@ -0,0 +1,197 @@
+#include "cloudcache.h"
+#include <QFileInfo>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+static const char CLOUD_CACHE_MAGIC[8] = { 'P', 'L', 'Y', 'C', 'A', 'C', 'H', 'E' };
+static const size_t CACHE_ALIGNMENT = 64;
+static const qint64 HASH_SAMPLE = 1 << 20;
+
+struct CacheFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t sectionCount;
+    uint64_t sourceSize;
+    uint64_t sourceMtime;
+    uint64_t sourceHash;
+    uint64_t pointCount;
+    float boundMin[3];
+    float boundMax[3];
+};
+
+struct CacheFileSection
+{
+    uint32_t id;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+};
+
+static size_t alignUp(size_t value)
+{
+    return (value + CACHE_ALIGNMENT - 1) / CACHE_ALIGNMENT * CACHE_ALIGNMENT;
+}
+
+// FNV-1a
+static uint64_t hashBytes(uint64_t hash, const char* data, qint64 size)
+{
+    for (qint64 i = 0; i < size; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+CacheKey cacheKeyFor(const QString& sourcePath)
+{
+    CacheKey key;
+    QFileInfo info(sourcePath);
+    key.size = static_cast<uint64_t>(info.size());
+    key.mtime = static_cast<uint64_t>(info.lastModified().toMSecsSinceEpoch());
+
+    QFile file(sourcePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return key;
+    }
+    const qint64 size = file.size();
+    const qint64 starts[3] = { 0, std::max<qint64>(0, size / 2 - HASH_SAMPLE / 2), std::max<qint64>(0, size - HASH_SAMPLE) };
+    std::vector<char> buffer(HASH_SAMPLE);
+    uint64_t hash = 14695981039346656037ull;
+    for (qint64 start : starts) {
+        file.seek(start);
+        const qint64 read = file.read(buffer.data(), HASH_SAMPLE);
+        hash = hashBytes(hash, buffer.data(), std::max<qint64>(0, read));
+    }
+    key.hash = hash;
+    return key;
+}
+
+QString cachePathFor(const QString& sourcePath)
+{
+    return sourcePath + ".cache";
+}
+
+void CloudCacheWriter::add(CacheSection id, const void* data, size_t size)
+{
+    _sections.push_back({ id, data, size });
+}
+
+bool CloudCacheWriter::write(const QString& sourcePath, const CacheKey& key, size_t pointCount, const QVector3D& min,
+                             const QVector3D& max) const
+{
+    CacheFileHeader header;
+    std::memcpy(header.magic, CLOUD_CACHE_MAGIC, sizeof(header.magic));
+    header.version = CLOUD_CACHE_VERSION;
+    header.sectionCount = static_cast<uint32_t>(_sections.size());
+    header.sourceSize = key.size;
+    header.sourceMtime = key.mtime;
+    header.sourceHash = key.hash;
+    header.pointCount = pointCount;
+    for (int k = 0; k < 3; ++k) {
+        header.boundMin[k] = min[k];
+        header.boundMax[k] = max[k];
+    }
+
+    std::vector<CacheFileSection> table(_sections.size());
+    size_t offset = alignUp(sizeof(CacheFileHeader) + table.size() * sizeof(CacheFileSection));
+    for (size_t i = 0; i < _sections.size(); ++i) {
+        table[i].id = static_cast<uint32_t>(_sections[i].id);
+        table[i].reserved = 0;
+        table[i].offset = offset;
+        table[i].size = _sections[i].size;
+        offset = alignUp(offset + _sections[i].size);
+    }
+
+    // write to a temporary file first, a crash must not leave a valid looking cache behind
+    const QString path = cachePathFor(sourcePath);
+    const QString tmpPath = path + ".tmp";
+    QFile file(tmpPath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        std::cout << "could not write cache " << path.toStdString() << std::endl;
+        return false;
+    }
+
+    bool ok = file.write(reinterpret_cast<const char*>(&header), sizeof(header)) == sizeof(header);
+    ok = ok && file.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(CacheFileSection))
+            == static_cast<qint64>(table.size() * sizeof(CacheFileSection));
+    for (size_t i = 0; ok && i < _sections.size(); ++i) {
+        ok = file.seek(static_cast<qint64>(table[i].offset))
+                && file.write(static_cast<const char*>(_sections[i].data), _sections[i].size) == static_cast<qint64>(_sections[i].size);
+    }
+    ok = ok && file.resize(static_cast<qint64>(offset));
+    file.close();
+
+    if (!ok) {
+        QFile::remove(tmpPath);
+        std::cout << "could not write cache " << path.toStdString() << std::endl;
+        return false;
+    }
+    QFile::remove(path);
+    return QFile::rename(tmpPath, path);
+}
+
+CloudCache::~CloudCache()
+{
+    if (_mapped) {
+        _file.unmap(_mapped);
+    }
+}
+
+bool CloudCache::open(const QString& sourcePath, const CacheKey& key)
+{
+    const QString path = cachePathFor(sourcePath);
+    if (!QFile::exists(path)) {
+        return false;
+    }
+    _file.setFileName(path);
+    if (!_file.open(QIODevice::ReadOnly) || _file.size() < static_cast<qint64>(sizeof(CacheFileHeader))) {
+        return false;
+    }
+    _mappedSize = _file.size();
+    _mapped = _file.map(0, _mappedSize);
+    if (!_mapped) {
+        return false;
+    }
+
+    CacheFileHeader header;
+    std::memcpy(&header, _mapped, sizeof(header));
+    const bool valid = std::memcmp(header.magic, CLOUD_CACHE_MAGIC, sizeof(header.magic)) == 0
+            && header.version == CLOUD_CACHE_VERSION
+            && static_cast<qint64>(sizeof(header) + header.sectionCount * sizeof(CacheFileSection)) <= _mappedSize;
+    if (!valid || key.size != header.sourceSize || key.mtime != header.sourceMtime || key.hash != header.sourceHash) {
+        _file.unmap(_mapped);
+        _mapped = nullptr;
+        return false;
+    }
+
+    _count = header.pointCount;
+    _min = QVector3D(header.boundMin[0], header.boundMin[1], header.boundMin[2]);
+    _max = QVector3D(header.boundMax[0], header.boundMax[1], header.boundMax[2]);
+    return true;
+}
+
+const uchar* CloudCache::section(CacheSection id, size_t* size) const
+{
+    if (!_mapped) {
+        return nullptr;
+    }
+    CacheFileHeader header;
+    std::memcpy(&header, _mapped, sizeof(header));
+    const uchar* table = _mapped + sizeof(CacheFileHeader);
+    for (uint32_t i = 0; i < header.sectionCount; ++i) {
+        CacheFileSection entry;
+        std::memcpy(&entry, table + i * sizeof(CacheFileSection), sizeof(entry));
+        // offset + size could wrap around
+        const uint64_t mappedSize = static_cast<uint64_t>(_mappedSize);
+        if (entry.id == static_cast<uint32_t>(id) && entry.offset <= mappedSize
+                && entry.size <= mappedSize - entry.offset) {
+            if (size) {
+                *size = entry.size;
+            }
+            return _mapped + entry.offset;
+        }
+    }
+    return nullptr;
+}
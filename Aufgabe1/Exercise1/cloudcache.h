@@ -0,0 +1,90 @@
+#ifndef CLOUDCACHE_H
+#define CLOUDCACHE_H
+
+#include <QString>
+#include <QFile>
+#include <QVector3D>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Sidecar file '<ply>.cache' with the parsed cloud and its spatial indexes.
+//
+// Layout: a fixed header, a table of sections and the sections themselves, every section
+// 64 byte aligned so float arrays can be used in place from the mapped file. The header
+// stores the key of the source file, a cache with another key or version is ignored.
+
+static const uint32_t CLOUD_CACHE_VERSION = 5;
+
+enum class CacheSection : uint32_t
+{
+    Points = 1,  // x, y, z floats per point
+    Columns = 2, // PointCloud columns
+    Octree = 6,  // Octtree::serialize
+    Faces = 7,   // uint32 triangle indices, only for meshes
+    KdTree = 8   // Tree::serialize
+};
+
+// identifies the source file: size, modification time and a hash of its first,
+// middle and last megabyte, so the check does not read the whole file
+struct CacheKey
+{
+    uint64_t size = 0;
+    uint64_t mtime = 0;
+    uint64_t hash = 0;
+
+    bool operator==(const CacheKey& other) const
+    {
+        return size == other.size && mtime == other.mtime && hash == other.hash;
+    }
+};
+
+CacheKey cacheKeyFor(const QString& sourcePath);
+QString cachePathFor(const QString& sourcePath);
+
+// collects sections and writes them in one go, through a temporary file and a rename
+class CloudCacheWriter
+{
+public:
+    void add(CacheSection id, const void* data, size_t size);
+    // key is that of the source when it was parsed, a file changed since then gets a stale cache
+    bool write(const QString& sourcePath, const CacheKey& key, size_t pointCount, const QVector3D& min,
+               const QVector3D& max) const;
+
+private:
+    struct Section
+    {
+        CacheSection id;
+        const void* data;
+        size_t size;
+    };
+    std::vector<Section> _sections;
+};
+
+// a mapped, validated cache file
+class CloudCache
+{
+public:
+    ~CloudCache();
+
+    // false if there is no cache for the source or it was written for another key
+    bool open(const QString& sourcePath, const CacheKey& key);
+
+    size_t getCount() const { return _count; }
+    QVector3D getMin() const { return _min; }
+    QVector3D getMax() const { return _max; }
+
+    // start of a section inside the mapped file, nullptr if the cache does not hold it
+    const uchar* section(CacheSection id, size_t* size = nullptr) const;
+
+private:
+    QFile _file;
+    uchar* _mapped = nullptr;
+    qint64 _mappedSize = 0;
+    size_t _count = 0;
+    QVector3D _min;
+    QVector3D _max;
+};
+
+#endif // CLOUDCACHE_H
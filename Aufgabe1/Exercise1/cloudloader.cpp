@@ -0,0 +1,199 @@
+#include "cloudloader.h"
+#include <QElapsedTimer>
+#include <QMetaObject>
+#include <algorithm>
+#include <exception>
+#include <iostream>
+
+// rows per pointsLoaded signal
+static const size_t PROGRESS_ROWS = 1 << 20;
+
+CloudLoader::CloudLoader(QObject* parent)
+    : QObject(parent)
+{}
+
+CloudLoader::~CloudLoader()
+{
+    cancel();
+    for (std::unique_ptr<Job>& job : _jobs) {
+        job->thread.join();
+    }
+}
+
+template <typename F>
+void CloudLoader::post(const Job* job, F fn)
+{
+    const unsigned generation = job->generation;
+    QMetaObject::invokeMethod(this, [this, generation, fn]() {
+        if (generation == _generation) {
+            fn();
+        }
+    }, Qt::QueuedConnection);
+}
+
+void CloudLoader::load(const QStringList& paths)
+{
+    cancel();
+    joinDone();
+
+    std::unique_ptr<Job> job(new Job());
+    job->generation = ++_generation;
+    job->quantize = _quantize;
+    job->reorder = _reorder;
+    job->voxels = _voxels;
+    Job* started = job.get();
+    _jobs.push_back(std::move(job));
+    _loading = true;
+    started->thread = std::thread(&CloudLoader::run, this, started, paths);
+}
+
+void CloudLoader::cancel()
+{
+    for (std::unique_ptr<Job>& job : _jobs) {
+        job->cancelled = true;
+    }
+    // drops everything the cancelled jobs already posted
+    ++_generation;
+    _loading = false;
+}
+
+void CloudLoader::joinDone()
+{
+    // a job is done once its thread does not touch it anymore, joining it does not block
+    for (auto it = _jobs.begin(); it != _jobs.end();) {
+        if ((*it)->done) {
+            (*it)->thread.join();
+            it = _jobs.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void CloudLoader::run(Job* job, const QStringList& paths)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    // owned by the job until it is posted, a cancelled job frees it on return
+    QSharedPointer<LoadedCloud> loaded(new LoadedCloud());
+    try {
+        PointCloud& cloud = loaded->cloud;
+        const LoadProgress handOut = [&](size_t first, size_t count) {
+            // hand out copies of the finished rows, the cloud itself stays with the job
+            const size_t total = cloud.getCount();
+            for (size_t begin = first; begin < first + count && !job->cancelled; begin += PROGRESS_ROWS) {
+                const size_t end = std::min(first + count, begin + PROGRESS_ROWS);
+                QVector<float> points(static_cast<int>((end - begin) * POINT_STRIDE));
+                float* p = points.data();
+                for (size_t i = begin; i < end; ++i) {
+                    const QVector3D point = cloud.getPoint(i);
+                    *p++ = point.x();
+                    *p++ = point.y();
+                    *p++ = point.z();
+                }
+                const int percent = static_cast<int>(100 * end / total);
+                post(job, [this, begin, total, points, percent]() {
+                    emit pointsLoaded(begin, total, points);
+                    emit progress("parsing", percent);
+                });
+            }
+            return !job->cancelled;
+        };
+        const bool complete = job->voxels > 0
+                ? cloud.loadPLYVoxels(paths, job->voxels, handOut)
+                : cloud.loadPLYs(paths, handOut);
+
+        if (complete && !job->cancelled && buildIndexes(job, *loaded)) {
+            // after the indexes and the cache, both want the float positions in file order
+            if (job->reorder) {
+                cloud.reorderMorton();
+                loaded->tree->renumber_rows(cloud.getOriginalRows());
+                loaded->octtree->renumber_rows(cloud.getOriginalRows());
+            }
+            // node samples for the level of detail, by the final rows
+            loaded->octtree->build_samples();
+            if (job->quantize) {
+                cloud.quantize();
+            }
+            std::cout << "cloud and indexes loaded in " << timer.elapsed() << " ms" << std::endl;
+            post(job, [this, loaded]() {
+                _loading = false;
+                emit finished(loaded);
+            });
+        }
+    } catch (const std::exception& e) {
+        const QString message = QString::fromStdString(e.what());
+        post(job, [this, message]() {
+            _loading = false;
+            emit failed(message);
+        });
+    }
+    loaded.reset();
+
+    job->done = true;
+    QMetaObject::invokeMethod(this, [this]() { joinDone(); }, Qt::QueuedConnection);
+}
+
+bool CloudLoader::loadIndexesFromCache(LoadedCloud& loaded)
+{
+    const CloudCache* cache = loaded.cloud.getCache();
+    if (!cache) {
+        return false;
+    }
+    size_t treeSize, octtreeSize;
+    const uchar* tree = cache->section(CacheSection::KdTree, &treeSize);
+    const uchar* octtree = cache->section(CacheSection::Octree, &octtreeSize);
+    if (!tree || !octtree) {
+        return false;
+    }
+    loaded.tree = Tree::deserialize(tree, treeSize);
+    loaded.octtree = Octtree::deserialize(octtree, octtreeSize);
+    return loaded.tree != nullptr && loaded.octtree != nullptr;
+}
+
+bool CloudLoader::buildIndexes(Job* job, LoadedCloud& loaded)
+{
+    // kd-tree and octtree of an earlier launch
+    if (loadIndexesFromCache(loaded)) {
+        std::cout << "kd-tree and octtree loaded from cache"<< std::endl;
+        return true;
+    }
+    delete loaded.tree;
+    loaded.tree = nullptr;
+    delete loaded.octtree;
+    loaded.octtree = nullptr;
+
+    const PointCloud& cloud = loaded.cloud;
+    QElapsedTimer timer;
+    timer.start();
+
+    // balanced kd-tree by median splits
+    post(job, [this]() { emit progress("kd-tree", 0); });
+    loaded.tree = new Tree();
+    if (!loaded.tree->build(cloud, true, &job->cancelled)) {
+        return false;
+    }
+    std::cout << "kd-tree with " << loaded.tree->get_nodes().size() << " nodes built in " << timer.elapsed() << " ms" << std::endl;
+
+    // linear octtree from the Morton codes of the points
+    post(job, [this]() { emit progress("octtree", 0); });
+    timer.restart();
+    loaded.octtree = new Octtree();
+    if (!loaded.octtree->build(cloud, true, &job->cancelled)) {
+        return false;
+    }
+    loaded.octtree->release_scratch();
+    std::cout << "octtree with " << loaded.octtree->get_nodes().size() << " nodes built in " << timer.elapsed() << " ms" << std::endl;
+
+    // store parsed points and indexes next to the ply for the next launch
+    post(job, [this]() { emit progress("caching", 0); });
+    const std::vector<unsigned char> tree = loaded.tree->serialize();
+    const std::vector<unsigned char> octtree = loaded.octtree->serialize();
+    CloudCacheWriter writer;
+    writer.add(CacheSection::KdTree, tree.data(), tree.size());
+    writer.add(CacheSection::Octree, octtree.data(), octtree.size());
+    cloud.writeCache(writer);
+
+    return !job->cancelled;
+}
@@ -0,0 +1,97 @@
+#ifndef CLOUDLOADER_H
+#define CLOUDLOADER_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QVector3D>
+#include <QSharedPointer>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "pointcloud.h"
+#include "octtree.h"
+#include "tree.h"
+
+// everything a load produces, handed to the gui thread in one piece when it is done
+struct LoadedCloud
+{
+    PointCloud cloud;
+    Tree* tree = nullptr;
+    Octtree* octtree = nullptr;
+
+    ~LoadedCloud()
+    {
+        delete tree;
+        delete octtree;
+    }
+};
+
+// Loads a ply file and builds its indexes on a worker thread: parse, kd-tree, octtree and cache.
+// Parsed rows are handed out while the rest is still loading, so the cloud can be drawn as it
+// fills in. Every load gets a new generation, signals of older loads are dropped on the gui
+// thread, so a cancelled or replaced load never shows up. All signals are emitted on the
+// thread the loader lives in.
+class CloudLoader : public QObject
+{
+    Q_OBJECT
+public:
+    CloudLoader(QObject* parent = nullptr);
+    ~CloudLoader();
+
+    // starts loading in the background, a running load is cancelled first. several files
+    // or directories are loaded as one cloud of tiles, see PointCloud::loadPLYs
+    void load(const QStringList& paths);
+    // the running load stops at its next check and frees everything it holds
+    void cancel();
+    bool isLoading() const { return _loading; }
+    // quantize the positions of the following loads to 16 bit, see PointCloud::quantize
+    void setQuantize(bool quantize) { _quantize = quantize; }
+    // store the points of the following loads in Morton order, see PointCloud::reorderMorton
+    void setReorder(bool reorder) { _reorder = reorder; }
+    // stream the following loads into a grid of resolution cells along the longest side,
+    // 0 loads every point, see PointCloud::loadPLYVoxels
+    void setVoxels(int resolution) { _voxels = resolution; }
+
+signals:
+    // stage is "parsing", "kd-tree", "octtree" or "caching"
+    void progress(const QString& stage, int percent);
+    // x, y, z of rows [first, first + points.size() / 3) of a cloud with total points
+    void pointsLoaded(size_t first, size_t total, const QVector<float>& points);
+    void finished(QSharedPointer<LoadedCloud> cloud);
+    void failed(const QString& message);
+
+private:
+    struct Job
+    {
+        unsigned generation = 0;
+        bool quantize = false;
+        bool reorder = false;
+        int voxels = 0;
+        std::atomic<bool> cancelled{false};
+        std::atomic<bool> done{false};
+        std::thread thread;
+    };
+
+    void run(Job* job, const QStringList& paths);
+    bool buildIndexes(Job* job, LoadedCloud& loaded);
+    bool loadIndexesFromCache(LoadedCloud& loaded);
+    void joinDone();
+
+    // runs fn on the gui thread, unless a newer load was started in between
+    template <typename F>
+    void post(const Job* job, F fn);
+
+    std::vector<std::unique_ptr<Job>> _jobs;
+    unsigned _generation = 0;
+    bool _loading = false;
+    bool _quantize = false;
+    bool _reorder = false;
+    int _voxels = 0;
+};
+
+#endif // CLOUDLOADER_H
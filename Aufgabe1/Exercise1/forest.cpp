@@ -0,0 +1,178 @@
+#include "forest.h"
+#include <algorithm>
+#include <cmath>
+#include "parallel.h"
+
+Forest::Forest(int trees, int leaf_capacity)
+    : _tree_count(std::max(1, trees)),
+      _leaf_capacity(std::max(1, leaf_capacity))
+{}
+
+void Forest::build(const PointCloud& cloud, bool parallel)
+{
+    _trees.clear();
+    _row_count = cloud.getCount();
+    for (int t = 0; t < _tree_count; ++t)
+    {
+        _trees.emplace_back(new Tree(_leaf_capacity, static_cast<uint32_t>(t + 1)));
+        _trees.back()->build(cloud, parallel);
+    }
+}
+
+void Forest::knn(const QVector3D& query, int k, std::vector<uint32_t>& rows, std::vector<float>& distances,
+                 const TreeApproximation& approximation) const
+{
+    std::vector<SearchEntry> nodes;
+    std::vector<std::pair<float, uint32_t>> found;
+    // a bit per point, kept by the thread so a query does not clear the whole cloud
+    static thread_local std::vector<uint64_t> taken;
+    const size_t points = _trees.empty() ? 0 : _trees[0]->get_points().size();
+    const size_t per_query = std::min(static_cast<size_t>(std::max(0, k)), points);
+    rows.resize(per_query);
+    distances.resize(per_query);
+    knn(query, per_query, rows.data(), distances.data(), approximation, nodes, found, taken);
+}
+
+void Forest::knn_batch(const std::vector<QVector3D>& queries, int k, std::vector<uint32_t>& rows,
+                       std::vector<float>& distances, const TreeApproximation& approximation) const
+{
+    const size_t points = _trees.empty() ? 0 : _trees[0]->get_points().size();
+    const size_t per_query = std::min(static_cast<size_t>(std::max(0, k)), points);
+    rows.resize(queries.size() * per_query);
+    distances.resize(queries.size() * per_query);
+    parallelBlocks(queries.size(), workerCount(), [&](size_t begin, size_t end, unsigned) {
+        std::vector<SearchEntry> nodes;
+        std::vector<std::pair<float, uint32_t>> found;
+        std::vector<uint64_t> taken;
+        for (size_t q = begin; q < end; ++q)
+        {
+            knn(queries[q], per_query, rows.data() + q * per_query, distances.data() + q * per_query, approximation,
+                nodes, found, taken);
+        }
+    });
+}
+
+size_t Forest::knn(const QVector3D& query, size_t k, uint32_t* rows, float* distances,
+                   const TreeApproximation& approximation, std::vector<SearchEntry>& nodes,
+                   std::vector<std::pair<float, uint32_t>>& found, std::vector<uint64_t>& taken) const
+{
+    if (_trees.empty())
+    {
+        return 0;
+    }
+    k = std::min(k, _trees[0]->get_points().size());
+    if (k == 0)
+    {
+        return 0;
+    }
+
+    // one heap of cells of all trees with the nearest on top, found holds cloud rows since a
+    // point is in every tree and must be taken once. taken has the bits of the rows in found
+    // set, all clear between queries. It covers all rows of the cloud, the trees leave its
+    // non-finite points out. A row pushed out of found is further than all that come
+    // after it, its bit is cleared right away
+    taken.resize((_row_count + 63) / 64, 0);
+    const float shrink = 1 / ((1 + approximation.eps) * (1 + approximation.eps));
+    auto nearer_entry = [](const SearchEntry& a, const SearchEntry& b) { return a.distance2 > b.distance2; };
+    int leaves = 0;
+    nodes.clear();
+    found.clear();
+    for (uint32_t t = 0; t < _trees.size(); ++t)
+    {
+        nodes.push_back({ 0, t, 0, QVector3D(0, 0, 0) });
+    }
+    while (!nodes.empty())
+    {
+        std::pop_heap(nodes.begin(), nodes.end(), nearer_entry);
+        const SearchEntry entry = nodes.back();
+        nodes.pop_back();
+        if (found.size() == k && entry.distance2 > found.front().first * shrink)
+        {
+            break;
+        }
+
+        const Tree& tree = *_trees[entry.tree];
+        const std::vector<TreeNode>& tree_nodes = tree.get_nodes();
+        uint32_t index = entry.node;
+        while (!tree_nodes[index].is_leaf())
+        {
+            const TreeNode& node = tree_nodes[index];
+            const float offset = query[node.axis] - node.split;
+            SearchEntry far = entry;
+            far.offset[node.axis] = offset;
+            far.distance2 = entry.distance2 - entry.offset[node.axis] * entry.offset[node.axis] + offset * offset;
+            if (offset <= 0)
+            {
+                far.node = node.right;
+                index = index + 1;
+            }
+            else
+            {
+                far.node = index + 1;
+                index = node.right;
+            }
+            if (found.size() < k || far.distance2 <= found.front().first * shrink)
+            {
+                nodes.push_back(far);
+                std::push_heap(nodes.begin(), nodes.end(), nearer_entry);
+            }
+        }
+
+        const TreeNode& leaf = tree_nodes[index];
+        const std::vector<uint32_t>& tree_rows = tree.get_rows();
+        float block[POINT_BLOCK];
+        for (uint32_t first = leaf.first; first < leaf.first + leaf.count; first += POINT_BLOCK)
+        {
+            const uint32_t count = std::min(leaf.first + leaf.count - first, POINT_BLOCK);
+            const bool filling = found.size() < k;
+            uint32_t mask = tree.get_points().squaredDistances(first, count, query, filling ? 0 : found.front().first, block);
+            if (filling)
+            {
+                mask = blockMask(count);
+            }
+            while (mask != 0)
+            {
+                const int j = lowestBit(mask);
+                mask &= mask - 1;
+                const float distance2 = block[j];
+                if (found.size() == k && distance2 >= found.front().first)
+                {
+                    continue;
+                }
+                const uint32_t row = tree_rows[first + j];
+                uint64_t& word = taken[row >> 6];
+                const uint64_t bit = uint64_t(1) << (row & 63);
+                if (word & bit)
+                {
+                    continue;
+                }
+                word |= bit;
+                if (found.size() < k)
+                {
+                    found.push_back(std::make_pair(distance2, row));
+                    std::push_heap(found.begin(), found.end());
+                }
+                else
+                {
+                    std::pop_heap(found.begin(), found.end());
+                    taken[found.back().second >> 6] &= ~(uint64_t(1) << (found.back().second & 63));
+                    found.back() = std::make_pair(distance2, row);
+                    std::push_heap(found.begin(), found.end());
+                }
+            }
+        }
+        if (approximation.max_leaves > 0 && ++leaves >= approximation.max_leaves && found.size() == k)
+        {
+            break;
+        }
+    }
+
+    std::sort_heap(found.begin(), found.end());
+    for (size_t i = 0; i < found.size(); ++i)
+    {
+        taken[found[i].second >> 6] = 0;
+        rows[i] = found[i].second;
+        distances[i] = std::sqrt(found[i].first);
+    }
+    return found.size();
+}
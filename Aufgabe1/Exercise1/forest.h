@@ -0,0 +1,63 @@
+#ifndef FOREST_H
+#define FOREST_H
+#include <QVector3D>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "pointcloud.h"
+#include "tree.h"
+
+// default number of trees of a forest
+static const int FOREST_TREES = 4;
+
+// Randomized kd-forest: seeded trees over the same cloud whose nodes split on one of the two
+// longest sides of their cell at random, so the trees cut the space differently and a point
+// near a split in one of them is inside a cell in another. A search visits the nearest cells
+// of all trees first from one heap and shares the leaf budget of TreeApproximation between
+// them, more trees find more of the true neighbours with the same number of leaves.
+class Forest
+{
+public:
+    Forest(int trees = FOREST_TREES, int leaf_capacity = TREE_LEAF_CAPACITY);
+    Forest(const Forest&) = delete;
+    Forest& operator=(const Forest&) = delete;
+
+    // builds the trees one after the other, each of them on all threads if parallel
+    void build(const PointCloud& cloud, bool parallel = true);
+
+    const std::vector<std::unique_ptr<Tree>>& get_trees() const { return _trees; }
+
+    // the k points nearest to query, nearest first, as Tree::knn. Without a leaf budget the
+    // search is as exact as eps allows, the first tree would do
+    void knn(const QVector3D& query, int k, std::vector<uint32_t>& rows, std::vector<float>& distances,
+             const TreeApproximation& approximation) const;
+    // the same for many queries on all threads, the min(k, points) nearest of query q are
+    // written from q * min(k, points) on
+    void knn_batch(const std::vector<QVector3D>& queries, int k, std::vector<uint32_t>& rows,
+                   std::vector<float>& distances, const TreeApproximation& approximation) const;
+
+private:
+    // a child waiting in a search, as in Tree, with the tree it belongs to
+    struct SearchEntry
+    {
+        float distance2;
+        uint32_t tree;
+        uint32_t node;
+        QVector3D offset;
+    };
+    // nodes, found and taken are the heaps and the row bitset of the calling thread, kept
+    // from query to query
+    size_t knn(const QVector3D& query, size_t k, uint32_t* rows, float* distances,
+               const TreeApproximation& approximation, std::vector<SearchEntry>& nodes,
+               std::vector<std::pair<float, uint32_t>>& found, std::vector<uint64_t>& taken) const;
+
+    std::vector<std::unique_ptr<Tree>> _trees;
+    // rows of the cloud, the trees may hold fewer points
+    size_t _row_count = 0;
+    int _tree_count;
+    int _leaf_capacity;
+};
+
+#endif // FOREST_H
@@ -2,11 +2,13 @@
 
 uniform float pointsCount;
 uniform float colorAxisMode;
+uniform float hasColor;
 uniform vec3 pointsBoundMin;
 uniform vec3 pointsBoundMax;
 
 varying vec3 vert;
 varying float pointIdx;
+varying vec3 color;
 
 void main() {
   float intensity = pointIdx/pointsCount;
@@ -14,4 +16,7 @@ void main() {
     intensity = (vert.z + abs(pointsBoundMin.z))/(pointsBoundMax.z - pointsBoundMin.z);
   }
   gl_FragColor = vec4(intensity, intensity, intensity, 0.);
+  if (hasColor == 1) {
+    gl_FragColor = vec4(color, 0.);
+  }
 }
@@ -15,6 +15,7 @@
 #include <QMouseEvent>
 #include <QFileDialog>
 #include <QMessageBox>
+#include <QElapsedTimer>
 
 #include <cmath>
 #include <cassert>
@@ -23,24 +24,41 @@
 #include <string>
 #include <sstream>
 #include <limits>
+#include <algorithm>
 #include <utility>
 
 #define PI 3.14159265
 #include "mainwindow.h"
 
-bool compareX(QVector3D v1, QVector3D v2)
+// a point under the mouse is picked up to this many pixels off
+static const float PICK_TOLERANCE_PIXELS = 4.0f;
+// octtree nodes are drawn from their sample once its points are this close on screen
+static const float LOD_PIXEL_ERROR = 1.0f;
+// grid cells along the longest side of a voxel downsampled cloud
+static const int VOXEL_RESOLUTION = 1024;
+// QOpenGLBuffer takes sizes as int, larger buffers are written in pieces of this many bytes
+static const size_t UPLOAD_CHUNK_BYTES = size_t(1) << 28;
+
+// bytes at offset of the bound buffer, in pieces below 2 GiB
+static void writeBuffer(QOpenGLBuffer& buffer, size_t offset, const void* data, size_t bytes)
 {
-    return (v1.x() < v2.x());
-}
-
-bool compareY(QVector3D v1, QVector3D v2)
-{
-    return (v1.y() < v2.y());
+    QOpenGLFunctions* f = QOpenGLContext::currentContext()->functions();
+    const uchar* p = static_cast<const uchar*>(data);
+    for (size_t done = 0; done < bytes; done += UPLOAD_CHUNK_BYTES) {
+        f->glBufferSubData(static_cast<GLenum>(buffer.type()), static_cast<qopengl_GLintptr>(offset + done),
+                           static_cast<qopengl_GLsizeiptr>(std::min(UPLOAD_CHUNK_BYTES, bytes - done)), p + done);
+    }
 }
 
-bool compareZ(QVector3D v1, QVector3D v2)
+// sizes the bound buffer to bytes of any size and writes data to it unless it is null
+static void allocateBuffer(QOpenGLBuffer& buffer, const void* data, size_t bytes)
 {
-    return (v1.z() < v2.z());
+    QOpenGLFunctions* f = QOpenGLContext::currentContext()->functions();
+    f->glBufferData(static_cast<GLenum>(buffer.type()), static_cast<qopengl_GLsizeiptr>(bytes), nullptr,
+                    static_cast<GLenum>(buffer.usagePattern()));
+    if (data) {
+        writeBuffer(buffer, 0, data, bytes);
+    }
 }
 
 //static const size_t POINT_STRIDE = 4; // x, y, z, index
@@ -58,12 +76,18 @@ GLWidget::GLWidget(QWidget* parent)
     _axesLines.push_back(std::make_pair(QVector3D(0.0, 0.0, 0.0), QColor(0.0, 0.0, 1.0)));
     _axesLines.push_back(std::make_pair(QVector3D(0.0, 0.0, 1.0), QColor(0.0, 0.0, 1.0)));
 
-
+    // point clouds are loaded in the background
+    connect(&_loader, &CloudLoader::progress, this, &GLWidget::loadProgress);
+    connect(&_loader, &CloudLoader::pointsLoaded, this, &GLWidget::onPointsLoaded);
+    connect(&_loader, &CloudLoader::finished, this, &GLWidget::onCloudLoaded);
+    connect(&_loader, &CloudLoader::failed, this, &GLWidget::onLoadFailed);
 }
 
 GLWidget::~GLWidget()
 {
     this->cleanup();
+    delete _kdTree;
+    delete _octtree;
 }
 
 void GLWidget::cleanup()
@@ -81,6 +105,12 @@ void GLWidget::initializeGL()
   initializeOpenGLFunctions();
   glClearColor(0, 0, 0, 1.0);
 
+  // glMultiDrawElements for the octtree ranges, one glDrawElements per range without it
+  _multiDraw = context()->versionFunctions<QOpenGLFunctions_1_4>();
+  if (_multiDraw) {
+    _multiDraw->initializeOpenGLFunctions();
+  }
+
   // the world is still for now
   _worldMatrix.setToIdentity();
 
@@ -164,19 +194,15 @@ void GLWidget::paintGL()
     // create shaders and map attributes
     initShaders();
 
-    // create array container and load points into buffer
-    const QVector<float>& pointsData =pointcloud.getData();
-    if(!_vao.isCreated()) _vao.create();
+    // load points into buffer, only after the cloud changed
+    if (_pointsDirty) {
+        createContainers();
+    }
+    // and rows of a cloud that is still loading
+    if (!_pendingPoints.empty()) {
+        uploadPendingPoints();
+    }
     QOpenGLVertexArrayObject::Binder vaoBinder(&_vao);
-    if(!_vertexBuffer.isCreated()) _vertexBuffer.create();
-    _vertexBuffer.bind();
-    _vertexBuffer.allocate(pointsData.constData(), pointsData.size() * sizeof(GLfloat));
-    QOpenGLFunctions *f = QOpenGLContext::currentContext()->functions();
-    f->glEnableVertexAttribArray(0);
-    f->glEnableVertexAttribArray(1);
-    f->glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3*sizeof(GLfloat) + sizeof(GLfloat), nullptr);
-    f->glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, 3*sizeof(GLfloat) + sizeof(GLfloat), reinterpret_cast<void *>(3*sizeof(GLfloat)));
-    _vertexBuffer.release();
 
     //
     // set camera
@@ -222,6 +248,7 @@ void GLWidget::paintGL()
         //
         drawPointCloud();
         aufgabe_3_2();
+        drawPickedPoint();
     }
 }
 
@@ -392,16 +419,20 @@ void GLWidget::aufgabe_3_1()
     }
 
 
-    std::vector<std::pair<QVector3D, QColor> > kdTreeLines;
-    std::vector<std::pair<QVector3D, QColor> > kdTreePoints;
-    constructBalanced3DTree(kdTreeLines, kdTreePoints, 0, x_array.size()-2, NULL, 0, 4);
-
+    if (!_kdTree) {
+        return;
+    }
+    // the tree does not change between loads, a paint only draws its upper levels
+    if (_kdTreePoints.empty()) {
+        int depth = 4;
+        _kdTree->get_tree_lines(_kdTreeLines, _kdTreePoints, depth);
+    }
 
     if (!_disable_tree)
     {
-        drawKDTreeLines(kdTreeLines);
+        drawKDTreeLines(_kdTreeLines);
 
-        drawKDTreePoints(kdTreePoints);
+        drawKDTreePoints(_kdTreePoints);
     }
 }
 
@@ -410,153 +441,96 @@ void GLWidget::aufgabe_3_2()
     if (_load_point_cloud) {
         load_point_cloud();
     }
-    std::vector<std::pair<QVector3D, QColor> > octtree_lines;
-
-    Octtree new_tree = init_octtree(octtree_lines);
+    if (!_octtree) {
+        return;
+    }
+    // the tree does not change between loads, a paint only draws its lines
+    if (_octtreeDepth > _octtreeLinesDepth) {
+        uploadOcttreeLines();
+    }
     if (!_disable_tree)
     {
-        drawKDTreeLines(octtree_lines);
-
+        drawOcttreeLines();
     }
 }
 
-Octtree GLWidget::init_octtree(std::vector<std::pair<QVector3D, QColor> > &octtree_lines)
+void GLWidget::load_point_cloud()
 {
-    QVector3D point1 = QVector3D(-0.5,-0.5,-0.5);
-    QVector3D point2 = QVector3D(0.5,0.5,0.5);
-    float length = 1;
-    Octtree *octtree = new Octtree(point1, point2, length);
-
-    octtree_lines.push_back(std::make_pair(point1, QColor(1,0,0)));
-    octtree_lines.push_back(std::make_pair(point2, QColor(1,0,0)));
-    //drawLines(octtree_lines);
-
-    // add points into octtree
-    for (QVector3D point: x_array)
-    {
-        if (!octtree->insert_point(point))
-        {
-            //printf("Point outside of octtree! x: %f, y: %f, z: %f\n", point.x(), point.y(), point.z());
-        }
-    }
+    _load_point_cloud = false;
 
-    // read octtree_lines
-    int depth = 5;
-    octtree->get_octtree_lines(octtree_lines, QColor(0,0,1), depth, *octtree->root);
-    return *octtree;
+    // drop the old cloud, the new one is parsed, sorted and indexed by the loader
+    delete _kdTree;
+    _kdTree = nullptr;
+    _kdTreeLines.clear();
+    _kdTreePoints.clear();
+    delete _octtree;
+    _octtree = nullptr;
+    _octtreeLinesDepth = -1;
+    _picked = false;
+    pointcloud = PointCloud();
+    _pointsDirty = true;
+
+    _pendingPoints.clear();
+    _previewing = true;
+    _previewCount = 0;
+    _previewTotal = 0;
+    _loader.load(_point_cloud_paths);
+    update();
 }
 
-void GLWidget::load_point_cloud()
+void GLWidget::onPointsLoaded(size_t first, size_t total, const QVector<float>& points)
 {
-    _load_point_cloud = false;
-    x_array.clear();
-    y_array.clear();
-    z_array.clear();
+    // uploaded with the next paint, the GL context is only current there
+    _previewTotal = total;
+    _pendingPoints.push_back(std::make_pair(first, points));
+    update();
+}
 
-    pointcloud.loadPLY(_point_cloud_path);
+void GLWidget::onCloudLoaded(QSharedPointer<LoadedCloud> loaded)
+{
+    pointcloud = std::move(loaded->cloud);
+    delete _kdTree;
+    _kdTree = loaded->tree;
+    loaded->tree = nullptr;
+    _kdTreeLines.clear();
+    _kdTreePoints.clear();
+    delete _octtree;
+    _octtree = loaded->octtree;
+    loaded->octtree = nullptr;
+    _octtreeLinesDepth = -1;
+    _picked = false;
     printf("%f %f %f",pointcloud.getMax().x(), pointcloud.getMax().y(), pointcloud.getMax().z());
     printf("%f %f %f",pointcloud.getMin().x(), pointcloud.getMin().y(), pointcloud.getMin().z());
-    const QVector<float>& pointsData = pointcloud.getData();
-    QVectorIterator<float> i(pointsData);
-    const float *p = pointsData.data();
-    for (size_t i = 0; i < pointsData.size(); ++i) {
-
-      float x, y, z;
-
-      x = *p++;
-      y = *p++;
-      z = *p++;
-      i = *p++;
-      QVector3D vec = QVector3D(x,y,z);
-      x_array.push_back(vec);
-      y_array.push_back(vec);
-      z_array.push_back(vec);
-
-    }
-
-    std::sort(x_array.begin(), x_array.end(), compareX);
-    std::sort(y_array.begin(), y_array.end(), compareY);
-    std::sort(z_array.begin(), z_array.end(), compareZ);
-
-    std::cout << "sorting done for x, y, z Arrays in Task 3"<< std::endl;
-    //for (auto x : x_array)
-    //    std::cout << "x[" << x.x() << ", " << x.y() << ", " << x.z() << "] "<< std::endl;
-    //for (auto y : y_array)
-    //    std::cout << "y[" << y.x() << ", " << y.y() << ", " << y.z()<< "] "<< std::endl;
-    //for (auto z : z_array)
-    //    std::cout << "z[" << z.x() << ", " << z.y() << ", " << z.z() << "] "<< std::endl;
 
+    // the final cloud replaces the preview, with its own stride and colors
+    _previewing = false;
+    _pendingPoints.clear();
+    _pointsDirty = true;
+    emit loadFinished(QString());
     update();
 }
 
-void GLWidget::constructBalanced3DTree(std::vector<std::pair<QVector3D, QColor> > &kdTreeLines, std::vector<std::pair<QVector3D, QColor> > &points, int left, int right, Tree * node, int d, int maxLvl)
+void GLWidget::onLoadFailed(const QString& message)
 {
-    if (maxLvl > 0) {
-        node = new Tree;
-
-        if (left <= right){
-            int m = (left + right) / 2;
-            if (d == 0) {
-                node->data = y_array[m];
-                node->split = "y-split";
-
-                points.push_back(std::make_pair(QVector3D(y_array[m].x(), y_array[m].y(), y_array[m].z()), QColor(0.0, 1.0, 1.0)));
-
-                kdTreeLines.push_back(std::make_pair(QVector3D(pointcloud.getMin().x(), y_array[m].y(), y_array[m].z()), QColor(1.0, 0.0, 0.0)));
-                kdTreeLines.push_back(std::make_pair(QVector3D(pointcloud.getMax().x(), y_array[m].y(), y_array[m].z()), QColor(1.0, 0.0, 0.0)));
-
-                partitionField(x_array, left, right, y_array[m], m, "y-split");
-            } else if (d == 1) {
-                node->data = x_array[m];
-                node->split = "x-split";
-
-                points.push_back(std::make_pair(QVector3D(x_array[m].x(), x_array[m].y(), x_array[m].z()), QColor(0.0, 1.0, 1.0)));
-
-                kdTreeLines.push_back(std::make_pair(QVector3D(x_array[m].x(), pointcloud.getMin().y(), x_array[m].z()), QColor(0.0, 1.0, 0.0)));
-                kdTreeLines.push_back(std::make_pair(QVector3D(x_array[m].x(), pointcloud.getMax().y(), x_array[m].z()), QColor(0.0, 1.0, 0.0)));
-                partitionField(z_array, left, right, x_array[m], m, "x-split");
-            } else if (d == 2) {
-                node->data = z_array[m];
-                node->split = "z-split";
-
-                points.push_back(std::make_pair(QVector3D(z_array[m].x(), z_array[m].y(), z_array[m].z()), QColor(0.0, 1.0, 1.0)));
-
-                kdTreeLines.push_back(std::make_pair(QVector3D(z_array[m].x(), z_array[m].y(), pointcloud.getMin().z()), QColor(0.0, 0.0, 1.0)));
-                kdTreeLines.push_back(std::make_pair(QVector3D(z_array[m].x(), z_array[m].y(), pointcloud.getMax().z()), QColor(0.0, 0.0, 1.0)));
-
-                partitionField(y_array, left, right, z_array[m], m, "z-split");
-
-            }
-
-            constructBalanced3DTree(kdTreeLines, points,left, m-1, node->left, (d + 1) % 3, maxLvl - 1);
-            constructBalanced3DTree(kdTreeLines, points, m+1, right, node->right, (d + 1 ) % 3, maxLvl - 1);
-        }
-    }
+    std::cout << "loading " << _point_cloud_paths.join(", ").toStdString() << " failed: " << message.toStdString() << std::endl;
+    _previewing = false;
+    _pendingPoints.clear();
+    _pointsDirty = true;
+    emit loadFinished(message);
+    update();
 }
 
-void GLWidget::partitionField(std::vector<QVector3D> array, int left, int right, QVector3D medianVector, int m, std::string direction)
+void GLWidget::cancelLoading()
 {
-    std::vector<QVector3D> tmp1;
-    std::vector<QVector3D> tmp2;
-
-    for (int i = left; i <= right; i++) {
-        if (direction == "x-split") {
-            if(array[i].x() < medianVector.x()) tmp1.push_back(array[i]);
-            if(array[i].x() > medianVector.x()) tmp2.push_back(array[i]);
-        } else if (direction == "y-split") {
-            if(array[i].y() < medianVector.y()) tmp1.push_back(array[i]);
-            if(array[i].y() > medianVector.y()) tmp2.push_back(array[i]);
-        } else if (direction == "z-split") {
-            if(array[i].z() < medianVector.z()) tmp1.push_back(array[i]);
-            if(array[i].z() > medianVector.z()) tmp2.push_back(array[i]);
-        }
-
-
-
+    if (!_loader.isLoading()) {
+        return;
     }
-    for (int i = 0; i < tmp1.size(); i++) array[left + i] = tmp1[i];
-    for (int i = 0; i < tmp2.size(); i++) array[m + i + 1] = tmp2[i];
-
+    _loader.cancel();
+    _previewing = false;
+    _pendingPoints.clear();
+    _pointsDirty = true;
+    emit loadFinished(tr("loading cancelled"));
+    update();
 }
 
 QVector4D GLWidget::calculateImagePrinciplePoint(float focalLength, QVector4D positionCamera, QVector3D cameraRotation)
@@ -859,12 +833,12 @@ void GLWidget::drawKDTreePoints(std::vector<std::pair<QVector3D, QColor>> quader
   glEnd();
 }
 
-void GLWidget::drawKDTreeLines(std::vector<std::pair<QVector3D, QColor>> quader)
+void GLWidget::drawKDTreeLines(const std::vector<std::pair<QVector3D, QColor>>& quader)
 {
   glBegin(GL_LINES);
 
    const auto viewMatrix = _projectionMatrix * _cameraMatrix * _worldMatrix;
-  for (auto vertex : quader) {
+  for (const auto& vertex : quader) {
     const auto translated = viewMatrix * vertex.first;
     glColor3f(vertex.second.red(), vertex.second.green(), vertex.second.blue());
     glVertex3f(translated.x(), translated.y(), translated.z());
@@ -872,6 +846,59 @@ void GLWidget::drawKDTreeLines(std::vector<std::pair<QVector3D, QColor>> quader)
   glEnd();
 }
 
+void GLWidget::uploadOcttreeLines()
+{
+    std::vector<QVector3D> corners;
+    std::vector<uint32_t> indices;
+    _octtree->get_octtree_wireframe(_octtreeDepth, corners, indices, _octtreeLineEnds);
+
+    // the diagonal of the root in red comes first, so every depth draws it
+    const uint32_t count = static_cast<uint32_t>(corners.size());
+    corners.push_back(_octtree->near_bot_left());
+    corners.push_back(_octtree->far_top_right());
+    indices.insert(indices.begin(), {count, count + 1});
+    std::vector<unsigned char> colors(3 * corners.size(), 0);
+    for (uint32_t i = 0; i < count; ++i) {
+        colors[3 * i + 2] = 255;
+    }
+    colors[3 * count] = colors[3 * count + 3] = 255;
+
+    // positions and colors in one buffer, bound to the fixed function arrays of its own vao
+    const size_t positionBytes = corners.size() * sizeof(QVector3D);
+    if(!_octtreeVao.isCreated()) _octtreeVao.create();
+    QOpenGLVertexArrayObject::Binder vaoBinder(&_octtreeVao);
+    if(!_octtreeVertexBuffer.isCreated()) _octtreeVertexBuffer.create();
+    _octtreeVertexBuffer.bind();
+    allocateBuffer(_octtreeVertexBuffer, nullptr, positionBytes + colors.size());
+    writeBuffer(_octtreeVertexBuffer, 0, corners.data(), positionBytes);
+    writeBuffer(_octtreeVertexBuffer, positionBytes, colors.data(), colors.size());
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(3, GL_FLOAT, 0, nullptr);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glColorPointer(3, GL_UNSIGNED_BYTE, 0, reinterpret_cast<void *>(positionBytes));
+    _octtreeVertexBuffer.release();
+    if(!_octtreeIndexBuffer.isCreated()) _octtreeIndexBuffer.create();
+    _octtreeIndexBuffer.bind();
+    allocateBuffer(_octtreeIndexBuffer, indices.data(), indices.size() * sizeof(uint32_t));
+    _octtreeLinesDepth = _octtreeDepth;
+}
+
+void GLWidget::drawOcttreeLines()
+{
+    if (_octtreeLineEnds.empty()) {
+        return;
+    }
+    // the view matrix goes to the GL, the lines are never touched on the cpu
+    const size_t level = std::min(static_cast<size_t>(_octtreeDepth), _octtreeLineEnds.size() - 1);
+    const QMatrix4x4 viewMatrix = _projectionMatrix * _cameraMatrix * _worldMatrix;
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadMatrixf(viewMatrix.constData());
+    QOpenGLVertexArrayObject::Binder vaoBinder(&_octtreeVao);
+    glDrawElements(GL_LINES, static_cast<GLsizei>(2 + _octtreeLineEnds[level]), GL_UNSIGNED_INT, nullptr);
+    glPopMatrix();
+}
+
 void GLWidget::resizeGL(int w, int h)
 {
   _projectionMatrix.setToIdentity();
@@ -925,6 +952,15 @@ void GLWidget::keyPressEvent(QKeyEvent * event)
         _currentCamera->down();
         break;
 
+      // depth of the octtree lines
+      case Qt::Key_Plus:
+        _octtreeDepth = std::min(_octtreeDepth + 1, OCTTREE_MAX_DEPTH);
+        break;
+
+      case Qt::Key_Minus:
+        _octtreeDepth = std::max(_octtreeDepth - 1, 0);
+        break;
+
       default:
         QWidget::keyPressEvent(event);
     }
@@ -938,7 +974,11 @@ void GLWidget::mouseMoveEvent(QMouseEvent *event)
 
   _prevMousePosition = event->pos();
 
-  if (event->buttons() & Qt::LeftButton)
+  if (event->buttons() == Qt::NoButton && _pick_points)
+  {
+      pickPoint(event->pos());
+  }
+  else if (event->buttons() & Qt::LeftButton)
   {
       _currentCamera->rotate(dy, dx, 0);
   }
@@ -959,6 +999,55 @@ void GLWidget::mouseMoveEvent(QMouseEvent *event)
   }
 }
 
+void GLWidget::pickPoint(const QPoint& position)
+{
+  const bool picked = _picked;
+  _picked = false;
+  if (_octtree && width() > 0 && height() > 0)
+  {
+      // the pixel and one PICK_TOLERANCE_PIXELS to its right on the near and the far plane
+      const QMatrix4x4 unproject = (_projectionMatrix * _cameraMatrix * _worldMatrix).inverted();
+      const float x = 2.0f * position.x() / width() - 1.0f;
+      const float y = 1.0f - 2.0f * position.y() / height();
+      const float dx = 2.0f * PICK_TOLERANCE_PIXELS / width();
+      const QVector3D nearPoint = unproject * QVector3D(x, y, -1);
+      const QVector3D farPoint = unproject * QVector3D(x, y, 1);
+      const float nearRadius = (unproject * QVector3D(x + dx, y, -1) - nearPoint).length();
+      const float farRadius = (unproject * QVector3D(x + dx, y, 1) - farPoint).length();
+      const float depth = (farPoint - nearPoint).length();
+
+      OcttreeNeighbour hit;
+      if (depth > 0) {
+          _picked = _octtree->pick(nearPoint, farPoint - nearPoint, nearRadius, (farRadius - nearRadius) / depth,
+                                   hit, _pickedPoint);
+      }
+      if (_picked && hit.row != _pickedRow) {
+          _pickedRow = hit.row;
+          emit pointPicked(tr("picked row %1 at %2 %3 %4").arg(pointcloud.getOriginalRow(hit.row))
+                           .arg(_pickedPoint.x()).arg(_pickedPoint.y()).arg(_pickedPoint.z()));
+      }
+  }
+  if (picked && !_picked)
+  {
+      _pickedRow = UINT32_MAX;
+      emit pointPicked(QString());
+  }
+  if (_picked || picked)
+  {
+      update();
+  }
+}
+
+void GLWidget::drawPickedPoint()
+{
+  if (_picked)
+  {
+      std::vector<std::pair<QVector3D, QColor>> picked;
+      picked.push_back(std::make_pair(_pickedPoint, QColor(1, 0, 0)));
+      drawKDTreePoints(picked);
+  }
+}
+
 void GLWidget::attachCamera(QSharedPointer<Camera> camera)
 {
   if (_currentCamera)
@@ -983,19 +1072,20 @@ void GLWidget::setPointSize(size_t size)
 
 void GLWidget::openFileDialog()
 {
-    const QString filePath = QFileDialog::getOpenFileName(this, tr("Open PLY file"), "", tr("PLY Files (*.ply)"));
+    // several files are the tiles of one cloud
+    const QStringList filePaths = QFileDialog::getOpenFileNames(this, tr("Open PLY files"), "", tr("PLY Files (*.ply)"));
 
     if (_show_aufgabe_1 || _show_aufgabe_2)
     {
         return;
     }
 
-    if (!filePath.isEmpty())
+    if (!filePaths.isEmpty())
     {
-        _point_cloud_path = filePath;
-        std::cout << filePath.toStdString() << std::endl;
+        _point_cloud_paths = filePaths;
+        std::cout << filePaths.join(", ").toStdString() << std::endl;
+        // a load that is still running is cancelled by the new one
         load_point_cloud();
-        update();
     }
 }
 
@@ -1120,6 +1210,70 @@ void GLWidget::disable_tree()
     update();
 }
 
+void GLWidget::quantize_points()
+{
+    if (_quantize_points == true) {
+        _quantize_points = false;
+    } else {
+        _quantize_points = true;
+    }
+    // the floats are gone after quantizing, so the cloud is loaded again, from its cache
+    _loader.setQuantize(_quantize_points);
+    if (!_show_aufgabe_1 && !_show_aufgabe_2) {
+        load_point_cloud();
+    }
+}
+
+void GLWidget::level_of_detail()
+{
+    if (_level_of_detail == true) {
+        _level_of_detail = false;
+    } else {
+        _level_of_detail = true;
+    }
+    // the samples are built with the octtree, nothing is loaded again
+    update();
+}
+
+void GLWidget::pick_points()
+{
+    _pick_points = !_pick_points;
+    if (!_pick_points && _picked) {
+        _picked = false;
+        _pickedRow = UINT32_MAX;
+        emit pointPicked(QString());
+        update();
+    }
+}
+
+void GLWidget::voxel_downsample()
+{
+    if (_voxel_downsample == true) {
+        _voxel_downsample = false;
+    } else {
+        _voxel_downsample = true;
+    }
+    // the file is streamed again and thinned while it is read
+    _loader.setVoxels(_voxel_downsample ? VOXEL_RESOLUTION : 0);
+    if (!_show_aufgabe_1 && !_show_aufgabe_2) {
+        load_point_cloud();
+    }
+}
+
+void GLWidget::morton_order()
+{
+    if (_morton_order == true) {
+        _morton_order = false;
+    } else {
+        _morton_order = true;
+    }
+    // the loader reorders after the cache is written, the reload comes from the cache
+    _loader.setReorder(_morton_order);
+    if (!_show_aufgabe_1 && !_show_aufgabe_2) {
+        load_point_cloud();
+    }
+}
+
 void GLWidget::initShaders()
 {
     _shaders.reset(new QOpenGLShaderProgram());
@@ -1128,7 +1282,10 @@ void GLWidget::initShaders()
     assert(vsLoaded && fsLoaded);
     // vector attributes
     _shaders->bindAttributeLocation("vertex", 0);
-    _shaders->bindAttributeLocation("pointRowIndex", 1);
+    _shaders->bindAttributeLocation("red", 1);
+    _shaders->bindAttributeLocation("green", 2);
+    _shaders->bindAttributeLocation("blue", 3);
+    _shaders->bindAttributeLocation("row", 4);
     // constants
     _shaders->bind();
     _shaders->setUniformValue("lightPos", QVector3D(0, 0, 50));
@@ -1141,31 +1298,168 @@ void GLWidget::initShaders()
 void GLWidget::createContainers()
 {
     // create array container and load points into buffer
-    const QVector<float>& pointsData =pointcloud.getData();
+    // the view either points into _pointsData or directly into the mapped ply file,
+    // in both cases it is handed to GL as is, with the record stride of its source
+    const PointView& view = pointcloud.getView();
     if(!_vao.isCreated()) _vao.create();
     QOpenGLVertexArrayObject::Binder vaoBinder(&_vao);
     if(!_vertexBuffer.isCreated()) _vertexBuffer.create();
     _vertexBuffer.bind();
-    _vertexBuffer.allocate(pointsData.constData(), pointsData.size() * sizeof(GLfloat));
     QOpenGLFunctions *f = QOpenGLContext::currentContext()->functions();
     f->glEnableVertexAttribArray(0);
-    f->glEnableVertexAttribArray(1);
-    f->glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3*sizeof(GLfloat) + sizeof(GLfloat), nullptr);
-    f->glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, 3*sizeof(GLfloat) + sizeof(GLfloat), reinterpret_cast<void *>(3*sizeof(GLfloat)));
+    if (pointcloud.isQuantized()) {
+        // normalized to [0, 1] by the GL, the vertex shader scales them into the AABB
+        const std::vector<uint16_t>& quantized = pointcloud.getQuantized();
+        allocateBuffer(_vertexBuffer, quantized.data(), quantized.size() * sizeof(uint16_t));
+        f->glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, static_cast<GLsizei>(QUANTIZED_STRIDE * sizeof(uint16_t)), nullptr);
+    } else {
+        allocateBuffer(_vertexBuffer, view.data, view.count * view.stride);
+        f->glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, static_cast<GLsizei>(view.stride), reinterpret_cast<void *>(view.offset));
+    }
+    _vertexBuffer.release();
+    _previewBytes = 0;
+
+    // uchar color columns are bound as they are, the GL normalizes them to [0, 1]
+    const PointColumn* red = pointcloud.getColumn("red");
+    const PointColumn* green = pointcloud.getColumn("green");
+    const PointColumn* blue = pointcloud.getColumn("blue");
+    _hasColor = red && green && blue
+            && red->type == PlyType::UInt8 && green->type == PlyType::UInt8 && blue->type == PlyType::UInt8;
+    if (_hasColor) {
+        const size_t count = pointcloud.getCount();
+        if(!_colorBuffer.isCreated()) _colorBuffer.create();
+        _colorBuffer.bind();
+        allocateBuffer(_colorBuffer, nullptr, 3 * count);
+        writeBuffer(_colorBuffer, 0, red->data.data(), count);
+        writeBuffer(_colorBuffer, count, green->data.data(), count);
+        writeBuffer(_colorBuffer, 2 * count, blue->data.data(), count);
+        for (GLuint channel = 0; channel < 3; ++channel) {
+            f->glEnableVertexAttribArray(1 + channel);
+            f->glVertexAttribPointer(1 + channel, 1, GL_UNSIGNED_BYTE, GL_TRUE, 0, reinterpret_cast<void *>(channel * count));
+        }
+        _colorBuffer.release();
+    } else {
+        for (GLuint channel = 0; channel < 3; ++channel) {
+            f->glDisableVertexAttribArray(1 + channel);
+        }
+    }
+
+    // a reordered cloud keeps coloring and ids by file row
+    if (pointcloud.isReordered()) {
+        const std::vector<uint32_t>& rows = pointcloud.getOriginalRows();
+        if(!_rowBuffer.isCreated()) _rowBuffer.create();
+        _rowBuffer.bind();
+        allocateBuffer(_rowBuffer, rows.data(), rows.size() * sizeof(uint32_t));
+        f->glEnableVertexAttribArray(4);
+        f->glVertexAttribPointer(4, 1, GL_UNSIGNED_INT, GL_FALSE, 0, nullptr);
+        _rowBuffer.release();
+    } else {
+        f->glDisableVertexAttribArray(4);
+    }
+
+    // the element buffer binding is part of the vao, so it is not released here
+    // a point cloud gets the octtree order instead, for the ranges of the level of detail
+    const std::vector<uint32_t>& faces = pointcloud.getFaces();
+    _hasDrawOrder = false;
+    if (!faces.empty()) {
+        if(!_indexBuffer.isCreated()) _indexBuffer.create();
+        _indexBuffer.bind();
+        allocateBuffer(_indexBuffer, faces.data(), faces.size() * sizeof(uint32_t));
+    } else if (_octtree && _octtree->get_rows().size() == pointcloud.getCount()) {
+        const std::vector<uint32_t> order = _octtree->get_draw_order();
+        if(!_indexBuffer.isCreated()) _indexBuffer.create();
+        _indexBuffer.bind();
+        allocateBuffer(_indexBuffer, order.data(), order.size() * sizeof(uint32_t));
+        _hasDrawOrder = true;
+    }
+    _pointsDirty = false;
+}
+
+void GLWidget::uploadPendingPoints()
+{
+    // a buffer sized for the whole cloud, every chunk goes to the rows it covers
+    QOpenGLVertexArrayObject::Binder vaoBinder(&_vao);
+    if(!_vertexBuffer.isCreated()) _vertexBuffer.create();
+    _vertexBuffer.bind();
+    const size_t bytes = _previewTotal * POINT_STRIDE * sizeof(float);
+    QOpenGLFunctions *f = QOpenGLContext::currentContext()->functions();
+    if (_previewBytes != bytes) {
+        allocateBuffer(_vertexBuffer, nullptr, bytes);
+        _previewBytes = bytes;
+    }
+    // the vao may still hold the attributes of the cloud before, with its colors and rows,
+    // the preview is plain float positions whatever its size
+    f->glEnableVertexAttribArray(0);
+    f->glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, static_cast<GLsizei>(POINT_STRIDE * sizeof(float)), nullptr);
+    for (GLuint channel = 0; channel < 3; ++channel) {
+        f->glDisableVertexAttribArray(1 + channel);
+    }
+    f->glDisableVertexAttribArray(4);
+    _hasColor = false;
+    for (const auto& chunk : _pendingPoints) {
+        writeBuffer(_vertexBuffer, chunk.first * POINT_STRIDE * sizeof(float), chunk.second.constData(),
+                    chunk.second.size() * sizeof(float));
+        // chunks arrive in row order
+        _previewCount = chunk.first + chunk.second.size() / POINT_STRIDE;
+    }
     _vertexBuffer.release();
+    _pendingPoints.clear();
 }
 
 void GLWidget::drawPointCloud()
 {
     const auto viewMatrix = _projectionMatrix * _cameraMatrix * _worldMatrix;
+    // while loading, only the rows that arrived so far
+    const size_t count = _previewing ? _previewCount : pointcloud.getCount();
+    const size_t total = _previewing ? _previewTotal : pointcloud.getCount();
     _shaders->bind();
-    _shaders->setUniformValue("pointsCount", static_cast<GLfloat>(pointcloud.getCount()));
+    _shaders->setUniformValue("pointsCount", static_cast<GLfloat>(total));
     _shaders->setUniformValue("viewMatrix", viewMatrix);
     _shaders->setUniformValue("pointSize", _pointSize);
     //_shaders->setUniformValue("colorAxisMode", static_cast<GLfloat>(_colorMode));
     _shaders->setUniformValue("colorAxisMode", static_cast<GLfloat>(0));
+    _shaders->setUniformValue("hasColor", static_cast<GLfloat>(_hasColor ? 1 : 0));
     _shaders->setUniformValue("pointsBoundMin", pointcloud.getMin());
     _shaders->setUniformValue("pointsBoundMax", pointcloud.getMax());
-    glDrawArrays(GL_POINTS, 0, pointcloud.getData().size());
+    // the preview of a loading cloud is always float
+    const bool quantized = !_previewing && pointcloud.isQuantized();
+    _shaders->setUniformValue("quantized", static_cast<GLfloat>(quantized ? 1 : 0));
+    _shaders->setUniformValue("quantizeMin", pointcloud.getMin());
+    _shaders->setUniformValue("quantizeExtent", pointcloud.getQuantizeStep() * QUANTIZED_MAX);
+    _shaders->setUniformValue("reordered", static_cast<GLfloat>(!_previewing && pointcloud.isReordered() ? 1 : 0));
+    // meshes as triangles over the shared vertices, once they are loaded completely
+    if (!_previewing && pointcloud.getFaceCount() > 0) {
+        glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(pointcloud.getFaces().size()), GL_UNSIGNED_INT, nullptr);
+    } else if (!_previewing && _hasDrawOrder) {
+        // the octtree nodes in the view frustum, with level of detail small ones by their sample
+        QElapsedTimer timer;
+        timer.start();
+        const float pixelsPerUnit = _projectionMatrix(1, 1) * height() / 2;
+        const size_t chunks = _octtree->select_lod(viewMatrix, pixelsPerUnit, _level_of_detail ? LOD_PIXEL_ERROR : 0.0f,
+                                                   _lodRanges);
+        const double cullingMs = timer.nsecsElapsed() / 1e6;
+
+        size_t points = 0;
+        _drawCounts.resize(_lodRanges.size());
+        _drawOffsets.resize(_lodRanges.size());
+        for (size_t i = 0; i < _lodRanges.size(); ++i) {
+            _drawCounts[i] = static_cast<GLsizei>(_lodRanges[i].count);
+            _drawOffsets[i] = reinterpret_cast<const void *>(_lodRanges[i].first * sizeof(uint32_t));
+            points += _lodRanges[i].count;
+        }
+        if (_multiDraw) {
+            _multiDraw->glMultiDrawElements(GL_POINTS, _drawCounts.data(), GL_UNSIGNED_INT, _drawOffsets.data(),
+                                            static_cast<GLsizei>(_drawCounts.size()));
+        } else {
+            for (size_t i = 0; i < _drawCounts.size(); ++i) {
+                glDrawElements(GL_POINTS, _drawCounts[i], GL_UNSIGNED_INT, _drawOffsets[i]);
+            }
+        }
+        emit frameStats(tr("%1 of %2 chunks in view, %3 draw ranges, %4 of %5 points, culled in %6 ms")
+                        .arg(chunks).arg(_octtree->get_nodes().size()).arg(_lodRanges.size())
+                        .arg(points).arg(pointcloud.getCount()).arg(cullingMs, 0, 'f', 3));
+    } else {
+        glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(count));
+    }
     _shaders->release();
 }
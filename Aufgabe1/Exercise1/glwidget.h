@@ -8,6 +8,7 @@
 
 #include <QOpenGLWidget>
 #include <QOpenGLFunctions>
+#include <QOpenGLFunctions_1_4>
 #include <QOpenGLVertexArrayObject>
 #include <QOpenGLShaderProgram>
 #include <QOpenGLBuffer>
@@ -18,6 +19,7 @@
 #include <vector>
 
 #include "camera.h"
+#include "cloudloader.h"
 #include "pointcloud.h"
 #include "tree.h"
 #include "octtree.h"
@@ -45,8 +47,25 @@ public slots:
     void disable_camera_2();
     void disable_reconstruction();
     void disable_tree();
+    void quantize_points();
+    void morton_order();
+    void level_of_detail();
+    void voxel_downsample();
+    // points under the mouse are picked only while this is on
+    void pick_points();
     void setPointSize(size_t size);
     void attachCamera(QSharedPointer<Camera> camera);
+    // stops a running background load, the partly loaded cloud is dropped
+    void cancelLoading();
+
+signals:
+    void loadProgress(const QString& stage, int percent);
+    // empty message after a successful load
+    void loadFinished(const QString& message);
+    // visible octtree chunks and culling time of the last frame
+    void frameStats(const QString& message);
+    // row and position of the picked point, empty once nothing is picked
+    void pointPicked(const QString& message);
 
 protected:
     void paintGL() Q_DECL_OVERRIDE;
@@ -61,14 +80,20 @@ protected:
 
 private slots:
   void onCameraChanged(const CameraState& state);
+  void onPointsLoaded(size_t first, size_t total, const QVector<float>& points);
+  void onCloudLoaded(QSharedPointer<LoadedCloud> loaded);
+  void onLoadFailed(const QString& message);
 
 private:
   void initShaders();
   void createContainers();
+  void uploadPendingPoints();
   void cleanup();
   void drawLines(std::vector<std::pair<QVector3D, QColor>>);
-  void drawKDTreeLines(std::vector<std::pair<QVector3D, QColor>>);
+  void drawKDTreeLines(const std::vector<std::pair<QVector3D, QColor>>&);
   void drawKDTreePoints(std::vector<std::pair<QVector3D, QColor>> quader);
+  void uploadOcttreeLines();
+  void drawOcttreeLines();
 
 
   void drawPointCloud();
@@ -81,14 +106,9 @@ private:
   QVector4D calculateImagePrinciplePoint(float focalLength, QVector4D positionCamera, QVector3D cameraRotation);
   QVector4D calculate_image_plane_equation(QVector3D imagePrinciplePoint, QVector3D rotation);
   
-  Tree root;
   float _pointSize;
   std::vector<std::pair<QVector3D, QColor> > _axesLines;
 
-  std::vector<QVector3D> x_array;
-  std::vector<QVector3D> y_array;
-  std::vector<QVector3D> z_array;
-
   QMatrix4x4 rotation_x(float);
   QMatrix4x4 rotation_y(float);
   QMatrix4x4 rotation_z(float);
@@ -96,17 +116,38 @@ private:
   QPoint _prevMousePosition;
   QOpenGLVertexArrayObject _vao;
   QOpenGLBuffer _vertexBuffer;
+  QOpenGLBuffer _colorBuffer;
+  // file row of every vertex of a reordered cloud
+  QOpenGLBuffer _rowBuffer;
+  // triangles of a mesh, bound in the vao next to the vertices
+  QOpenGLBuffer _indexBuffer{QOpenGLBuffer::IndexBuffer};
+  bool _hasColor = false;
   QScopedPointer<QOpenGLShaderProgram> _shaders;
 
   void aufgabe_1();
   void aufgabe_2();
   void aufgabe_3_1();
   void aufgabe_3_2();
-  Octtree init_octtree(std::vector<std::pair<QVector3D, QColor> > &octtree_lines);
+  Octtree* _octtree = nullptr;
+  // edges of _octtree as GL_LINES, uploaded on the first paint after a load or after the depth
+  // grew past them. The lines are stored level by level, a smaller depth draws a prefix
+  QOpenGLVertexArrayObject _octtreeVao;
+  QOpenGLBuffer _octtreeVertexBuffer;
+  QOpenGLBuffer _octtreeIndexBuffer{QOpenGLBuffer::IndexBuffer};
+  std::vector<uint32_t> _octtreeLineEnds;
+  int _octtreeDepth = 5;
+  int _octtreeLinesDepth = -1;
+  // the point under the mouse, picked through _octtree while picking is on and no button is down
+  void pickPoint(const QPoint& position);
+  void drawPickedPoint();
+  bool _picked = false;
+  uint32_t _pickedRow = UINT32_MAX;
+  QVector3D _pickedPoint;
   void load_point_cloud();
-  void constructBalanced3DTree(std::vector<std::pair<QVector3D, QColor> > &kdTreeLines, std::vector<std::pair<QVector3D, QColor> > &points, int left, int right, Tree * node, int d, int maxLvl);
-  void partitionField(std::vector<QVector3D> test, int left, int right, QVector3D medianVec, int m, std::string dir);
+  Tree* _kdTree = nullptr;
+  // split planes and medians of the upper levels of _kdTree, kept until the next load
   std::vector<std::pair<QVector3D, QColor> > _kdTreeLines;
+  std::vector<std::pair<QVector3D, QColor> > _kdTreePoints;
 
   bool _show_aufgabe_1 = false;
   bool _show_aufgabe_2 = false;
@@ -120,6 +161,18 @@ private:
   bool _disable_camera2 = false;
   bool _disable_reconstruction = false;
   bool _disable_tree = false;
+  bool _quantize_points = false;
+  bool _morton_order = false;
+  bool _level_of_detail = false;
+  bool _voxel_downsample = false;
+  bool _pick_points = false;
+  // the element buffer holds Octtree::get_draw_order() of a point cloud, the ranges of a frame
+  bool _hasDrawOrder = false;
+  std::vector<OcttreeRange> _lodRanges;
+  // the ranges as glMultiDrawElements takes them, kept between frames
+  std::vector<GLsizei> _drawCounts;
+  std::vector<const void*> _drawOffsets;
+  QOpenGLFunctions_1_4* _multiDraw = nullptr;
 
   QMatrix4x4 _projectionMatrix;
   QMatrix4x4 _cameraMatrix;
@@ -130,7 +183,18 @@ private:
 
   PointCloud pointcloud;
   bool _load_point_cloud = true;
-  QString _point_cloud_path = "C:/Users/keller/Desktop/bunny.ply";
+  bool _pointsDirty = true;
+
+  // background load, rows of the cloud are drawn as they arrive until it is done
+  CloudLoader _loader;
+  bool _previewing = false;
+  size_t _previewCount = 0;
+  size_t _previewTotal = 0;
+  // bytes of the preview in _vertexBuffer, 0 once the final cloud is in it
+  size_t _previewBytes = 0;
+  std::vector<std::pair<size_t, QVector<float> > > _pendingPoints;
+  // a single ply, several tiles or directories of tiles, loaded as one cloud
+  QStringList _point_cloud_paths = QStringList("C:/Users/keller/Desktop/bunny.ply");
 
   QSharedPointer<Camera> _currentCamera;
   QVector3D centralProjection(float focalLength, QVector3D vertex, QVector3D projectionCenter, QVector3D imagePrinciplePoint, QVector3D rotation, QVector4D image_plane);
@@ -2,6 +2,7 @@
 
 #include <QFileDialog>
 #include <QKeyEvent>
+#include <QStatusBar>
 
 #include <iostream>
 MainWindow::MainWindow(QWidget *parent)
@@ -29,6 +30,30 @@ MainWindow::MainWindow(QWidget *parent)
     QObject::connect(ui->checkBox_6,&QCheckBox::clicked,ui->glwidget,&GLWidget::disable_rays);
     QObject::connect(ui->checkBox_7,&QCheckBox::clicked,ui->glwidget,&GLWidget::disable_image_plane);
     QObject::connect(ui->checkBox_8,&QCheckBox::clicked,ui->glwidget,&GLWidget::disable_tree);
+    QObject::connect(ui->checkBox_9,&QCheckBox::clicked,ui->glwidget,&GLWidget::quantize_points);
+    QObject::connect(ui->checkBox_10,&QCheckBox::clicked,ui->glwidget,&GLWidget::morton_order);
+    QObject::connect(ui->checkBox_11,&QCheckBox::clicked,ui->glwidget,&GLWidget::level_of_detail);
+    QObject::connect(ui->checkBox_12,&QCheckBox::clicked,ui->glwidget,&GLWidget::voxel_downsample);
+    QObject::connect(ui->checkBox_13,&QCheckBox::clicked,ui->glwidget,&GLWidget::pick_points);
+
+    // load progress in the status bar, with a button to cancel the load
+    _loadProgress = new QProgressBar(this);
+    _loadProgress->setRange(0, 100);
+    _loadProgress->setMaximumWidth(200);
+    _cancelLoad = new QPushButton(tr("Cancel"), this);
+    statusBar()->addPermanentWidget(_loadProgress);
+    statusBar()->addPermanentWidget(_cancelLoad);
+    _loadProgress->hide();
+    _cancelLoad->hide();
+    QObject::connect(_cancelLoad,&QPushButton::clicked,ui->glwidget,&GLWidget::cancelLoading);
+    QObject::connect(ui->glwidget,&GLWidget::loadProgress,this,&MainWindow::showLoadProgress);
+    QObject::connect(ui->glwidget,&GLWidget::loadFinished,this,&MainWindow::showLoadResult);
+
+    // culling of the last frame, next to the messages
+    _frameStats = new QLabel(this);
+    statusBar()->addPermanentWidget(_frameStats);
+    QObject::connect(ui->glwidget,&GLWidget::frameStats,this,&MainWindow::showFrameStats);
+    QObject::connect(ui->glwidget,&GLWidget::pointPicked,this,&MainWindow::showPickedPoint);
 
 
     updatePointSize(1);
@@ -57,3 +82,28 @@ void MainWindow::updatePointSize(size_t value)
     std::cout << "new pointsize: " << value << std::endl;
     ui->glwidget->setPointSize(value);
 }
+
+void MainWindow::showLoadProgress(const QString& stage, int percent)
+{
+    statusBar()->showMessage(stage + "...");
+    _loadProgress->setValue(percent);
+    _loadProgress->show();
+    _cancelLoad->show();
+}
+
+void MainWindow::showLoadResult(const QString& message)
+{
+    statusBar()->showMessage(message.isEmpty() ? tr("point cloud loaded") : message, 5000);
+    _loadProgress->hide();
+    _cancelLoad->hide();
+}
+
+void MainWindow::showFrameStats(const QString& message)
+{
+    _frameStats->setText(message);
+}
+
+void MainWindow::showPickedPoint(const QString& message)
+{
+    statusBar()->showMessage(message);
+}
@@ -4,7 +4,10 @@
 
 #pragma once
 
+#include <QtWidgets/QLabel>
 #include <QtWidgets/QMainWindow>
+#include <QtWidgets/QProgressBar>
+#include <QtWidgets/QPushButton>
 #include <QVector3D>
 #include <QSharedPointer>
 
@@ -22,9 +25,16 @@ public:
 protected slots:
   void openFileDialog();
   void updatePointSize(size_t);
+  void showLoadProgress(const QString& stage, int percent);
+  void showLoadResult(const QString& message);
+  void showFrameStats(const QString& message);
+  void showPickedPoint(const QString& message);
 
 
 private:
 	Ui::MainWindowClass *ui;
     QSharedPointer<Camera> _camera;
+    QProgressBar* _loadProgress;
+    QPushButton* _cancelLoad;
+    QLabel* _frameStats;
 };
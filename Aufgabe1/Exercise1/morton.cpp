@@ -0,0 +1,89 @@
+#include "morton.h"
+#include <algorithm>
+#include "parallel.h"
+
+// below this many keys a single thread sorts faster than the threads start
+static const size_t PARALLEL_SORT_KEYS = 1 << 16;
+static const int RADIX_BITS = 11;
+static const size_t RADIX_BUCKETS = 1 << RADIX_BITS;
+
+MortonGrid::MortonGrid(const QVector3D& min, const QVector3D& max)
+    : _min(min)
+{
+    // a flat axis keeps all points in cell 0
+    for (int k = 0; k < 3; ++k) {
+        const float extent = max[k] - min[k];
+        _scale[k] = extent > 0 ? MORTON_CELLS / extent : 0.0f;
+        _cellSize[k] = extent / MORTON_CELLS;
+    }
+}
+
+uint64_t MortonGrid::code(const QVector3D& point) const
+{
+    uint32_t cell[3];
+    for (int k = 0; k < 3; ++k) {
+        // NaN must not reach the conversion, it goes to cell 0 with everything below the grid
+        const float c = (point[k] - _min[k]) * _scale[k];
+        cell[k] = !(c > 0) ? 0 : static_cast<uint32_t>(std::min(c, static_cast<float>(MORTON_CELLS - 1)));
+    }
+    return mortonEncode(cell[0], cell[1], cell[2]);
+}
+
+QVector3D MortonGrid::cellMin(uint32_t x, uint32_t y, uint32_t z) const
+{
+    return _min + QVector3D(x, y, z) * _cellSize;
+}
+
+void sortMorton(std::vector<MortonKey>& keys)
+{
+    std::vector<MortonKey> buffer;
+    sortMorton(keys, buffer);
+}
+
+void sortMorton(std::vector<MortonKey>& keys, std::vector<MortonKey>& buffer)
+{
+    const size_t count = keys.size();
+    const unsigned blocks = count < PARALLEL_SORT_KEYS ? 1 : workerCount();
+    buffer.resize(count);
+    std::vector<size_t> offsets(blocks * RADIX_BUCKETS);
+
+    for (int shift = 0; shift < 3 * MORTON_BITS; shift += RADIX_BITS) {
+        // a histogram of the digit per block
+        std::fill(offsets.begin(), offsets.end(), 0);
+        const MortonKey* from = keys.data();
+        MortonKey* to = buffer.data();
+        parallelBlocks(count, blocks, [&](size_t begin, size_t end, unsigned block) {
+            size_t* histogram = offsets.data() + block * RADIX_BUCKETS;
+            for (size_t i = begin; i < end; ++i) {
+                ++histogram[(from[i].code >> shift) & (RADIX_BUCKETS - 1)];
+            }
+        });
+
+        // exclusive offsets, digit major and block minor, so the sort stays stable
+        size_t sum = 0;
+        bool single = false;
+        for (size_t digit = 0; digit < RADIX_BUCKETS; ++digit) {
+            size_t inDigit = 0;
+            for (unsigned block = 0; block < blocks; ++block) {
+                size_t& offset = offsets[block * RADIX_BUCKETS + digit];
+                const size_t n = offset;
+                offset = sum;
+                sum += n;
+                inDigit += n;
+            }
+            single = single || inDigit == count;
+        }
+        if (single) {
+            continue;
+        }
+
+        // the blocks are the same as for the histograms
+        parallelBlocks(count, blocks, [&](size_t begin, size_t end, unsigned block) {
+            size_t* offset = offsets.data() + block * RADIX_BUCKETS;
+            for (size_t i = begin; i < end; ++i) {
+                to[offset[(from[i].code >> shift) & (RADIX_BUCKETS - 1)]++] = from[i];
+            }
+        });
+        keys.swap(buffer);
+    }
+}
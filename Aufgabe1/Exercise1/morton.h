@@ -0,0 +1,103 @@
+#ifndef MORTON_H
+#define MORTON_H
+
+#include <QVector3D>
+
+#include <cstdint>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Morton (Z order) codes: the bits of the x, y and z cell of a point interleaved, so points
+// that are close in space mostly get close codes. 21 bits per axis give 63 bit codes and
+// 2^21 cells per axis across the AABB.
+
+static const int MORTON_BITS = 21;
+static const uint32_t MORTON_CELLS = 1u << MORTON_BITS;
+
+// a code with the row it was computed for, sorted by code
+struct MortonKey
+{
+    uint64_t code;
+    uint32_t row;
+};
+
+// spreads the lower 21 bits of v so two zero bits follow every bit
+inline uint64_t mortonSpread(uint32_t v)
+{
+    uint64_t x = v & (MORTON_CELLS - 1);
+    x = (x | x << 32) & 0x1f00000000ffffULL;
+    x = (x | x << 16) & 0x1f0000ff0000ffULL;
+    x = (x | x << 8)  & 0x100f00f00f00f00fULL;
+    x = (x | x << 4)  & 0x10c30c30c30c30c3ULL;
+    x = (x | x << 2)  & 0x1249249249249249ULL;
+    return x;
+}
+
+// inverse of mortonSpread
+inline uint32_t mortonCompact(uint64_t x)
+{
+    x &= 0x1249249249249249ULL;
+    x = (x | x >> 2)  & 0x10c30c30c30c30c3ULL;
+    x = (x | x >> 4)  & 0x100f00f00f00f00fULL;
+    x = (x | x >> 8)  & 0x1f0000ff0000ffULL;
+    x = (x | x >> 16) & 0x1f00000000ffffULL;
+    x = (x | x >> 32) & 0x1fffffULL;
+    return static_cast<uint32_t>(x);
+}
+
+// x in the lowest bit, then y and z
+inline uint64_t mortonEncode(uint32_t x, uint32_t y, uint32_t z)
+{
+    return mortonSpread(x) | mortonSpread(y) << 1 | mortonSpread(z) << 2;
+}
+
+inline void mortonDecode(uint64_t code, uint32_t& x, uint32_t& y, uint32_t& z)
+{
+    x = mortonCompact(code);
+    y = mortonCompact(code >> 1);
+    z = mortonCompact(code >> 2);
+}
+
+// the number of leading 3 bit digits two codes share, MORTON_BITS if they are equal
+inline int mortonSharedDigits(uint64_t a, uint64_t b)
+{
+    const uint64_t x = a ^ b;
+    if (x == 0) {
+        return MORTON_BITS;
+    }
+#if defined(_MSC_VER)
+    unsigned long highest;
+    _BitScanReverse64(&highest, x);
+#else
+    const int highest = 63 - __builtin_clzll(x);
+#endif
+    return (3 * MORTON_BITS - 1 - static_cast<int>(highest)) / 3;
+}
+
+// maps points of an AABB to their cells, points on the max side go to the last cell
+class MortonGrid
+{
+public:
+    MortonGrid(const QVector3D& min, const QVector3D& max);
+
+    uint64_t code(const QVector3D& point) const;
+    // lower corner of a cell, and the size of one
+    QVector3D cellMin(uint32_t x, uint32_t y, uint32_t z) const;
+    QVector3D cellSize() const { return _cellSize; }
+
+private:
+    QVector3D _min;
+    QVector3D _cellSize;
+    float _scale[3];
+};
+
+// stable, parallel LSD radix sort by code, 11 bits per pass, passes that would not
+// move anything are skipped
+void sortMorton(std::vector<MortonKey>& keys);
+// the same with a caller owned scratch buffer, it keeps its capacity for the next sort
+void sortMorton(std::vector<MortonKey>& keys, std::vector<MortonKey>& buffer);
+
+#endif // MORTON_H
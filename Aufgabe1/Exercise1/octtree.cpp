@@ -1,84 +1,1323 @@
 #include <octtree.h>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include "morton.h"
+#include "parallel.h"
 
+// below this many points the subtrees are not worth the threads
+static const size_t PARALLEL_OCTTREE_POINTS = 1 << 16;
 
-Octtree::Octtree(QVector3D new_near_bot_left, QVector3D new_far_top_right, float new_length)
+Octtree::Octtree(int leaf_capacity, int max_depth)
+    : _leaf_capacity(std::max(1, leaf_capacity)),
+      _max_depth(std::min(std::max(0, max_depth), MORTON_BITS))
+{}
+
+static bool is_finite(const QVector3D& point)
 {
-    Node *tmp = new Node(new_near_bot_left, new_far_top_right, new_length);
-    this->root = tmp;
+    return std::isfinite(point.x()) && std::isfinite(point.y()) && std::isfinite(point.z());
 }
 
-void Octtree::get_octtree_lines(std::vector<std::pair<QVector3D, QColor>> &octtree_lines, QColor colour, int depth, Node current)
+// octant digit of a code for the node on the given level, level 1 is below the root
+static int octant_of(uint64_t code, int level)
 {
+    return static_cast<int>((code >> (3 * (MORTON_BITS - level))) & 7);
+}
 
-    // add lines
-    QVector3D point1 = current.near_bot_left;
-    QVector3D point2 = QVector3D(current.far_top_right.x(), current.near_bot_left.y(), current.near_bot_left.z());
-    QVector3D point3 = QVector3D(current.far_top_right.x(), current.far_top_right.y(), current.near_bot_left.z());
-    QVector3D point4 = QVector3D(current.near_bot_left.x(), current.far_top_right.y(), current.near_bot_left.z());
+QVector3D Octtree::child_near_bot_left(const QVector3D& near_bot_left, float length, int octant)
+{
+    const float half = length / 2;
+    return near_bot_left + QVector3D((octant & 1) ? half : 0, (octant & 2) ? half : 0, (octant & 4) ? half : 0);
+}
 
-    QVector3D point5 = QVector3D(current.near_bot_left.x(), current.near_bot_left.y(), current.far_top_right.z());
-    QVector3D point6 = QVector3D(current.far_top_right.x(), current.near_bot_left.y(), current.far_top_right.z());
-    QVector3D point7 = current.far_top_right;
-    QVector3D point8 = QVector3D(current.near_bot_left.x(), current.far_top_right.y(), current.far_top_right.z());
+void Octtree::reset()
+{
+    _nodes.clear();
+    _points.clear();
+    _rows.clear();
+    _keys.clear();
+    _samples.clear();
+    _sample_first.clear();
+    _near_bot_left = QVector3D();
+    _length = 0;
+}
 
-    // front lines:
-    octtree_lines.push_back(std::make_pair(point1, colour));
-    octtree_lines.push_back(std::make_pair(point2, colour));
+void Octtree::release()
+{
+    reset();
+    std::vector<OcttreeNode>().swap(_nodes);
+    _points = PointBlocks();
+    std::vector<uint32_t>().swap(_rows);
+    std::vector<uint32_t>().swap(_samples);
+    std::vector<uint32_t>().swap(_sample_first);
+    release_scratch();
+}
 
-    octtree_lines.push_back(std::make_pair(point2, colour));
-    octtree_lines.push_back(std::make_pair(point3, colour));
+void Octtree::release_scratch()
+{
+    std::vector<MortonKey>().swap(_keys);
+    std::vector<MortonKey>().swap(_key_buffer);
+}
 
-    octtree_lines.push_back(std::make_pair(point3, colour));
-    octtree_lines.push_back(std::make_pair(point4, colour));
+size_t Octtree::memory_usage() const
+{
+    return _nodes.capacity() * sizeof(OcttreeNode) + _points.memoryUsage()
+            + (_rows.capacity() + _samples.capacity() + _sample_first.capacity()) * sizeof(uint32_t)
+            + (_keys.capacity() + _key_buffer.capacity()) * sizeof(MortonKey);
+}
 
-    octtree_lines.push_back(std::make_pair(point4, colour));
-    octtree_lines.push_back(std::make_pair(point1, colour));
+bool Octtree::build(const PointCloud& cloud, bool parallel, const std::atomic<bool>* cancel)
+{
+    reset();
 
-    // back lines:
-    octtree_lines.push_back(std::make_pair(point5, colour));
-    octtree_lines.push_back(std::make_pair(point6, colour));
+    const size_t count = cloud.getCount();
+    const QVector3D extent = cloud.getMax() - cloud.getMin();
+    _near_bot_left = cloud.getMin();
+    _length = std::max(extent.x(), std::max(extent.y(), extent.z()));
+    if (count == 0)
+    {
+        return true;
+    }
 
-    octtree_lines.push_back(std::make_pair(point6, colour));
-    octtree_lines.push_back(std::make_pair(point7, colour));
+    // NaN and infinite points have no cell, they are left out of the tree
+    std::vector<size_t> skipped(workerCount(), 0);
+    parallelBlocks(count, workerCount(), [&](size_t begin, size_t end, unsigned block) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            skipped[block] += is_finite(cloud.getPoint(i)) ? 0 : 1;
+        }
+    });
+    size_t non_finite = 0;
+    for (size_t n : skipped)
+    {
+        non_finite += n;
+    }
+    if (non_finite == 0)
+    {
+        sort_points(count, [&](size_t i) { return cloud.getPoint(i); }, [](size_t i) { return static_cast<uint32_t>(i); });
+    }
+    else
+    {
+        std::vector<uint32_t> finite_rows;
+        finite_rows.reserve(count - non_finite);
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (is_finite(cloud.getPoint(i)))
+            {
+                finite_rows.push_back(static_cast<uint32_t>(i));
+            }
+        }
+        sort_points(finite_rows.size(), [&](size_t i) { return cloud.getPoint(finite_rows[i]); },
+                    [&](size_t i) { return finite_rows[i]; });
+    }
+    if (cancel && *cancel)
+    {
+        reset();
+        return false;
+    }
+    build_nodes(parallel);
+    if (cancel && *cancel)
+    {
+        reset();
+        return false;
+    }
+    return true;
+}
 
-    octtree_lines.push_back(std::make_pair(point7, colour));
-    octtree_lines.push_back(std::make_pair(point8, colour));
+template <typename PointAt, typename RowAt>
+void Octtree::sort_points(size_t count, PointAt point_at, RowAt row_at)
+{
+    // codes of all points on a grid of 2^21 cells per axis over the root cube
+    const MortonGrid grid(near_bot_left(), far_top_right());
+    std::vector<MortonKey>& keys = _keys;
+    keys.resize(count);
+    parallelBlocks(count, workerCount(), [&](size_t begin, size_t end, unsigned) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            keys[i].code = grid.code(point_at(i));
+            keys[i].row = static_cast<uint32_t>(i);
+        }
+    });
+    sortMorton(keys, _key_buffer);
 
-    octtree_lines.push_back(std::make_pair(point8, colour));
-    octtree_lines.push_back(std::make_pair(point5, colour));
+    _points.resize(count);
+    _rows.resize(count);
+    parallelBlocks(count, workerCount(), [&](size_t begin, size_t end, unsigned) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            _rows[i] = row_at(keys[i].row);
+            _points.set(i, point_at(keys[i].row));
+        }
+    });
+}
 
-    // quere linien:
-    octtree_lines.push_back(std::make_pair(point1, colour));
-    octtree_lines.push_back(std::make_pair(point5, colour));
+void Octtree::build_nodes(bool parallel)
+{
+    const std::vector<MortonKey>& keys = _keys;
+    const size_t count = keys.size();
+    _nodes.clear();
+    // samples of the old nodes are rebuilt by the caller
+    _samples.clear();
+    _sample_first.clear();
+    if (count == 0)
+    {
+        return;
+    }
+
+    // The levels above top_level are split top down until there are enough subtrees to keep
+    // all threads busy, few nodes that only need a binary search per octant.
+    const size_t tasks_wanted = parallel && count >= PARALLEL_OCTTREE_POINTS ? 8 * workerCount() : 1;
+    std::vector<std::vector<OcttreeNode>> top;
+    std::vector<OcttreeNode> roots(1);
+    roots[0] = { 0, 0, static_cast<uint32_t>(count), 0, 0 };
+    int top_level = 0;
+    while (roots.size() < tasks_wanted && top_level < _max_depth)
+    {
+        std::vector<OcttreeNode> below;
+        for (OcttreeNode& node : roots)
+        {
+            if (node.count <= static_cast<uint32_t>(_leaf_capacity))
+            {
+                continue;
+            }
+            // the child index is relative to the level below until the layout is known
+            node.first_child = static_cast<uint32_t>(below.size());
+            const MortonKey* first = keys.data() + node.first;
+            const MortonKey* last = first + node.count;
+            for (int octant = 0; octant < 8; ++octant)
+            {
+                const MortonKey* end = std::partition_point(first, last, [&](const MortonKey& key) {
+                    return octant_of(key.code, top_level + 1) <= octant;
+                });
+                if (end != first)
+                {
+                    node.child_mask |= static_cast<uint8_t>(1 << octant);
+                    below.push_back({ 0, static_cast<uint32_t>(first - keys.data()), static_cast<uint32_t>(end - first),
+                                      0, static_cast<uint8_t>(top_level + 1) });
+                }
+                first = end;
+            }
+        }
+        if (below.empty())
+        {
+            break;
+        }
+        top.push_back(std::move(roots));
+        roots = std::move(below);
+        ++top_level;
+    }
 
-    octtree_lines.push_back(std::make_pair(point2, colour));
-    octtree_lines.push_back(std::make_pair(point6, colour));
+    // Every root on top_level is a subtree that is built bottom up from its leaves,
+    // consecutive ranges of codes. The leaf starting at row b is the shallowest node that does
+    // not reach back to row b - 1 and holds at most _leaf_capacity rows, so does not reach row
+    // b + _leaf_capacity, unless it is on _max_depth already. Both follow from the digits b
+    // shares with those rows, a leaf is found in constant time. Two neighbouring leaves share
+    // the nodes on the levels up to the digits their first rows share, a leaf opens the nodes
+    // above it that it does not share with the leaf before. Nodes of a level are created in
+    // Morton order, so the children of a node are contiguous on the level below. The first
+    // pass counts the nodes per subtree and level, the second writes them to their breadth
+    // first position. A subtree only depends on its own rows, the tree is the same for any
+    // number of them.
+    const size_t tasks = roots.size();
+    const int levels = MORTON_BITS + 1;
+    auto walk = [&](const OcttreeNode& root, size_t* level_size, size_t* cursor) {
+        const int top_depth = root.depth;
+        const size_t range_end = static_cast<size_t>(root.first) + root.count;
 
-    octtree_lines.push_back(std::make_pair(point3, colour));
-    octtree_lines.push_back(std::make_pair(point7, colour));
+        // a node of a level that is still collecting points is the last one written there,
+        // the parents of the subtree roots are linked with the upper levels
+        auto add_node = [&](int level, uint64_t code, size_t first, size_t size) {
+            if (!cursor)
+            {
+                ++level_size[level];
+                return;
+            }
+            if (level > top_depth)
+            {
+                OcttreeNode& parent = _nodes[cursor[level - 1] - 1];
+                if (parent.child_mask == 0)
+                {
+                    parent.first_child = static_cast<uint32_t>(cursor[level]);
+                }
+                parent.child_mask |= static_cast<uint8_t>(1 << octant_of(code, level));
+            }
+            OcttreeNode& node = _nodes[cursor[level]++];
+            node.first_child = 0;
+            node.first = static_cast<uint32_t>(first);
+            node.count = static_cast<uint32_t>(size);
+            node.child_mask = 0;
+            node.depth = static_cast<uint8_t>(level);
+        };
+        auto close_node = [&](int level, size_t end) {
+            if (cursor)
+            {
+                OcttreeNode& node = _nodes[cursor[level] - 1];
+                node.count = static_cast<uint32_t>(end - node.first);
+            }
+        };
 
-    octtree_lines.push_back(std::make_pair(point4, colour));
-    octtree_lines.push_back(std::make_pair(point8, colour));
+        int open = top_depth - 1; // deepest level with a node that is still collecting points
+        int shared_prev = top_depth - 1;
+        for (size_t begin = root.first; begin < range_end;)
+        {
+            const uint64_t code = keys[begin].code;
+            int level = shared_prev + 1;
+            if (begin + _leaf_capacity < range_end)
+            {
+                level = std::max(level, mortonSharedDigits(code, keys[begin + _leaf_capacity].code) + 1);
+            }
+            level = std::min(level, _max_depth);
+            size_t end = begin + 1;
+            while (end < range_end && mortonSharedDigits(code, keys[end].code) >= level)
+            {
+                ++end;
+            }
 
-    // handle depth
-    if (depth == 0 || !current.is_set || current.is_leaf)
+            for (; open > shared_prev; --open)
+            {
+                close_node(open, begin);
+            }
+            for (int inner = shared_prev + 1; inner < level; ++inner)
+            {
+                add_node(inner, code, begin, 0);
+            }
+            open = std::max(open, level - 1);
+            add_node(level, code, begin, end - begin);
+
+            shared_prev = end < range_end ? mortonSharedDigits(code, keys[end].code) : top_depth - 1;
+            begin = end;
+        }
+        for (; open >= top_depth; --open)
+        {
+            close_node(open, range_end);
+        }
+    };
+
+    // the biggest subtrees are taken first, threads that finish early take the small ones
+    std::vector<size_t> order(tasks);
+    for (size_t task = 0; task < tasks; ++task)
     {
-        return;
+        order[task] = task;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return roots[a].count > roots[b].count; });
+
+    std::vector<size_t> level_size(tasks * levels, 0);
+    parallelFor(tasks, [&](size_t i) {
+        walk(roots[order[i]], &level_size[order[i] * levels], nullptr);
+    });
+
+    // levels one after the other, on a level the upper nodes or the subtrees in Morton order
+    std::vector<size_t> cursor(tasks * levels);
+    std::vector<size_t> level_start(levels + 1, 0);
+    for (int level = 0; level < levels; ++level)
+    {
+        size_t at = level_start[level];
+        if (level < top_level)
+        {
+            at += top[level].size();
+        }
+        for (size_t task = 0; task < tasks; ++task)
+        {
+            cursor[task * levels + level] = at;
+            at += level_size[task * levels + level];
+        }
+        level_start[level + 1] = at;
     }
+    _nodes.resize(level_start[levels]);
 
-    // get new nodes
-    for (Node *new_current: current.children)
+    // a subtree root is the only node of its subtree on top_level, so its index on the
+    // level is the index of the subtree
+    for (int level = 0; level < top_level; ++level)
     {
-        get_octtree_lines(octtree_lines, colour, depth - 1, *new_current);
+        for (size_t i = 0; i < top[level].size(); ++i)
+        {
+            OcttreeNode node = top[level][i];
+            if (!node.is_leaf())
+            {
+                node.first_child += static_cast<uint32_t>(level_start[level + 1]);
+            }
+            _nodes[level_start[level] + i] = node;
+        }
     }
+    parallelFor(tasks, [&](size_t i) {
+        walk(roots[order[i]], nullptr, &cursor[order[i] * levels]);
+    });
 }
 
+void Octtree::ensure_codes()
+{
+    const size_t count = _points.size();
+    if (_keys.size() == count)
+    {
+        return;
+    }
+    const MortonGrid grid(near_bot_left(), far_top_right());
+    _keys.resize(count);
+    parallelBlocks(count, workerCount(), [&](size_t begin, size_t end, unsigned) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            _keys[i].code = grid.code(_points[i]);
+            _keys[i].row = static_cast<uint32_t>(i);
+        }
+    });
+    // a root that grew places points by their old codes, rounding may put a few in another order
+    const bool sorted = std::is_sorted(_keys.begin(), _keys.end(), [](const MortonKey& a, const MortonKey& b) {
+        return a.code < b.code;
+    });
+    if (!sorted)
+    {
+        const PointBlocks points(_points);
+        const std::vector<uint32_t> rows(_rows);
+        sort_points(count, [&](size_t i) { return points[i]; }, [&](size_t i) { return rows[i]; });
+    }
+}
 
-bool Octtree::insert_point(QVector3D point)
+void Octtree::insert(const std::vector<QVector3D>& points, const std::vector<uint32_t>& rows)
 {
-    // handle leaf
-    if (this->root->insert_point(point, 9000)) {
+    if (points.size() != rows.size())
+    {
+        throw std::runtime_error("one row per inserted point needed");
+    }
+    if (points.empty())
+    {
+        return;
+    }
+    QVector3D low = points[0];
+    QVector3D high = points[0];
+    for (const QVector3D& point : points)
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            if (!std::isfinite(point[axis]))
+            {
+                throw std::runtime_error("inserted points must be finite");
+            }
+            low[axis] = std::min(low[axis], point[axis]);
+            high[axis] = std::max(high[axis], point[axis]);
+        }
+    }
+
+    // without a root to grow from, the tree is built over the old and the new points
+    if (_points.empty() || _length == 0)
+    {
+        const PointBlocks old_points(_points);
+        const size_t old = old_points.size();
+        std::vector<uint32_t> all_rows(_rows);
+        all_rows.insert(all_rows.end(), rows.begin(), rows.end());
+        if (!_points.empty())
+        {
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                low[axis] = std::min(low[axis], _near_bot_left[axis]);
+                high[axis] = std::max(high[axis], _near_bot_left[axis]);
+            }
+        }
+        const QVector3D extent = high - low;
+        _near_bot_left = low;
+        _length = std::max(extent.x(), std::max(extent.y(), extent.z()));
+        sort_points(all_rows.size(), [&](size_t i) { return i < old ? old_points[i] : points[i - old]; },
+                    [&](size_t i) { return all_rows[i]; });
+        build_nodes(true);
+        return;
+    }
+
+    // Every step makes the root the octant of a new root twice its size that lies towards
+    // the points outside. The codes of the old points move down one level below the octant
+    // digit, which keeps their order. top collects the new leading digits.
+    ensure_codes();
+    uint64_t top = 0;
+    int grown = 0;
+    auto inside = [&](const QVector3D& point) {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            if (point[axis] < _near_bot_left[axis] || point[axis] > _near_bot_left[axis] + _length)
+            {
+                return false;
+            }
+        }
         return true;
+    };
+    while (!inside(low) || !inside(high))
+    {
+        int octant = 0;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            if (low[axis] < _near_bot_left[axis])
+            {
+                octant |= 1 << axis;
+                _near_bot_left[axis] -= _length;
+            }
+        }
+        _length *= 2;
+        top = static_cast<uint64_t>(octant) << (3 * (MORTON_BITS - 1)) | top >> 3;
+        ++grown;
+    }
+    if (grown > 0)
+    {
+        const int shift = 3 * std::min(grown, MORTON_BITS);
+        parallelBlocks(_keys.size(), workerCount(), [&](size_t begin, size_t end, unsigned) {
+            for (size_t i = begin; i < end; ++i)
+            {
+                _keys[i].code = top | (shift < 64 ? _keys[i].code >> shift : 0);
+            }
+        });
+        std::cout << "octtree root grown " << grown << " times to length " << _length << std::endl;
+    }
+
+    // the new points sorted on their own, then merged behind old points with the same code,
+    // from the back so the old points move only once
+    const MortonGrid grid(near_bot_left(), far_top_right());
+    std::vector<MortonKey> added(points.size());
+    parallelBlocks(points.size(), workerCount(), [&](size_t begin, size_t end, unsigned) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            added[i].code = grid.code(points[i]);
+            added[i].row = static_cast<uint32_t>(i);
+        }
+    });
+    sortMorton(added, _key_buffer);
+
+    size_t old = _points.size();
+    size_t add = added.size();
+    const size_t count = old + add;
+    _keys.resize(count);
+    _points.resize(count);
+    _rows.resize(count);
+    for (size_t i = count; add > 0; --i)
+    {
+        if (old == 0 || added[add - 1].code >= _keys[old - 1].code)
+        {
+            --add;
+            _keys[i - 1] = added[add];
+            _points.set(i - 1, points[added[add].row]);
+            _rows[i - 1] = rows[added[add].row];
+        }
+        else
+        {
+            --old;
+            _keys[i - 1] = _keys[old];
+            _points.set(i - 1, _points[old]);
+            _rows[i - 1] = _rows[old];
+        }
+    }
+    update_nodes(grown, top);
+}
+
+void Octtree::remove(const std::vector<uint32_t>& rows)
+{
+    if (rows.empty() || _points.empty())
+    {
+        return;
+    }
+    ensure_codes();
+    const uint32_t last = *std::max_element(rows.begin(), rows.end());
+    std::vector<bool> removed(static_cast<size_t>(last) + 1, false);
+    for (const uint32_t row : rows)
+    {
+        removed[row] = true;
+    }
+
+    // the rest keeps its order, so the codes stay sorted
+    size_t kept = 0;
+    for (size_t i = 0; i < _points.size(); ++i)
+    {
+        if (_rows[i] <= last && removed[_rows[i]])
+        {
+            continue;
+        }
+        _keys[kept] = _keys[i];
+        _points.set(kept, _points[i]);
+        _rows[kept] = _rows[i];
+        ++kept;
+    }
+    if (kept == _points.size())
+    {
+        return;
+    }
+    _keys.resize(kept);
+    _points.resize(kept);
+    _rows.resize(kept);
+    update_nodes(0, 0);
+}
+
+void Octtree::update_nodes(int grown, uint64_t top)
+{
+    std::vector<OcttreeNode> old;
+    old.swap(_nodes);
+    _nodes.reserve(old.size());
+    // samples of the old nodes are rebuilt by the caller
+    _samples.clear();
+    _sample_first.clear();
+    const size_t count = _keys.size();
+    if (count == 0)
+    {
+        return;
+    }
+
+    // The new tree is written level by level from the root, a node with the old node of the
+    // same cube where there was one. A node that holds as many points as its old node got none
+    // and lost none, it and its subtree are the old ones with their ranges moved by shift.
+    // Such clean nodes are taken over in runs, on every level the nodes of a subtree follow
+    // each other and so do their children. Only the nodes whose points changed are split
+    // again over their codes, a leaf that went over the capacity gets children, an inner node
+    // that dropped to it becomes a leaf and its children go. After growing the root the old
+    // root is the node on the path of top at depth grown. The result is the tree
+    // build_nodes() gives for the same codes.
+    struct Pending
+    {
+        OcttreeNode node; // a node whose points changed or that is new
+        int64_t old;      // its old node, -1 for none. For a clean run the first old node
+        int64_t old_end;  // end of a clean run
+        int64_t shift;    // of the ranges of a clean run
+        bool clean;
+    };
+    const std::vector<MortonKey>& keys = _keys;
+    std::vector<Pending> level(1);
+    std::vector<Pending> below;
+    level[0].node = { 0, 0, static_cast<uint32_t>(count), 0, 0 };
+    level[0].old = grown == 0 && !old.empty() ? 0 : -1;
+    level[0].old_end = level[0].old + 1;
+    level[0].shift = 0;
+    level[0].clean = level[0].old == 0 && old[0].count == count;
+    auto push_clean = [&](int64_t begin, int64_t end, int64_t shift) {
+        if (!below.empty() && below.back().clean && below.back().old_end == begin && below.back().shift == shift)
+        {
+            below.back().old_end = end;
+            return;
+        }
+        Pending run = {};
+        run.old = begin;
+        run.old_end = end;
+        run.shift = shift;
+        run.clean = true;
+        below.push_back(run);
+    };
+    for (int depth = 0; !level.empty(); ++depth)
+    {
+        size_t child = _nodes.size(); // index of the next node on the level below
+        for (const Pending& pending : level)
+        {
+            child += pending.clean ? static_cast<size_t>(pending.old_end - pending.old) : 1;
+        }
+        below.clear();
+        for (const Pending& pending : level)
+        {
+            if (pending.clean)
+            {
+                // the children of the run are a run on the old level below, they move by as
+                // many places as the first of them
+                int64_t children_begin = -1;
+                int64_t children_end = -1;
+                int64_t moved = 0;
+                for (int64_t i = pending.old; i < pending.old_end; ++i)
+                {
+                    OcttreeNode node = old[i];
+                    node.first = static_cast<uint32_t>(node.first + pending.shift);
+                    node.depth = static_cast<uint8_t>(depth);
+                    if (depth >= _max_depth)
+                    {
+                        node.first_child = 0;
+                        node.child_mask = 0;
+                    }
+                    else if (!node.is_leaf())
+                    {
+                        if (children_begin < 0)
+                        {
+                            children_begin = node.first_child;
+                            moved = static_cast<int64_t>(child) - children_begin;
+                        }
+                        children_end = node.first_child + node.child_count();
+                        node.first_child = static_cast<uint32_t>(node.first_child + moved);
+                    }
+                    _nodes.push_back(node);
+                }
+                if (children_begin >= 0)
+                {
+                    push_clean(children_begin, children_end, pending.shift);
+                    child += static_cast<size_t>(children_end - children_begin);
+                }
+                continue;
+            }
+
+            OcttreeNode node = pending.node;
+            if (node.count > static_cast<uint32_t>(_leaf_capacity) && depth < _max_depth)
+            {
+                node.first_child = static_cast<uint32_t>(child);
+                const OcttreeNode* was = pending.old >= 0 ? &old[pending.old] : nullptr;
+                uint32_t old_child = was ? was->first_child : 0;
+                const MortonKey* first = keys.data() + node.first;
+                const MortonKey* last = first + node.count;
+                for (int octant = 0; octant < 8; ++octant)
+                {
+                    const MortonKey* end = std::partition_point(first, last, [&](const MortonKey& key) {
+                        return octant_of(key.code, depth + 1) <= octant;
+                    });
+                    int64_t match = -1;
+                    if (was && (was->child_mask >> octant & 1))
+                    {
+                        match = old_child++;
+                    }
+                    else if (!was && depth + 1 == grown && end != first
+                             && ((first->code ^ top) >> (3 * (MORTON_BITS - grown))) == 0)
+                    {
+                        match = 0;
+                    }
+                    if (end != first)
+                    {
+                        node.child_mask |= static_cast<uint8_t>(1 << octant);
+                        const uint32_t child_first = static_cast<uint32_t>(first - keys.data());
+                        const uint32_t child_count = static_cast<uint32_t>(end - first);
+                        if (match >= 0 && old[match].count == child_count)
+                        {
+                            push_clean(match, match + 1, static_cast<int64_t>(child_first) - old[match].first);
+                        }
+                        else
+                        {
+                            Pending changed = {};
+                            changed.node = { 0, child_first, child_count, 0, static_cast<uint8_t>(depth + 1) };
+                            changed.old = match;
+                            below.push_back(changed);
+                        }
+                        ++child;
+                    }
+                    first = end;
+                }
+            }
+            _nodes.push_back(node);
+        }
+        level.swap(below);
+    }
+}
+
+float Octtree::box_distance2(const QVector3D& query, const QVector3D& near_bot_left, float length) const
+{
+    // cubes are widened by a millionth of the root, a point rounded into the neighbouring
+    // cell by its Morton code is still inside
+    const float margin = _length * 1e-6f;
+    float distance2 = 0;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        const float low = near_bot_left[axis] - margin;
+        const float high = near_bot_left[axis] + length + margin;
+        const float d = query[axis] < low ? low - query[axis] : (query[axis] > high ? query[axis] - high : 0.0f);
+        distance2 += d * d;
+    }
+    return distance2;
+}
+
+void Octtree::knn(const QVector3D& query, int k, std::vector<OcttreeNeighbour>& result) const
+{
+    std::vector<SearchEntry> nodes;
+    std::vector<std::pair<float, uint32_t>> found;
+    knn(query, static_cast<size_t>(std::max(0, k)), result, nodes, found);
+}
+
+void Octtree::knn(const QVector3D& query, size_t k, std::vector<OcttreeNeighbour>& result,
+                  std::vector<SearchEntry>& nodes, std::vector<std::pair<float, uint32_t>>& found) const
+{
+    result.clear();
+    k = std::min(k, _points.size());
+    if (k == 0)
+    {
+        return;
+    }
+
+    // nodes is a heap with the nearest node on top, found one with the furthest point on top
+    auto nearer_entry = [](const SearchEntry& a, const SearchEntry& b) { return a.distance2 > b.distance2; };
+    nodes.clear();
+    found.clear();
+    nodes.push_back({ box_distance2(query, _near_bot_left, _length), 0, _near_bot_left, _length });
+    while (!nodes.empty())
+    {
+        std::pop_heap(nodes.begin(), nodes.end(), nearer_entry);
+        const SearchEntry entry = nodes.back();
+        nodes.pop_back();
+        if (found.size() == k && entry.distance2 > found.front().first)
+        {
+            break;
+        }
+
+        const OcttreeNode& node = _nodes[entry.node];
+        if (node.is_leaf())
+        {
+            // only the points of a block nearer than the k-th at its start can enter the heap
+            float block[POINT_BLOCK];
+            for (uint32_t first = node.first; first < node.first + node.count; first += POINT_BLOCK)
+            {
+                const uint32_t count = std::min(node.first + node.count - first, POINT_BLOCK);
+                const bool filling = found.size() < k;
+                uint32_t mask = _points.squaredDistances(first, count, query, filling ? 0 : found.front().first, block);
+                if (filling)
+                {
+                    mask = blockMask(count);
+                }
+                while (mask != 0)
+                {
+                    const int j = lowestBit(mask);
+                    mask &= mask - 1;
+                    const uint32_t i = first + j;
+                    const float distance2 = block[j];
+                    if (found.size() < k)
+                    {
+                        found.push_back(std::make_pair(distance2, i));
+                        std::push_heap(found.begin(), found.end());
+                    }
+                    else if (distance2 < found.front().first)
+                    {
+                        std::pop_heap(found.begin(), found.end());
+                        found.back() = std::make_pair(distance2, i);
+                        std::push_heap(found.begin(), found.end());
+                    }
+                }
+            }
+            continue;
+        }
+
+        uint32_t child = node.first_child;
+        const float half = entry.length / 2;
+        for (int octant = 0; octant < 8; ++octant)
+        {
+            if (!(node.child_mask & (1 << octant)))
+            {
+                continue;
+            }
+            const QVector3D corner = child_near_bot_left(entry.near_bot_left, entry.length, octant);
+            const float distance2 = box_distance2(query, corner, half);
+            if (found.size() < k || distance2 <= found.front().first)
+            {
+                nodes.push_back({ distance2, child, corner, half });
+                std::push_heap(nodes.begin(), nodes.end(), nearer_entry);
+            }
+            ++child;
+        }
+    }
+
+    std::sort_heap(found.begin(), found.end());
+    result.resize(found.size());
+    for (size_t i = 0; i < found.size(); ++i)
+    {
+        result[i].row = _rows[found[i].second];
+        result[i].distance = std::sqrt(found[i].first);
+    }
+}
+
+void Octtree::radius_search(const QVector3D& query, float radius, std::vector<OcttreeNeighbour>& result) const
+{
+    std::vector<SearchEntry> nodes;
+    radius_search(query, radius, result, nodes);
+}
+
+void Octtree::radius_search(const QVector3D& query, float radius, std::vector<OcttreeNeighbour>& result,
+                            std::vector<SearchEntry>& nodes) const
+{
+    result.clear();
+    if (_nodes.empty() || radius < 0)
+    {
+        return;
+    }
+
+    // depth first, nodes further than radius are not entered
+    const float radius2 = radius * radius;
+    nodes.clear();
+    nodes.push_back({ 0, 0, _near_bot_left, _length });
+    while (!nodes.empty())
+    {
+        const SearchEntry entry = nodes.back();
+        nodes.pop_back();
+        if (box_distance2(query, entry.near_bot_left, entry.length) > radius2)
+        {
+            continue;
+        }
+
+        const OcttreeNode& node = _nodes[entry.node];
+        if (node.is_leaf())
+        {
+            float block[POINT_BLOCK];
+            for (uint32_t first = node.first; first < node.first + node.count; first += POINT_BLOCK)
+            {
+                const uint32_t count = std::min(node.first + node.count - first, POINT_BLOCK);
+                uint32_t mask = _points.squaredDistances(first, count, query, radius2, block);
+                while (mask != 0)
+                {
+                    const int j = lowestBit(mask);
+                    mask &= mask - 1;
+                    result.push_back({ _rows[first + j], std::sqrt(block[j]) });
+                }
+            }
+            continue;
+        }
+
+        // pushed backwards so the octants are taken in order and the result is in tree order
+        uint32_t child = node.first_child + node.child_count();
+        for (int octant = 7; octant >= 0; --octant)
+        {
+            if (node.child_mask & (1 << octant))
+            {
+                nodes.push_back({ 0, --child, child_near_bot_left(entry.near_bot_left, entry.length, octant), entry.length / 2 });
+            }
+        }
+    }
+}
+
+void Octtree::knn_batch(const std::vector<QVector3D>& queries, int k, std::vector<OcttreeNeighbour>& result) const
+{
+    const size_t per_query = std::min(static_cast<size_t>(std::max(0, k)), _points.size());
+    result.resize(queries.size() * per_query);
+    parallelBlocks(queries.size(), workerCount(), [&](size_t begin, size_t end, unsigned) {
+        std::vector<SearchEntry> nodes;
+        std::vector<std::pair<float, uint32_t>> found;
+        std::vector<OcttreeNeighbour> nearest;
+        for (size_t q = begin; q < end; ++q)
+        {
+            knn(queries[q], per_query, nearest, nodes, found);
+            std::copy(nearest.begin(), nearest.end(), result.begin() + q * per_query);
+        }
+    });
+}
+
+void Octtree::radius_search_batch(const std::vector<QVector3D>& queries, float radius,
+                                  std::vector<std::vector<OcttreeNeighbour>>& result) const
+{
+    result.resize(queries.size());
+    parallelBlocks(queries.size(), workerCount(), [&](size_t begin, size_t end, unsigned) {
+        std::vector<SearchEntry> nodes;
+        for (size_t q = begin; q < end; ++q)
+        {
+            radius_search(queries[q], radius, result[q], nodes);
+        }
+    });
+}
+
+// entry and exit of a ray with the cube grown by margin on all sides, false if it misses
+static bool slab_test(const QVector3D& origin, const QVector3D& direction, const QVector3D& near_bot_left,
+                      float length, float margin, float& enter, float& exit)
+{
+    enter = 0;
+    exit = std::numeric_limits<float>::max();
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        const float low = near_bot_left[axis] - margin;
+        const float high = near_bot_left[axis] + length + margin;
+        if (direction[axis] == 0)
+        {
+            if (origin[axis] < low || origin[axis] > high)
+            {
+                return false;
+            }
+            continue;
+        }
+        const float inverse = 1 / direction[axis];
+        float t0 = (low - origin[axis]) * inverse;
+        float t1 = (high - origin[axis]) * inverse;
+        if (t0 > t1)
+        {
+            std::swap(t0, t1);
+        }
+        enter = std::max(enter, t0);
+        exit = std::min(exit, t1);
+    }
+    return enter <= exit;
+}
+
+bool Octtree::pick(const QVector3D& origin, const QVector3D& direction, float radius, float spread,
+                   OcttreeNeighbour& hit, QVector3D& point) const
+{
+    if (_nodes.empty())
+    {
+        return false;
+    }
+    const QVector3D ray = direction.normalized();
+
+    // A point of a cube that is in the cone t along the ray has its foot on the ray within
+    // radius + spread * t of the cube, so the ray passes the cube grown by that. t is at most
+    // the best hit so far and the furthest corner of the cube along the ray. The entry into
+    // the grown cube is a lower bound for the hits in it, cubes are taken front to back by it
+    // and the search ends at the first one behind the best hit.
+    const float positive = std::max(ray.x(), 0.0f) + std::max(ray.y(), 0.0f) + std::max(ray.z(), 0.0f);
+    auto furthest = [&](const QVector3D& near_bot_left, float length) {
+        return QVector3D::dotProduct(near_bot_left - origin, ray) + length * positive;
+    };
+    float best_t = std::numeric_limits<float>::max();
+    uint32_t best = UINT32_MAX;
+    auto nearer_entry = [](const SearchEntry& a, const SearchEntry& b) { return a.distance2 > b.distance2; };
+
+    std::vector<SearchEntry> nodes;
+    float enter, exit;
+    const float margin = _length * 1e-6f;
+    if (!slab_test(origin, ray, _near_bot_left, _length, radius + spread * std::max(0.0f, furthest(_near_bot_left, _length)) + margin,
+                   enter, exit))
+    {
+        return false;
+    }
+    nodes.push_back({ enter, 0, _near_bot_left, _length });
+    while (!nodes.empty())
+    {
+        std::pop_heap(nodes.begin(), nodes.end(), nearer_entry);
+        const SearchEntry entry = nodes.back();
+        nodes.pop_back();
+        if (entry.distance2 > best_t)
+        {
+            break;
+        }
+
+        const OcttreeNode& node = _nodes[entry.node];
+        if (node.is_leaf())
+        {
+            for (uint32_t i = node.first; i < node.first + node.count; ++i)
+            {
+                const QVector3D to_point = _points[i] - origin;
+                const float t = QVector3D::dotProduct(to_point, ray);
+                if (t < 0 || t >= best_t)
+                {
+                    continue;
+                }
+                const float allowed = radius + spread * t;
+                if (to_point.lengthSquared() - t * t <= allowed * allowed)
+                {
+                    best_t = t;
+                    best = i;
+                }
+            }
+            continue;
+        }
+
+        uint32_t child = node.first_child;
+        const float half = entry.length / 2;
+        for (int octant = 0; octant < 8; ++octant)
+        {
+            if (!(node.child_mask & (1 << octant)))
+            {
+                continue;
+            }
+            const QVector3D corner = child_near_bot_left(entry.near_bot_left, entry.length, octant);
+            const float t = std::min(best_t, furthest(corner, half));
+            if (t >= 0 && slab_test(origin, ray, corner, half, radius + spread * t + margin, enter, exit) && enter <= best_t)
+            {
+                nodes.push_back({ enter, child, corner, half });
+                std::push_heap(nodes.begin(), nodes.end(), nearer_entry);
+            }
+            ++child;
+        }
+    }
+
+    if (best == UINT32_MAX)
+    {
+        return false;
+    }
+    hit.row = _rows[best];
+    hit.distance = best_t;
+    point = _points[best];
+    return true;
+}
+
+void Octtree::renumber_rows(const std::vector<uint32_t>& original_rows)
+{
+    // the map covers the whole cloud, rows of non-finite points are not in the tree
+    std::vector<uint32_t> now_at(original_rows.size());
+    for (size_t i = 0; i < original_rows.size(); ++i)
+    {
+        now_at[original_rows[i]] = static_cast<uint32_t>(i);
+    }
+    for (uint32_t& row : _rows)
+    {
+        row = row < now_at.size() ? now_at[row] : row;
+    }
+    for (uint32_t& row : _samples)
+    {
+        row = row < now_at.size() ? now_at[row] : row;
+    }
+}
+
+void Octtree::build_samples(int per_node)
+{
+    _samples_per_node = std::max(1, per_node);
+    const size_t per = static_cast<size_t>(_samples_per_node);
+    _sample_first.assign(_nodes.size() + 1, 0);
+    for (size_t i = 0; i < _nodes.size(); ++i)
+    {
+        _sample_first[i + 1] = _sample_first[i] + (_nodes[i].count > per ? static_cast<uint32_t>(per) : 0);
+    }
+    _samples.resize(_sample_first.back());
+
+    // the middle row of every per_node-th part of the range
+    parallelBlocks(_nodes.size(), workerCount(), [&](size_t begin, size_t end, unsigned) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            const OcttreeNode& node = _nodes[i];
+            for (uint32_t j = _sample_first[i]; j < _sample_first[i + 1]; ++j)
+            {
+                const uint64_t part = j - _sample_first[i];
+                _samples[j] = _rows[node.first + (2 * part + 1) * node.count / (2 * per)];
+            }
+        }
+    });
+}
+
+std::vector<uint32_t> Octtree::get_draw_order() const
+{
+    std::vector<uint32_t> order(_rows);
+    order.insert(order.end(), _samples.begin(), _samples.end());
+    return order;
+}
+
+OcttreeFrustum::OcttreeFrustum(const QMatrix4x4& view_projection)
+{
+    // -w <= x, y, z <= w in clip space
+    const QVector4D w = view_projection.row(3);
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        const QVector4D row = view_projection.row(axis);
+        planes[2 * axis] = w + row;
+        planes[2 * axis + 1] = w - row;
+    }
+}
+
+size_t Octtree::select_lod(const QMatrix4x4& view_projection, float pixels_per_unit, float pixel_error,
+                           std::vector<OcttreeRange>& ranges) const
+{
+    ranges.clear();
+    if (_nodes.empty())
+    {
+        return 0;
+    }
+    size_t drawn = 0;
+    auto add_range = [&](uint32_t first, uint32_t count) {
+        ++drawn;
+        if (!ranges.empty() && ranges.back().first + ranges.back().count == first)
+        {
+            ranges.back().count += count;
+        }
+        else
+        {
+            ranges.push_back({ first, count });
+        }
+    };
+
+    // The signed distance of a plane over a cube is at most half the edge times the sum of
+    // the absolute coefficients away from the distance of the centre, the same holds for w.
+    // Cubes are widened by a millionth of the root for points rounded into the next cell.
+    const OcttreeFrustum frustum(view_projection);
+    float plane_spread[6];
+    for (int plane = 0; plane < 6; ++plane)
+    {
+        const QVector4D& p = frustum.planes[plane];
+        plane_spread[plane] = std::abs(p.x()) + std::abs(p.y()) + std::abs(p.z());
+    }
+    const QVector4D w_row = view_projection.row(3);
+    const float w_spread = std::abs(w_row.x()) + std::abs(w_row.y()) + std::abs(w_row.z());
+    const float margin = _length * 1e-6f;
+    const bool sampled = !_sample_first.empty();
+    const float spacing = sampled ? 1 / std::sqrt(static_cast<float>(_samples_per_node)) : 0.0f;
+    const uint32_t samples_at = static_cast<uint32_t>(_rows.size());
+
+    // depth first in octant order, so the ranges come in tree order
+    std::vector<SearchEntry> nodes;
+    nodes.push_back({ 0, 0, _near_bot_left, _length, 0x3f });
+    while (!nodes.empty())
+    {
+        SearchEntry entry = nodes.back();
+        nodes.pop_back();
+        const OcttreeNode& node = _nodes[entry.node];
+        const float half = entry.length / 2;
+        const QVector4D centre(entry.near_bot_left + QVector3D(half, half, half), 1);
+
+        bool outside = false;
+        for (int plane = 0; plane < 6 && !outside; ++plane)
+        {
+            if (!(entry.planes & (1 << plane)))
+            {
+                continue;
+            }
+            const float distance = QVector4D::dotProduct(frustum.planes[plane], centre);
+            const float reach = (half + margin) * plane_spread[plane];
+            outside = distance + reach < 0;
+            if (distance - reach >= 0)
+            {
+                entry.planes &= static_cast<uint8_t>(~(1 << plane));
+            }
+        }
+        if (outside)
+        {
+            continue;
+        }
+
+        const bool has_sample = sampled && _sample_first[entry.node + 1] > _sample_first[entry.node];
+        const float nearest = QVector4D::dotProduct(w_row, centre) - half * w_spread;
+        if (has_sample && nearest > 0 && entry.length * spacing * pixels_per_unit <= pixel_error * nearest)
+        {
+            add_range(samples_at + _sample_first[entry.node], _sample_first[entry.node + 1] - _sample_first[entry.node]);
+            continue;
+        }
+        if (node.is_leaf() || (entry.planes == 0 && (pixel_error == 0 || !has_sample)))
+        {
+            // a node in view as a whole that is not thinned out is one range
+            add_range(node.first, node.count);
+            continue;
+        }
+
+        uint32_t child = node.first_child + node.child_count();
+        for (int octant = 7; octant >= 0; --octant)
+        {
+            if (node.child_mask & (1 << octant))
+            {
+                nodes.push_back({ 0, --child, child_near_bot_left(entry.near_bot_left, entry.length, octant), half, entry.planes });
+            }
+        }
+    }
+    return drawn;
+}
+
+void Octtree::get_octtree_wireframe(int depth, std::vector<QVector3D> &corners, std::vector<uint32_t> &indices,
+                                   std::vector<uint32_t> &level_ends) const
+{
+    corners.clear();
+    indices.clear();
+    level_ends.clear();
+    if (_nodes.empty())
+    {
+        return;
+    }
+
+    // corner k of a cube is at the far side along x | y << 1 | z << 2, like the octants
+    static const uint32_t edges[24] = { 0, 1, 2, 3, 4, 5, 6, 7,   // along x
+                                        0, 2, 1, 3, 4, 6, 5, 7,   // along y
+                                        0, 4, 1, 5, 2, 6, 3, 7 }; // along z
+    auto add_cube = [&](const QVector3D &near_bot_left, float length)
+    {
+        const uint32_t first = static_cast<uint32_t>(corners.size());
+        for (int corner = 0; corner < 8; ++corner)
+        {
+            corners.push_back(child_near_bot_left(near_bot_left, 2 * length, corner));
+        }
+        for (uint32_t edge : edges)
+        {
+            indices.push_back(first + edge);
+        }
+    };
+
+    // the nodes of a level with their corners, children follow each other in the order of
+    // their parents so the cubes of a level do too
+    std::vector<std::pair<uint32_t, QVector3D>> level(1, std::make_pair(0u, _near_bot_left));
+    std::vector<std::pair<uint32_t, QVector3D>> next;
+    add_cube(_near_bot_left, _length);
+    level_ends.push_back(static_cast<uint32_t>(indices.size()));
+    float length = _length;
+    for (int level_depth = 1; level_depth <= depth && !level.empty(); ++level_depth)
+    {
+        next.clear();
+        for (const auto &entry : level)
+        {
+            const OcttreeNode &node = _nodes[entry.first];
+            if (node.is_leaf())
+            {
+                continue;
+            }
+            // empty octants are drawn but have no node
+            uint32_t child = node.first_child;
+            for (int octant = 0; octant < 8; ++octant)
+            {
+                const QVector3D child_corner = child_near_bot_left(entry.second, length, octant);
+                add_cube(child_corner, length / 2);
+                if (node.child_mask & (1 << octant))
+                {
+                    next.push_back(std::make_pair(child++, child_corner));
+                }
+            }
+        }
+        length /= 2;
+        level.swap(next);
+        level_ends.push_back(static_cast<uint32_t>(indices.size()));
+    }
+}
+
+// serialized form: root corner and length, leaf capacity and max depth, node and point
+// count, then the arrays as they are
+static_assert(sizeof(QVector3D) == 3 * sizeof(float), "points are serialized as packed floats");
+
+static void append_bytes(std::vector<unsigned char> &out, const void *data, size_t size)
+{
+    const size_t at = out.size();
+    out.resize(at + size);
+    std::memcpy(out.data() + at, data, size);
+}
+
+std::vector<unsigned char> Octtree::serialize() const
+{
+    std::vector<unsigned char> out;
+    const float bounds[4] = { _near_bot_left.x(), _near_bot_left.y(), _near_bot_left.z(), _length };
+    const uint32_t limits[2] = { static_cast<uint32_t>(_leaf_capacity), static_cast<uint32_t>(_max_depth) };
+    const uint64_t counts[2] = { _nodes.size(), _points.size() };
+    append_bytes(out, bounds, sizeof(bounds));
+    append_bytes(out, limits, sizeof(limits));
+    append_bytes(out, counts, sizeof(counts));
+    // field by field, the padding of a node is written as zeros so the same tree gives the same bytes
+    const size_t nodes_at = out.size();
+    out.resize(nodes_at + _nodes.size() * sizeof(OcttreeNode), 0);
+    for (size_t i = 0; i < _nodes.size(); ++i)
+    {
+        const OcttreeNode &node = _nodes[i];
+        unsigned char *record = out.data() + nodes_at + i * sizeof(OcttreeNode);
+        std::memcpy(record + offsetof(OcttreeNode, first_child), &node.first_child, sizeof(node.first_child));
+        std::memcpy(record + offsetof(OcttreeNode, first), &node.first, sizeof(node.first));
+        std::memcpy(record + offsetof(OcttreeNode, count), &node.count, sizeof(node.count));
+        std::memcpy(record + offsetof(OcttreeNode, child_mask), &node.child_mask, sizeof(node.child_mask));
+        std::memcpy(record + offsetof(OcttreeNode, depth), &node.depth, sizeof(node.depth));
+    }
+    append_bytes(out, _rows.data(), _rows.size() * sizeof(uint32_t));
+    const size_t points_at = out.size();
+    out.resize(points_at + _points.size() * sizeof(QVector3D));
+    _points.save(out.data() + points_at);
+    return out;
+}
+
+Octtree* Octtree::deserialize(const unsigned char *data, size_t size)
+{
+    float bounds[4];
+    uint32_t limits[2];
+    uint64_t counts[2];
+    const size_t header = sizeof(bounds) + sizeof(limits) + sizeof(counts);
+    if (size < header)
+    {
+        return nullptr;
+    }
+    std::memcpy(bounds, data, sizeof(bounds));
+    std::memcpy(limits, data + sizeof(bounds), sizeof(limits));
+    std::memcpy(counts, data + sizeof(bounds) + sizeof(limits), sizeof(counts));
+    const unsigned char *p = data + header;
+    const uint64_t rest = size - header;
+    if (counts[0] > rest / sizeof(OcttreeNode) || counts[1] > rest
+            || rest != counts[0] * sizeof(OcttreeNode) + counts[1] * (sizeof(uint32_t) + sizeof(QVector3D)))
+    {
+        return nullptr;
+    }
+
+    Octtree *octtree = new Octtree(static_cast<int>(limits[0]), static_cast<int>(limits[1]));
+    octtree->_near_bot_left = QVector3D(bounds[0], bounds[1], bounds[2]);
+    octtree->_length = bounds[3];
+    octtree->_nodes.resize(counts[0]);
+    octtree->_rows.resize(counts[1]);
+    std::memcpy(octtree->_nodes.data(), p, counts[0] * sizeof(OcttreeNode));
+    p += counts[0] * sizeof(OcttreeNode);
+    std::memcpy(octtree->_rows.data(), p, counts[1] * sizeof(uint32_t));
+    p += counts[1] * sizeof(uint32_t);
+    octtree->_points.load(p, counts[1]);
+
+    // a broken cache must not send a traversal outside the arrays or around in a circle,
+    // children always come after their parent
+    for (size_t i = 0; i < octtree->_nodes.size(); ++i)
+    {
+        const OcttreeNode &node = octtree->_nodes[i];
+        const int children = node.child_count();
+        if (static_cast<uint64_t>(node.first) + node.count > counts[1]
+                || (children > 0 && (node.first_child <= i || static_cast<uint64_t>(node.first_child) + children > counts[0])))
+        {
+            delete octtree;
+            return nullptr;
+        }
     }
-    return false;
+    return octtree;
 }
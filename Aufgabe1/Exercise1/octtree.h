@@ -1,20 +1,197 @@
 #ifndef OCTTREE_H
 #define OCTTREE_H
 #include <QVector3D>
-#include <QColor>
-#include "Node.h"
+#include <QMatrix4x4>
+#include <atomic>
+#include <bitset>
+#include <cstdint>
+#include <vector>
 
+#include "morton.h"
+#include "pointblocks.h"
+#include "pointcloud.h"
 
+// one node of the linear octree. the children of a node follow each other in octant order,
+// octant k holds x | y << 1 | z << 2 of the upper halves, empty octants have no node
+struct OcttreeNode
+{
+    uint32_t first_child; // index of the first child in Octtree::get_nodes(), 0 for leaves
+    uint32_t first;       // the points of the node are [first, first + count) of get_points()
+    uint32_t count;
+    uint8_t child_mask;   // bit k is set if octant k has a child
+    uint8_t depth;        // 0 for the root
+    bool is_leaf() const { return child_mask == 0; }
+    int child_count() const { return static_cast<int>(std::bitset<8>(child_mask).count()); }
+};
+
+// a point found by a search, the cloud row it came from and its distance to the query
+struct OcttreeNeighbour
+{
+    uint32_t row;
+    float distance;
+};
+
+// a range of Octtree::get_draw_order(), drawn as one
+struct OcttreeRange
+{
+    uint32_t first;
+    uint32_t count;
+};
+
+// the six clip planes of a view projection, pointing inwards: a point p is in the view if
+// dot(plane, (p, 1)) >= 0 for all of them
+struct OcttreeFrustum
+{
+    explicit OcttreeFrustum(const QMatrix4x4& view_projection);
+    QVector4D planes[6];
+};
+
+// default limits, leaves of up to 32 points are scanned faster than split further
+static const int OCTTREE_LEAF_CAPACITY = 32;
+static const int OCTTREE_MAX_DEPTH = 16;
+
+// Pointerless octree over a cloud: nodes are stored breadth first in one array, points in
+// Morton order so every node covers one range of them. Nodes are split until they hold at
+// most leaf_capacity points, leaves on max_depth (at most MORTON_BITS) may hold more.
+// The arrays are the only allocations of a tree, a rebuild reuses them.
 class Octtree
 {
 public:
+    Octtree(int leaf_capacity = OCTTREE_LEAF_CAPACITY, int max_depth = OCTTREE_MAX_DEPTH);
+    Octtree(const Octtree&) = delete;
+    Octtree& operator=(const Octtree&) = delete;
+
+    // builds the tree bottom up from the sorted Morton codes of the points, the root is
+    // the smallest cube at the AABB minimum that holds the cloud. parallel builds the
+    // subtrees below the upper levels on all threads, the tree is the same either way. Once
+    // cancel is set the build stops after its current step and returns false, the tree is empty
+    bool build(const PointCloud& cloud, bool parallel = true, const std::atomic<bool>* cancel = nullptr);
+    // adds points with their cloud rows. A root that does not hold them becomes an octant of
+    // a root twice its size until it does, the old points keep their order. The new points
+    // are sorted and merged into the old ones. Leaves that go over the capacity are split, the
+    // rest of the tree is kept with its ranges moved, no point is sorted twice
+    void insert(const std::vector<QVector3D>& points, const std::vector<uint32_t>& rows);
+    // removes the points of these cloud rows, the root stays as it is. Nodes that drop to the
+    // capacity become leaves, empty ones go
+    void remove(const std::vector<uint32_t>& rows);
+
+    // empties the tree but keeps the memory of its arrays for the next build
+    void reset();
+    // empties the tree and frees its memory
+    void release();
+    // frees the sort keys only, for a tree that is not built again
+    void release_scratch();
+    // bytes held by the arrays, with the scratch keys of the build
+    size_t memory_usage() const;
+
+    // bounds of the root cube
+    QVector3D near_bot_left() const { return _near_bot_left; }
+    QVector3D far_top_right() const { return _near_bot_left + QVector3D(_length, _length, _length); }
+    float length() const { return _length; }
+    int leaf_capacity() const { return _leaf_capacity; }
+    int max_depth() const { return _max_depth; }
+
+    // root first, breadth first, empty for an empty cloud
+    const std::vector<OcttreeNode>& get_nodes() const { return _nodes; }
+    // the points in tree order and the cloud row each of them came from
+    const PointBlocks& get_points() const { return _points; }
+    const std::vector<uint32_t>& get_rows() const { return _rows; }
+
+    // lower corner of the child in octant of a node with the given corner and edge length
+    static QVector3D child_near_bot_left(const QVector3D& near_bot_left, float length, int octant);
+
+    // the k points nearest to query, nearest first, fewer if the cloud is smaller. Nodes are
+    // visited nearest first and skipped once they are further than the k-th point found
+    void knn(const QVector3D& query, int k, std::vector<OcttreeNeighbour>& result) const;
+    // all points within radius of query, in tree order
+    void radius_search(const QVector3D& query, float radius, std::vector<OcttreeNeighbour>& result) const;
+    // the same for many queries on all threads. knn_batch writes the min(k, points) nearest
+    // of query q to result[q * min(k, points)] onwards
+    void knn_batch(const std::vector<QVector3D>& queries, int k, std::vector<OcttreeNeighbour>& result) const;
+    void radius_search_batch(const std::vector<QVector3D>& queries, float radius,
+                             std::vector<std::vector<OcttreeNeighbour>>& result) const;
+
+    // the point nearest to origin along a ray whose distance from the ray is at most
+    // radius + spread * t where it is t along the normalized direction, the cone of a pixel
+    // through a perspective camera. hit.distance is t, false if the cone misses all points
+    bool pick(const QVector3D& origin, const QVector3D& direction, float radius, float spread,
+              OcttreeNeighbour& hit, QVector3D& point) const;
+
+    // every node with more than per_node points gets per_node of them spread evenly over its
+    // Morton range, they stand in for the node while it is small on screen
+    void build_samples(int per_node = OCTTREE_LEAF_CAPACITY);
+    // the rows of the points in tree order followed by the samples in node order, the index
+    // buffer the ranges of select_lod() point into
+    std::vector<uint32_t> get_draw_order() const;
+    // the ranges to draw for a view. Nodes outside the view frustum are skipped, the planes a
+    // node is completely inside of are not tested again below it. A node is drawn from its
+    // sample once the sample points are at most pixel_error pixels apart on screen, else its
+    // children are taken, a pixel_error of 0 draws all points in view. The points of a sample
+    // are taken length / sqrt(samples) apart, as on a surface. pixels_per_unit is the size in
+    // pixels of a unit at distance 1. Ranges that follow each other are merged, returns the
+    // number of nodes drawn
+    size_t select_lod(const QMatrix4x4& view_projection, float pixels_per_unit, float pixel_error,
+                      std::vector<OcttreeRange>& ranges) const;
+
+    // the cloud was reordered after the build, original_rows[i] is the build row now at row i.
+    // rows past the end of original_rows stay as they are
+    void renumber_rows(const std::vector<uint32_t>& original_rows);
+
+    // the edges of all nodes down to depth, with the empty octants of split nodes, as GL_LINES
+    // indices into the 8 corners of every cube. The cubes are written level by level, so the
+    // lines down to depth d are the first level_ends[d] indices
+    void get_octtree_wireframe(int depth, std::vector<QVector3D> &corners, std::vector<uint32_t> &indices,
+                               std::vector<uint32_t> &level_ends) const;
+
+    // nodes, rows and points for the cloud cache
+    std::vector<unsigned char> serialize() const;
+    static Octtree* deserialize(const unsigned char* data, size_t size);
+
+private:
+    // codes, points and rows of count points in tree order, point_at(i) and row_at(i) give
+    // point i and its cloud row
+    template <typename PointAt, typename RowAt>
+    void sort_points(size_t count, PointAt point_at, RowAt row_at);
+    // the nodes over the sorted codes
+    void build_nodes(bool parallel);
+    // the nodes after an insert or remove changed the sorted codes, over the old nodes. Cubes
+    // whose points did not change keep their subtrees. grown is the number of times the root
+    // grew, top holds the octant digits of the old root below the new one
+    void update_nodes(int grown, uint64_t top);
+    // the codes of the points for the current root, they are not kept by a loaded tree or
+    // after release_scratch()
+    void ensure_codes();
 
-    // variables
-    Node *root;
+    // a node waiting in a search, with its cube and squared distance to the query, or the
+    // entry of the ray into it for a pick
+    struct SearchEntry
+    {
+        float distance2;
+        uint32_t node;
+        QVector3D near_bot_left;
+        float length;
+        uint8_t planes = 0; // frustum planes the node still has to be tested against
+    };
+    float box_distance2(const QVector3D& query, const QVector3D& near_bot_left, float length) const;
+    // the searches with the heaps and stack of the caller, so a batch reuses them
+    void knn(const QVector3D& query, size_t k, std::vector<OcttreeNeighbour>& result,
+             std::vector<SearchEntry>& nodes, std::vector<std::pair<float, uint32_t>>& found) const;
+    void radius_search(const QVector3D& query, float radius, std::vector<OcttreeNeighbour>& result,
+                       std::vector<SearchEntry>& nodes) const;
 
-    //functions
-    Octtree(QVector3D new_near_bot_left, QVector3D new_far_top_right, float new_length);
-    void get_octtree_lines(std::vector<std::pair<QVector3D, QColor>> &octtree_lines, QColor colour, int depth, Node current);
-    bool insert_point(QVector3D point);
+    std::vector<OcttreeNode> _nodes;
+    PointBlocks _points;
+    std::vector<uint32_t> _rows;
+    // rows of the node samples, the sample of node i is [_sample_first[i], _sample_first[i + 1])
+    std::vector<uint32_t> _samples;
+    std::vector<uint32_t> _sample_first;
+    int _samples_per_node = 0;
+    // sort keys and radix buffer of the last build
+    std::vector<MortonKey> _keys;
+    std::vector<MortonKey> _key_buffer;
+    QVector3D _near_bot_left;
+    float _length = 0;
+    int _leaf_capacity;
+    int _max_depth;
 };
 #endif // OCTTREE_H
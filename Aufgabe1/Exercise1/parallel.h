@@ -0,0 +1,79 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// true while a thread runs a block of parallelBlocks or parallelFor,
+// loops nested inside run serially instead of starting threads of their own
+inline bool& insideParallel()
+{
+    static thread_local bool inside = false;
+    return inside;
+}
+
+// number of threads the parallel loops use instead of the hardware threads, 0 for all of
+// them. For benchmarks that measure the speedup by thread count
+inline unsigned& workerLimit()
+{
+    static unsigned limit = 0;
+    return limit;
+}
+
+// number of threads used by the parallel loops
+inline unsigned workerCount()
+{
+    if (insideParallel()) {
+        return 1;
+    }
+    if (workerLimit() > 0) {
+        return workerLimit();
+    }
+    const unsigned n = std::thread::hardware_concurrency();
+    return n > 0 ? n : 1;
+}
+
+// splits [0, count) into 'blocks' contiguous ranges and calls fn(begin, end, block) for each
+// range on its own thread, the calling thread takes block 0. fn must not throw.
+template <typename F>
+void parallelBlocks(size_t count, unsigned blocks, F fn)
+{
+    if (blocks <= 1 || count < 2) {
+        fn(size_t(0), count, 0u);
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    threads.reserve(blocks - 1);
+    for (unsigned b = 1; b < blocks; ++b) {
+        threads.emplace_back([&fn](size_t begin, size_t end, unsigned block) {
+            insideParallel() = true;
+            fn(begin, end, block);
+        }, count * b / blocks, count * (b + 1) / blocks, b);
+    }
+    const bool inside = insideParallel();
+    insideParallel() = true;
+    fn(size_t(0), count / blocks, 0u);
+    insideParallel() = inside;
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+// calls fn(i) for every i in [0, count), every thread takes the next index as soon as it is
+// free, for items of very different cost such as files. fn must not throw.
+template <typename F>
+void parallelFor(size_t count, F fn)
+{
+    std::atomic<size_t> next(0);
+    const unsigned threads = static_cast<unsigned>(std::min<size_t>(workerCount(), count));
+    parallelBlocks(threads, threads, [&](size_t, size_t, unsigned) {
+        for (size_t i = next++; i < count; i = next++) {
+            fn(i);
+        }
+    });
+}
+
+#endif // PARALLEL_H
@@ -0,0 +1,244 @@
+#include "plyheader.h"
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+int PlyHeader::propertyIndex(const std::string& name) const
+{
+    for (size_t i = 0; i < vertexProperties.size(); ++i) {
+        if (vertexProperties[i].name == name) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+static PlyType plyTypeFromString(const std::string& tag)
+{
+    if (tag == "char" || tag == "int8") return PlyType::Int8;
+    if (tag == "uchar" || tag == "uint8") return PlyType::UInt8;
+    if (tag == "short" || tag == "int16") return PlyType::Int16;
+    if (tag == "ushort" || tag == "uint16") return PlyType::UInt16;
+    if (tag == "int" || tag == "int32") return PlyType::Int32;
+    if (tag == "uint" || tag == "uint32") return PlyType::UInt32;
+    if (tag == "float" || tag == "float32") return PlyType::Float32;
+    if (tag == "double" || tag == "float64") return PlyType::Float64;
+    throw std::runtime_error("unknown ply property type: " + tag);
+}
+
+size_t plyTypeSize(PlyType type)
+{
+    switch (type) {
+    case PlyType::Int8:
+    case PlyType::UInt8:
+        return 1;
+    case PlyType::Int16:
+    case PlyType::UInt16:
+        return 2;
+    case PlyType::Int32:
+    case PlyType::UInt32:
+    case PlyType::Float32:
+        return 4;
+    case PlyType::Float64:
+        return 8;
+    }
+    return 0;
+}
+
+template <typename T>
+static T readSwapped(const unsigned char* p, bool swap)
+{
+    unsigned char bytes[sizeof(T)];
+    std::memcpy(bytes, p, sizeof(T));
+    if (swap) {
+        for (size_t i = 0; i < sizeof(T) / 2; ++i) {
+            std::swap(bytes[i], bytes[sizeof(T) - 1 - i]);
+        }
+    }
+    T value;
+    std::memcpy(&value, bytes, sizeof(T));
+    return value;
+}
+
+double plyReadValue(const unsigned char* p, PlyType type, bool swap)
+{
+    switch (type) {
+    case PlyType::Int8:    return readSwapped<int8_t>(p, swap);
+    case PlyType::UInt8:   return readSwapped<uint8_t>(p, swap);
+    case PlyType::Int16:   return readSwapped<int16_t>(p, swap);
+    case PlyType::UInt16:  return readSwapped<uint16_t>(p, swap);
+    case PlyType::Int32:   return readSwapped<int32_t>(p, swap);
+    case PlyType::UInt32:  return readSwapped<uint32_t>(p, swap);
+    case PlyType::Float32: return readSwapped<float>(p, swap);
+    case PlyType::Float64: return readSwapped<double>(p, swap);
+    }
+    return 0.0;
+}
+
+template <typename T>
+static void writeValue(unsigned char* p, double value)
+{
+    const T typed = static_cast<T>(value);
+    std::memcpy(p, &typed, sizeof(T));
+}
+
+void plyWriteValue(unsigned char* p, PlyType type, double value)
+{
+    switch (type) {
+    case PlyType::Int8:    writeValue<int8_t>(p, value); break;
+    case PlyType::UInt8:   writeValue<uint8_t>(p, value); break;
+    case PlyType::Int16:   writeValue<int16_t>(p, value); break;
+    case PlyType::UInt16:  writeValue<uint16_t>(p, value); break;
+    case PlyType::Int32:   writeValue<int32_t>(p, value); break;
+    case PlyType::UInt32:  writeValue<uint32_t>(p, value); break;
+    case PlyType::Float32: writeValue<float>(p, value); break;
+    case PlyType::Float64: writeValue<double>(p, value); break;
+    }
+}
+
+// skips blanks, parses one number without locale, returns nullptr on failure
+template <typename T>
+static const char* parseNumber(const char* p, const char* end, T& value)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) {
+        ++p;
+    }
+    // from_chars takes no plus sign, a stream did
+    if (p + 1 < end && *p == '+' && p[1] != '-') {
+        ++p;
+    }
+    const std::from_chars_result result = std::from_chars(p, end, value);
+    if (result.ec != std::errc()) {
+        return nullptr;
+    }
+    return result.ptr;
+}
+
+const char* plyParseFloat(const char* p, const char* end, float& value)
+{
+    return parseNumber(p, end, value);
+}
+
+const char* plyParseValue(const char* p, const char* end, PlyType type, unsigned char* dst)
+{
+    // floats directly, so they match a float parse of x, y, z
+    if (type == PlyType::Float32) {
+        float value;
+        p = parseNumber(p, end, value);
+        if (p) {
+            std::memcpy(dst, &value, sizeof(value));
+        }
+        return p;
+    }
+    double value;
+    p = parseNumber(p, end, value);
+    if (p) {
+        plyWriteValue(dst, type, value);
+    }
+    return p;
+}
+
+PlyHeader parsePlyHeader(std::istream& is)
+{
+    PlyHeader header;
+
+    // ensure format with magic header
+    std::string line;
+    std::getline(is, line);
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    if (line != "ply") {
+        throw std::runtime_error("not a ply file");
+    }
+
+    // properties are collected for the vertices, the first faces and the elements in between,
+    // whose records have to be skipped to reach the faces
+    std::string currentElement;
+    std::vector<PlyProperty>* properties = nullptr;
+    bool vertexSeen = false;
+    bool faceSeen = false;
+    bool hasFormat = false;
+    while (is.good()) {
+        std::getline(is, line);
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line == "end_header") {
+            header.dataOffset = static_cast<size_t>(is.tellg());
+            break;
+        }
+
+        std::stringstream ss(line);
+        std::string tag1, tag2, tag3;
+        ss >> tag1 >> tag2 >> tag3;
+        if (tag1 == "format") {
+            hasFormat = true;
+            if (tag2 == "ascii") {
+                header.format = PlyFormat::Ascii;
+            } else if (tag2 == "binary_little_endian") {
+                header.format = PlyFormat::BinaryLittleEndian;
+            } else if (tag2 == "binary_big_endian") {
+                header.format = PlyFormat::BinaryBigEndian;
+            } else {
+                throw std::runtime_error("unknown ply format: " + tag2);
+            }
+        } else if (tag1 == "element") {
+            currentElement = tag2;
+            properties = nullptr;
+            if (tag2 == "vertex") {
+                header.vertexCount = std::stoull(tag3);
+                vertexSeen = true;
+            } else if (!vertexSeen) {
+                throw std::runtime_error("unsupported ply file: 'element vertex' has to be the first element");
+            } else if (faceSeen) {
+                // elements after the faces are not read
+            } else if (tag2 == "face") {
+                header.faceCount = std::stoull(tag3);
+                properties = &header.faceProperties;
+                faceSeen = true;
+            } else {
+                PlyElement element;
+                element.name = tag2;
+                element.count = std::stoull(tag3);
+                header.skippedElements.push_back(element);
+                properties = &header.skippedElements.back().properties;
+            }
+        } else if (tag1 == "property" && currentElement == "vertex") {
+            if (tag2 == "list") {
+                throw std::runtime_error("unsupported ply file: list property in 'element vertex'");
+            }
+            PlyProperty property;
+            property.name = tag3;
+            property.type = plyTypeFromString(tag2);
+            property.offset = header.vertexStride;
+            header.vertexStride += plyTypeSize(property.type);
+            header.vertexProperties.push_back(property);
+        } else if (tag1 == "property" && properties) {
+            PlyProperty property;
+            property.offset = 0;
+            if (tag2 == "list") {
+                std::string tag4, tag5;
+                ss >> tag4 >> tag5;
+                property.list = true;
+                property.countType = plyTypeFromString(tag3);
+                property.type = plyTypeFromString(tag4);
+                property.name = tag5;
+                if (properties == &header.faceProperties && (tag5 == "vertex_indices" || tag5 == "vertex_index")) {
+                    header.faceIndices = static_cast<int>(header.faceProperties.size());
+                }
+            } else {
+                property.type = plyTypeFromString(tag2);
+                property.name = tag3;
+            }
+            properties->push_back(property);
+        }
+    }
+
+    if (header.faceIndices < 0) {
+        header.faceCount = 0;
+    }
+    if (!hasFormat || header.dataOffset == 0) {
+        throw std::runtime_error("broken ply header");
+    }
+    return header;
+}
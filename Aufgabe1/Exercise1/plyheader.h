@@ -0,0 +1,62 @@
+#ifndef PLYHEADER_H
+#define PLYHEADER_H
+
+#include <istream>
+#include <string>
+#include <vector>
+
+enum class PlyFormat { Ascii, BinaryLittleEndian, BinaryBigEndian };
+
+enum class PlyType { Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64 };
+
+struct PlyProperty
+{
+    std::string name;
+    PlyType type;
+    size_t offset; // byte offset inside a binary vertex record
+    bool list = false;          // face properties only, a count of countType followed by the values
+    PlyType countType = PlyType::UInt8;
+};
+
+// an element between the vertices and the faces, its records are only skipped
+struct PlyElement
+{
+    std::string name;
+    size_t count = 0;
+    std::vector<PlyProperty> properties;
+};
+
+struct PlyHeader
+{
+    PlyFormat format = PlyFormat::Ascii;
+    size_t vertexCount = 0;
+    std::vector<PlyProperty> vertexProperties;
+    size_t vertexStride = 0; // bytes per binary vertex record
+    size_t dataOffset = 0;   // bytes from file start to the first vertex
+
+    // the first 'element face' after the vertices, the elements in between are skipped by
+    // their properties, the ones after the faces are ignored
+    size_t faceCount = 0;
+    std::vector<PlyProperty> faceProperties;
+    int faceIndices = -1; // the vertex_indices list among faceProperties
+    std::vector<PlyElement> skippedElements; // between the vertices and the faces, in file order
+
+    int propertyIndex(const std::string& name) const;
+};
+
+size_t plyTypeSize(PlyType type);
+
+// reads one binary value, swapping bytes if the file endianness differs from the host
+double plyReadValue(const unsigned char* p, PlyType type, bool swap);
+
+// writes one value in host byte order, converted to the given type
+void plyWriteValue(unsigned char* p, PlyType type, double value);
+
+// ascii number parsing without locale, skips leading blanks, returns the end of the number or nullptr
+const char* plyParseFloat(const char* p, const char* end, float& value);
+const char* plyParseValue(const char* p, const char* end, PlyType type, unsigned char* dst);
+
+// parses everything up to and including 'end_header', leaves the stream at the first data byte
+PlyHeader parsePlyHeader(std::istream& is);
+
+#endif // PLYHEADER_H
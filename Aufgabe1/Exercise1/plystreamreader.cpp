@@ -0,0 +1,245 @@
+#include "plystreamreader.h"
+#include <QtGlobal>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+static const size_t ASCII_BUFFER_SIZE = 4 << 20;
+
+PlyStreamReader::PlyStreamReader(const QString& filePath, size_t chunkSize, bool readAhead)
+    : _chunkSize(std::max<size_t>(1, chunkSize)),
+      _readAhead(readAhead)
+{
+    // open stream, binary mode so the header length is a byte offset
+    _is.open(filePath.toStdString().c_str(), std::ios::in | std::ios::binary);
+    if (!_is.is_open()) {
+        throw std::runtime_error("could not open ply file");
+    }
+
+    _header = parsePlyHeader(_is);
+    if (_header.vertexCount > 0) {
+        const char* names[3] = { "x", "y", "z" };
+        for (int k = 0; k < 3; ++k) {
+            _xyzOf[k] = _header.propertyIndex(names[k]);
+            if (_xyzOf[k] < 0) {
+                throw std::runtime_error("ply file without x, y, z vertex properties");
+            }
+        }
+    }
+
+    const bool fileLittleEndian = _header.format == PlyFormat::BinaryLittleEndian;
+    const bool hostLittleEndian = Q_BYTE_ORDER == Q_LITTLE_ENDIAN;
+    _swap = _header.format != PlyFormat::Ascii && fileLittleEndian != hostLittleEndian;
+
+    if (_header.format == PlyFormat::Ascii) {
+        _buffer.resize(ASCII_BUFFER_SIZE);
+    }
+
+    if (_readAhead) {
+        _worker = std::thread(&PlyStreamReader::readAheadLoop, this);
+    }
+}
+
+PlyStreamReader::~PlyStreamReader()
+{
+    if (_worker.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _condition.notify_all();
+        _worker.join();
+    }
+}
+
+bool PlyStreamReader::next(PointChunk& chunk)
+{
+    if (!_readAhead) {
+        return readChunk(chunk);
+    }
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    _condition.wait(lock, [this] { return !_ready.empty() || _done; });
+    if (!_ready.empty()) {
+        chunk = std::move(_ready.front());
+        _ready.pop_front();
+        _condition.notify_all();
+        return true;
+    }
+    if (_error) {
+        std::rethrow_exception(_error);
+    }
+    return false;
+}
+
+void PlyStreamReader::readAheadLoop()
+{
+    PointChunk chunk;
+    for (;;) {
+        bool more = false;
+        try {
+            more = readChunk(chunk);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _error = std::current_exception();
+            _done = true;
+            _condition.notify_all();
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (!more) {
+            _done = true;
+            _condition.notify_all();
+            return;
+        }
+        _condition.wait(lock, [this] { return _ready.empty() || _stop; });
+        if (_stop) {
+            return;
+        }
+        _ready.push_back(std::move(chunk));
+        chunk = PointChunk();
+        _condition.notify_all();
+    }
+}
+
+bool PlyStreamReader::readChunk(PointChunk& chunk)
+{
+    if (_nextRow >= _header.vertexCount) {
+        return false;
+    }
+
+    chunk.first = _nextRow;
+    chunk.count = std::min(_chunkSize, _header.vertexCount - _nextRow);
+    chunk.points.resize(chunk.count * 3);
+
+    if (_header.format == PlyFormat::Ascii) {
+        readASCII(chunk);
+    } else {
+        readBinary(chunk);
+    }
+    _nextRow += chunk.count;
+    return true;
+}
+
+void PlyStreamReader::readBinary(PointChunk& chunk)
+{
+    const size_t bytes = chunk.count * _header.vertexStride;
+    _buffer.resize(bytes);
+    _is.read(_buffer.data(), static_cast<std::streamsize>(bytes));
+    if (static_cast<size_t>(_is.gcount()) < bytes) {
+        throw std::runtime_error("broken ply file");
+    }
+
+    const PlyProperty* xyz[3];
+    for (int k = 0; k < 3; ++k) {
+        xyz[k] = &_header.vertexProperties[_xyzOf[k]];
+    }
+
+    float* p = chunk.points.data();
+    const unsigned char* record = reinterpret_cast<const unsigned char*>(_buffer.data());
+    for (size_t i = 0; i < chunk.count; ++i, record += _header.vertexStride) {
+        for (int k = 0; k < 3; ++k) {
+            *p++ = static_cast<float>(plyReadValue(record + xyz[k]->offset, xyz[k]->type, _swap));
+        }
+    }
+}
+
+void PlyStreamReader::refill()
+{
+    // keep the unparsed rest, grow only if a single line does not fit
+    const size_t rest = _bufferEnd - _bufferBegin;
+    if (_bufferBegin > 0) {
+        std::memmove(_buffer.data(), _buffer.data() + _bufferBegin, rest);
+    } else if (rest == _buffer.size()) {
+        _buffer.resize(_buffer.size() * 2);
+    }
+    _bufferBegin = 0;
+    _bufferEnd = rest;
+
+    _is.read(_buffer.data() + _bufferEnd, static_cast<std::streamsize>(_buffer.size() - _bufferEnd));
+    const size_t read = static_cast<size_t>(_is.gcount());
+    _bufferEnd += read;
+    if (read == 0) {
+        _eof = true;
+    }
+}
+
+void PlyStreamReader::readASCII(PointChunk& chunk)
+{
+    const int valuesPerLine = static_cast<int>(_header.vertexProperties.size());
+    float* point = chunk.points.data();
+    unsigned char skipped[8];
+
+    size_t n = 0;
+    while (n < chunk.count) {
+        const char* begin = _buffer.data() + _bufferBegin;
+        const char* end = _buffer.data() + _bufferEnd;
+        const char* lineEnd = static_cast<const char*>(std::memchr(begin, '\n', end - begin));
+        if (!lineEnd) {
+            if (!_eof) {
+                refill();
+                continue;
+            }
+            // last line without newline
+            if (begin == end) {
+                throw std::runtime_error("broken ply file");
+            }
+            lineEnd = end;
+        }
+
+        const char* p = begin;
+        for (int v = 0; v < valuesPerLine && p; ++v) {
+            if (v == _xyzOf[0]) {
+                p = plyParseFloat(p, lineEnd, point[0]);
+            } else if (v == _xyzOf[1]) {
+                p = plyParseFloat(p, lineEnd, point[1]);
+            } else if (v == _xyzOf[2]) {
+                p = plyParseFloat(p, lineEnd, point[2]);
+            } else {
+                p = plyParseValue(p, lineEnd, PlyType::Float64, skipped);
+            }
+        }
+        if (!p) {
+            throw std::runtime_error("broken ply file");
+        }
+
+        point += 3;
+        ++n;
+        _bufferBegin = std::min(static_cast<size_t>(lineEnd - _buffer.data()) + 1, _bufferEnd);
+    }
+}
+
+PlyStatistics plyStatistics(const QString& filePath, size_t chunkSize)
+{
+    PlyStreamReader reader(filePath, chunkSize);
+    PlyStatistics statistics;
+    double sum[3] = { 0, 0, 0 };
+    float low[3] = { 0, 0, 0 };
+    float high[3] = { 0, 0, 0 };
+    PointChunk chunk;
+    while (reader.next(chunk)) {
+        const float* p = chunk.points.data();
+        for (size_t i = 0; i < chunk.count; ++i, p += 3) {
+            if (!std::isfinite(p[0]) || !std::isfinite(p[1]) || !std::isfinite(p[2])) {
+                continue;
+            }
+            for (int k = 0; k < 3; ++k) {
+                low[k] = statistics.finite == 0 ? p[k] : std::min(low[k], p[k]);
+                high[k] = statistics.finite == 0 ? p[k] : std::max(high[k], p[k]);
+                sum[k] += p[k];
+            }
+            ++statistics.finite;
+        }
+        statistics.count += chunk.count;
+    }
+
+    statistics.min = QVector3D(low[0], low[1], low[2]);
+    statistics.max = QVector3D(high[0], high[1], high[2]);
+    if (statistics.finite > 0) {
+        const double n = static_cast<double>(statistics.finite);
+        statistics.mean = QVector3D(static_cast<float>(sum[0] / n), static_cast<float>(sum[1] / n), static_cast<float>(sum[2] / n));
+    }
+    return statistics;
+}
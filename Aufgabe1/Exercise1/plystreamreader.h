@@ -0,0 +1,88 @@
+#ifndef PLYSTREAMREADER_H
+#define PLYSTREAMREADER_H
+
+#include <QString>
+#include <QVector3D>
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "plyheader.h"
+
+// a block of consecutive points of a ply file, x, y, z per point as in PointCloud::_pointsData
+struct PointChunk
+{
+    size_t first = 0; // row index of the first point in the file
+    size_t count = 0;
+    std::vector<float> points;
+};
+
+// Reads the vertices of a ply file in fixed size chunks, without ever holding the whole
+// cloud in memory. Peak memory is a few chunks plus one read buffer, independent of the
+// file size. With read ahead, the next chunk is parsed on a background thread while the
+// caller works on the current one.
+class PlyStreamReader
+{
+public:
+    PlyStreamReader(const QString& filePath, size_t chunkSize = 1 << 20, bool readAhead = true);
+    ~PlyStreamReader();
+
+    PlyStreamReader(const PlyStreamReader&) = delete;
+    PlyStreamReader& operator=(const PlyStreamReader&) = delete;
+
+    const PlyHeader& getHeader() const { return _header; }
+    size_t getCount() const { return _header.vertexCount; }
+    size_t getChunkSize() const { return _chunkSize; }
+
+    // fills the next chunk, returns false after the last one, throws on broken files
+    bool next(PointChunk& chunk);
+
+private:
+    bool readChunk(PointChunk& chunk);
+    void readBinary(PointChunk& chunk);
+    void readASCII(PointChunk& chunk);
+    void refill();
+    void readAheadLoop();
+
+    std::ifstream _is;
+    PlyHeader _header;
+    size_t _chunkSize;
+    size_t _nextRow = 0;
+    int _xyzOf[3];
+    bool _swap = false;
+
+    // raw bytes, for ascii files the unparsed rest of the last read stays in [_bufferBegin, _bufferEnd)
+    std::vector<char> _buffer;
+    size_t _bufferBegin = 0;
+    size_t _bufferEnd = 0;
+    bool _eof = false;
+
+    // read ahead, at most one finished chunk waits for the caller
+    bool _readAhead;
+    std::thread _worker;
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    std::deque<PointChunk> _ready;
+    bool _done = false;
+    bool _stop = false;
+    std::exception_ptr _error;
+};
+
+// count, AABB and centroid of the points of a ply file, read chunk by chunk. Points that are
+// not finite are counted but left out of the bounds and the centroid
+struct PlyStatistics
+{
+    size_t count = 0;
+    size_t finite = 0;
+    QVector3D min;
+    QVector3D max;
+    QVector3D mean;
+};
+PlyStatistics plyStatistics(const QString& filePath, size_t chunkSize = 1 << 20);
+
+#endif // PLYSTREAMREADER_H
@@ -0,0 +1,268 @@
+#include "pointblocks.h"
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include "parallel.h"
+
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define POINTBLOCKS_X86 1
+#include <immintrin.h>
+#endif
+
+// a kernel may read this many floats past the last point
+static const size_t POINT_PADDING = 8;
+
+typedef uint32_t (*DistanceKernel)(const float* x, const float* y, const float* z, uint32_t count,
+                                   const QVector3D& query, float limit, float* out);
+typedef uint32_t (*InsideKernel)(const float* x, const float* y, const float* z, uint32_t count,
+                                 const QVector3D& min, const QVector3D& max);
+
+static uint32_t distancesScalar(const float* x, const float* y, const float* z, uint32_t count,
+                                const QVector3D& query, float limit, float* out)
+{
+    uint32_t mask = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        const float dx = x[i] - query.x();
+        const float dy = y[i] - query.y();
+        const float dz = z[i] - query.z();
+        out[i] = dx * dx + dy * dy + dz * dz;
+        if (out[i] <= limit) {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+}
+
+static uint32_t insideScalar(const float* x, const float* y, const float* z, uint32_t count,
+                             const QVector3D& min, const QVector3D& max)
+{
+    uint32_t mask = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (x[i] >= min.x() && y[i] >= min.y() && z[i] >= min.z()
+                && x[i] <= max.x() && y[i] <= max.y() && z[i] <= max.z()) {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+}
+
+#if defined(POINTBLOCKS_X86)
+
+static uint32_t distancesSse(const float* x, const float* y, const float* z, uint32_t count,
+                             const QVector3D& query, float limit, float* out)
+{
+    const __m128 qx = _mm_set1_ps(query.x());
+    const __m128 qy = _mm_set1_ps(query.y());
+    const __m128 qz = _mm_set1_ps(query.z());
+    const __m128 bound = _mm_set1_ps(limit);
+    uint32_t mask = 0;
+    for (uint32_t i = 0; i < count; i += 4) {
+        const __m128 dx = _mm_sub_ps(_mm_loadu_ps(x + i), qx);
+        const __m128 dy = _mm_sub_ps(_mm_loadu_ps(y + i), qy);
+        const __m128 dz = _mm_sub_ps(_mm_loadu_ps(z + i), qz);
+        const __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+        _mm_storeu_ps(out + i, d2);
+        mask |= static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(d2, bound))) << i;
+    }
+    return mask & blockMask(count);
+}
+
+static uint32_t insideSse(const float* x, const float* y, const float* z, uint32_t count,
+                          const QVector3D& min, const QVector3D& max)
+{
+    const __m128 lowX = _mm_set1_ps(min.x()), highX = _mm_set1_ps(max.x());
+    const __m128 lowY = _mm_set1_ps(min.y()), highY = _mm_set1_ps(max.y());
+    const __m128 lowZ = _mm_set1_ps(min.z()), highZ = _mm_set1_ps(max.z());
+    uint32_t mask = 0;
+    for (uint32_t i = 0; i < count; i += 4) {
+        const __m128 px = _mm_loadu_ps(x + i);
+        const __m128 py = _mm_loadu_ps(y + i);
+        const __m128 pz = _mm_loadu_ps(z + i);
+        const __m128 in = _mm_and_ps(_mm_and_ps(_mm_and_ps(_mm_cmpge_ps(px, lowX), _mm_cmple_ps(px, highX)),
+                                                _mm_and_ps(_mm_cmpge_ps(py, lowY), _mm_cmple_ps(py, highY))),
+                                     _mm_and_ps(_mm_cmpge_ps(pz, lowZ), _mm_cmple_ps(pz, highZ)));
+        mask |= static_cast<uint32_t>(_mm_movemask_ps(in)) << i;
+    }
+    return mask & blockMask(count);
+}
+
+// compiled for AVX2 whatever the flags of the build, only called where the cpu has it
+#if defined(__GNUC__)
+#define AVX2_TARGET __attribute__((target("avx2")))
+#else
+#define AVX2_TARGET
+#endif
+
+AVX2_TARGET static uint32_t distancesAvx2(const float* x, const float* y, const float* z, uint32_t count,
+                                          const QVector3D& query, float limit, float* out)
+{
+    const __m256 qx = _mm256_set1_ps(query.x());
+    const __m256 qy = _mm256_set1_ps(query.y());
+    const __m256 qz = _mm256_set1_ps(query.z());
+    const __m256 bound = _mm256_set1_ps(limit);
+    uint32_t mask = 0;
+    for (uint32_t i = 0; i < count; i += 8) {
+        const __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x + i), qx);
+        const __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y + i), qy);
+        const __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(z + i), qz);
+        const __m256 d2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+        _mm256_storeu_ps(out + i, d2);
+        mask |= static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(d2, bound, _CMP_LE_OQ))) << i;
+    }
+    return mask & blockMask(count);
+}
+
+AVX2_TARGET static uint32_t insideAvx2(const float* x, const float* y, const float* z, uint32_t count,
+                                       const QVector3D& min, const QVector3D& max)
+{
+    const __m256 lowX = _mm256_set1_ps(min.x()), highX = _mm256_set1_ps(max.x());
+    const __m256 lowY = _mm256_set1_ps(min.y()), highY = _mm256_set1_ps(max.y());
+    const __m256 lowZ = _mm256_set1_ps(min.z()), highZ = _mm256_set1_ps(max.z());
+    uint32_t mask = 0;
+    for (uint32_t i = 0; i < count; i += 8) {
+        const __m256 px = _mm256_loadu_ps(x + i);
+        const __m256 py = _mm256_loadu_ps(y + i);
+        const __m256 pz = _mm256_loadu_ps(z + i);
+        const __m256 inX = _mm256_and_ps(_mm256_cmp_ps(px, lowX, _CMP_GE_OQ), _mm256_cmp_ps(px, highX, _CMP_LE_OQ));
+        const __m256 inY = _mm256_and_ps(_mm256_cmp_ps(py, lowY, _CMP_GE_OQ), _mm256_cmp_ps(py, highY, _CMP_LE_OQ));
+        const __m256 inZ = _mm256_and_ps(_mm256_cmp_ps(pz, lowZ, _CMP_GE_OQ), _mm256_cmp_ps(pz, highZ, _CMP_LE_OQ));
+        mask |= static_cast<uint32_t>(_mm256_movemask_ps(_mm256_and_ps(_mm256_and_ps(inX, inY), inZ))) << i;
+    }
+    return mask & blockMask(count);
+}
+
+// AVX2 needs the cpu flag and an OS that saves the ymm registers
+static bool cpuHasAvx2()
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // POINTBLOCKS_X86
+
+struct Kernels
+{
+    DistanceKernel distances;
+    InsideKernel inside;
+    const char* name;
+};
+
+// the fastest kernels the cpu has
+static Kernels pickKernels()
+{
+#if defined(POINTBLOCKS_X86)
+    if (cpuHasAvx2()) {
+        return { distancesAvx2, insideAvx2, "avx2" };
+    }
+    return { distancesSse, insideSse, "sse" };
+#else
+    return { distancesScalar, insideScalar, "scalar" };
+#endif
+}
+
+static Kernels& kernels()
+{
+    static Kernels picked = pickKernels();
+    return picked;
+}
+
+void PointBlocks::resize(size_t count)
+{
+    // points dropped by a smaller count may still be in the arrays, the kernels mask them out
+    const size_t stale = std::min(count, _x.size());
+    for (size_t i = _count; i < stale; ++i) {
+        _x[i] = _y[i] = _z[i] = 0;
+    }
+    _x.resize(count + POINT_PADDING, 0);
+    _y.resize(count + POINT_PADDING, 0);
+    _z.resize(count + POINT_PADDING, 0);
+    _count = count;
+}
+
+void PointBlocks::clear()
+{
+    _x.clear();
+    _y.clear();
+    _z.clear();
+    _count = 0;
+}
+
+size_t PointBlocks::memoryUsage() const
+{
+    return (_x.capacity() + _y.capacity() + _z.capacity()) * sizeof(float);
+}
+
+void PointBlocks::save(unsigned char* out) const
+{
+    parallelBlocks(_count, workerCount(), [&](size_t begin, size_t end, unsigned) {
+        for (size_t i = begin; i < end; ++i) {
+            const float point[3] = { _x[i], _y[i], _z[i] };
+            std::memcpy(out + i * sizeof(point), point, sizeof(point));
+        }
+    });
+}
+
+void PointBlocks::load(const unsigned char* in, size_t count)
+{
+    clear();
+    resize(count);
+    parallelBlocks(count, workerCount(), [&](size_t begin, size_t end, unsigned) {
+        for (size_t i = begin; i < end; ++i) {
+            float point[3];
+            std::memcpy(point, in + i * sizeof(point), sizeof(point));
+            _x[i] = point[0];
+            _y[i] = point[1];
+            _z[i] = point[2];
+        }
+    });
+}
+
+uint32_t PointBlocks::squaredDistances(size_t first, uint32_t count, const QVector3D& query, float limit, float* out) const
+{
+    return kernels().distances(_x.data() + first, _y.data() + first, _z.data() + first, count, query, limit, out);
+}
+
+uint32_t PointBlocks::inside(size_t first, uint32_t count, const QVector3D& min, const QVector3D& max) const
+{
+    return kernels().inside(_x.data() + first, _y.data() + first, _z.data() + first, count, min, max);
+}
+
+const char* PointBlocks::kernelName()
+{
+    return kernels().name;
+}
+
+bool PointBlocks::setKernels(const char* name)
+{
+    const std::string wanted(name);
+    if (wanted == "scalar") {
+        kernels() = { distancesScalar, insideScalar, "scalar" };
+        return true;
+    }
+#if defined(POINTBLOCKS_X86)
+    if (wanted == "sse") {
+        kernels() = { distancesSse, insideSse, "sse" };
+        return true;
+    }
+    if (wanted == "avx2" && cpuHasAvx2()) {
+        kernels() = { distancesAvx2, insideAvx2, "avx2" };
+        return true;
+    }
+#endif
+    return false;
+}
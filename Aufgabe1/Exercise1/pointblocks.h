@@ -0,0 +1,82 @@
+#ifndef POINTBLOCKS_H
+#define POINTBLOCKS_H
+
+#include <QVector3D>
+
+#include <cstdint>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// points per call of the kernels, one bit each in the returned masks
+static const uint32_t POINT_BLOCK = 32;
+
+// index of the lowest set bit of a mask that is not 0
+inline int lowestBit(uint32_t mask)
+{
+#if defined(_MSC_VER)
+    unsigned long lowest;
+    _BitScanForward(&lowest, mask);
+    return static_cast<int>(lowest);
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+// bits 0 to count - 1, all points of a block of count
+inline uint32_t blockMask(uint32_t count)
+{
+    return count >= POINT_BLOCK ? ~0u : (1u << count) - 1;
+}
+
+// The points of a tree in tree order as three float arrays, the only copy the tree keeps. A
+// leaf is a range of them, the kernels take up to POINT_BLOCK points of it at once, 8 per
+// AVX2 and 4 per SSE instruction, picked when the program starts. The arrays are padded so a
+// kernel may read a full SIMD block past the last point. The results are the same on every
+// path: differences, squares and sums are taken in the order of QVector3D::lengthSquared and
+// no fused multiply add is used.
+class PointBlocks
+{
+public:
+    size_t size() const { return _count; }
+    bool empty() const { return _count == 0; }
+    QVector3D operator[](size_t i) const { return QVector3D(_x[i], _y[i], _z[i]); }
+    void set(size_t i, const QVector3D& point)
+    {
+        _x[i] = point.x();
+        _y[i] = point.y();
+        _z[i] = point.z();
+    }
+    // the first min(count, size()) points stay, the others are 0
+    void resize(size_t count);
+    void clear();
+    size_t memoryUsage() const;
+
+    // the points as packed x, y, z floats, the form of the caches. out must hold 12 bytes per
+    // point, in count points
+    void save(unsigned char* out) const;
+    void load(const unsigned char* in, size_t count);
+
+    // squared distances of points [first, first + count) to query, count at most POINT_BLOCK,
+    // to out, which must hold POINT_BLOCK floats. Bit i of the result is set if point
+    // first + i is at most limit away
+    uint32_t squaredDistances(size_t first, uint32_t count, const QVector3D& query, float limit, float* out) const;
+    // bit i of the result is set if point first + i is in the box from min to max
+    uint32_t inside(size_t first, uint32_t count, const QVector3D& min, const QVector3D& max) const;
+
+    // "avx2", "sse" or "scalar", the kernels in use
+    static const char* kernelName();
+    // switches to the kernels of that name, to compare them with each other. Returns false
+    // and keeps the kernels if the cpu does not have them. Not while a search runs
+    static bool setKernels(const char* name);
+
+private:
+    size_t _count = 0;
+    std::vector<float> _x;
+    std::vector<float> _y;
+    std::vector<float> _z;
+};
+
+#endif // POINTBLOCKS_H
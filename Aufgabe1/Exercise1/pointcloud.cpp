@@ -1,81 +1,1196 @@
 #include "pointcloud.h"
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QtGlobal>
 #include <fstream>
-#include <sstream>
 #include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <unordered_map>
+#include "morton.h"
+#include "parallel.h"
+#include "plystreamreader.h"
+
+// ascii bodies are parsed in pieces of this size, binary ones in slabs of this many rows,
+// finished rows are reported to the LoadProgress after every wave of pieces or slab
+static const size_t ASCII_PIECE_SIZE = 4 << 20;
+static const size_t BINARY_SLAB_ROWS = 1 << 20;
+// a QVector counts in int and holds less than 2 GiB, larger clouds can only be drawn from
+// a mapped binary ply whose x, y, z are floats one after the other
+static const size_t MAX_DATA_POINTS =
+        (static_cast<size_t>(std::numeric_limits<int>::max()) - 64) / (POINT_STRIDE * sizeof(float));
+
+// data sized for count points, throws if a QVector cannot hold them
+static void resizePointData(QVector<float>& data, size_t count)
+{
+    if (count > MAX_DATA_POINTS) {
+        throw std::runtime_error("too many points to copy into memory, " + std::to_string(MAX_DATA_POINTS)
+                                 + " at most, larger clouds need a binary ply with float x, y, z");
+    }
+    data.resize(static_cast<int>(count * POINT_STRIDE));
+}
 
 PointCloud::PointCloud()
 {}
 
 PointCloud::~PointCloud()
-{}
+{
+    unmap();
+}
+
+PointCloud& PointCloud::operator=(PointCloud&& other)
+{
+    if (this == &other) {
+        return *this;
+    }
+    unmap();
+    _pointsCount = other._pointsCount;
+    _pointsBoundMin = other._pointsBoundMin;
+    _pointsBoundMax = other._pointsBoundMax;
+    _file = std::move(other._file);
+    _mapped = other._mapped;
+    // the view stays valid, moving a QVector keeps its buffer
+    _view = other._view;
+    _columns = std::move(other._columns);
+    _tiles = std::move(other._tiles);
+    _faces = std::move(other._faces);
+    _originalRows = std::move(other._originalRows);
+    _quantized = std::move(other._quantized);
+    _quantizeStep = other._quantizeStep;
+    _pointsData = std::move(other._pointsData);
+    _path = std::move(other._path);
+    _cacheKey = other._cacheKey;
+    _cache = std::move(other._cache);
+
+    other._mapped = nullptr;
+    other.clear();
+    return *this;
+}
+
+void PointCloud::unmap()
+{
+    if (_mapped) {
+        _file->unmap(_mapped);
+        _mapped = nullptr;
+    }
+    _file.reset();
+    _cache.reset();
+    _view = PointView();
+}
+
+void PointCloud::clear()
+{
+    unmap();
+    _pointsData.clear();
+    _columns.clear();
+    _tiles.clear();
+    _faces.clear();
+    _originalRows.clear();
+    _quantized.clear();
+    _quantizeStep = QVector3D();
+    _pointsCount = 0;
+    _pointsBoundMin = QVector3D();
+    _pointsBoundMax = QVector3D();
+}
 
+void PointCloud::updateBounds(float x, float y, float z)
+{
+    // a NaN or infinite point would spread to the whole AABB
+    if (!std::isfinite(x) || !std::isfinite(y) || !std::isfinite(z)) {
+        return;
+    }
+    _pointsBoundMax[0] = std::max(x, _pointsBoundMax[0]);
+    _pointsBoundMax[1] = std::max(y, _pointsBoundMax[1]);
+    _pointsBoundMax[2] = std::max(z, _pointsBoundMax[2]);
+    _pointsBoundMin[0] = std::min(x, _pointsBoundMin[0]);
+    _pointsBoundMin[1] = std::min(y, _pointsBoundMin[1]);
+    _pointsBoundMin[2] = std::min(z, _pointsBoundMin[2]);
+}
 
-bool PointCloud::loadPLY(const QString& filePath)
+const PointColumn* PointCloud::getColumn(const std::string& name) const
 {
+    for (const PointColumn& column : _columns) {
+        if (column.name == name) {
+            return &column;
+        }
+    }
+    return nullptr;
+}
 
-    // open stream
-    std::fstream is;
-    is.open(filePath.toStdString().c_str(), std::fstream::in);
+std::vector<int> PointCloud::initColumns(const PlyHeader& header)
+{
+    // x, y, z go to _pointsData (or stay mapped), every other property gets its own column
+    std::vector<int> columnOf(header.vertexProperties.size(), -1);
+    for (size_t i = 0; i < header.vertexProperties.size(); ++i) {
+        const PlyProperty& property = header.vertexProperties[i];
+        if (property.name == "x" || property.name == "y" || property.name == "z") {
+            continue;
+        }
+        PointColumn column;
+        column.name = property.name;
+        column.type = property.type;
+        column.data.resize(_pointsCount * plyTypeSize(property.type));
+        columnOf[i] = static_cast<int>(_columns.size());
+        _columns.push_back(std::move(column));
+    }
+    return columnOf;
+}
 
-    // ensure format with magic header
-    std::string line;
-    std::getline(is, line);
-    if (line != "ply") {
-      throw std::runtime_error("not a ply file");
+void PointCloud::setDataView()
+{
+    _view.data = reinterpret_cast<const uchar*>(_pointsData.constData());
+    _view.stride = POINT_STRIDE * sizeof(float);
+    _view.offset = 0;
+    _view.count = _pointsCount;
+}
+
+bool PointCloud::loadCache(std::unique_ptr<CloudCache> cache)
+{
+    size_t pointsSize = 0;
+    const uchar* points = cache->section(CacheSection::Points, &pointsSize);
+    // divided, a corrupt count must not wrap around to the section size
+    if (!points || pointsSize % (POINT_STRIDE * sizeof(float)) != 0
+            || pointsSize / (POINT_STRIDE * sizeof(float)) != cache->getCount()) {
         return false;
     }
 
-    // parse header looking only for 'element vertex' section size
-    _pointsCount = 0;
-    while (is.good()) {
-      std::getline(is, line);
-      if (line == "end_header") {
-        break;
-      } else {
-        std::stringstream ss(line);
-        std::string tag1, tag2, tag3;
-        ss >> tag1 >> tag2 >> tag3;
-        if (tag1 == "element" && tag2 == "vertex") {
-          _pointsCount = std::atof(tag3.c_str());
+    // columns: count, then per column type, name length, byte size, name and data
+    size_t columnsSize = 0;
+    const uchar* columns = cache->section(CacheSection::Columns, &columnsSize);
+    if (columns && columnsSize >= sizeof(uint32_t)) {
+        const uchar* p = columns;
+        const uchar* end = columns + columnsSize;
+        uint32_t count;
+        std::memcpy(&count, p, sizeof(count));
+        p += sizeof(count);
+        for (uint32_t c = 0; c < count; ++c) {
+            uint32_t type, nameLength;
+            uint64_t byteSize;
+            if (end - p < static_cast<ptrdiff_t>(2 * sizeof(uint32_t) + sizeof(uint64_t))) {
+                _columns.clear();
+                return false;
+            }
+            std::memcpy(&type, p, sizeof(type));
+            std::memcpy(&nameLength, p + sizeof(uint32_t), sizeof(nameLength));
+            std::memcpy(&byteSize, p + 2 * sizeof(uint32_t), sizeof(byteSize));
+            p += 2 * sizeof(uint32_t) + sizeof(uint64_t);
+            // one value of a known type per point, all inside the section
+            if (type > static_cast<uint32_t>(PlyType::Float64)
+                    || byteSize != cache->getCount() * plyTypeSize(static_cast<PlyType>(type))
+                    || static_cast<uint64_t>(end - p) < nameLength + byteSize) {
+                _columns.clear();
+                return false;
+            }
+            PointColumn column;
+            column.type = static_cast<PlyType>(type);
+            column.name.assign(reinterpret_cast<const char*>(p), nameLength);
+            p += nameLength;
+            column.data.assign(p, p + byteSize);
+            p += byteSize;
+            _columns.push_back(std::move(column));
         }
-      }
     }
 
-    // read and parse 'element vertex' section
+    size_t facesSize = 0;
+    const uchar* faces = cache->section(CacheSection::Faces, &facesSize);
+    if (faces) {
+        // whole triangles of existing points only
+        _faces.resize(facesSize / sizeof(uint32_t));
+        std::memcpy(_faces.data(), faces, _faces.size() * sizeof(uint32_t));
+        if (facesSize % (FACE_STRIDE * sizeof(uint32_t)) != 0
+                || std::any_of(_faces.begin(), _faces.end(), [&](uint32_t index) { return index >= cache->getCount(); })) {
+            _columns.clear();
+            _faces.clear();
+            return false;
+        }
+    }
+
+    _pointsCount = cache->getCount();
+    _pointsBoundMin = cache->getMin();
+    _pointsBoundMax = cache->getMax();
+    _view.data = points;
+    _view.stride = POINT_STRIDE * sizeof(float);
+    _view.offset = 0;
+    _view.count = _pointsCount;
+    _cache = std::move(cache);
+    return true;
+}
+
+bool PointCloud::writeCache(CloudCacheWriter& writer) const
+{
+    // a cloud of several tiles or a downsampled one has no single source file to key the
+    // cache on, a reordered one is not in the order of its file anymore
+    if (_tiles.size() > 1 || _path.isEmpty() || isReordered()) {
+        return false;
+    }
+
+    // points packed as in _pointsData, mapped ply files may have a wider stride
+    std::vector<float> packed;
+    const void* points = _pointsData.constData();
+    if (_pointsData.isEmpty()) {
+        packed.resize(_pointsCount * POINT_STRIDE);
+        for (size_t i = 0; i < _pointsCount; ++i) {
+            const QVector3D point = getPoint(i);
+            packed[i * POINT_STRIDE + 0] = point.x();
+            packed[i * POINT_STRIDE + 1] = point.y();
+            packed[i * POINT_STRIDE + 2] = point.z();
+        }
+        points = packed.data();
+    }
+    writer.add(CacheSection::Points, points, _pointsCount * POINT_STRIDE * sizeof(float));
+
+    std::vector<uchar> columns(sizeof(uint32_t));
+    const uint32_t count = static_cast<uint32_t>(_columns.size());
+    std::memcpy(columns.data(), &count, sizeof(count));
+    for (const PointColumn& column : _columns) {
+        const uint32_t type = static_cast<uint32_t>(column.type);
+        const uint32_t nameLength = static_cast<uint32_t>(column.name.size());
+        const uint64_t byteSize = column.data.size();
+        const size_t at = columns.size();
+        columns.resize(at + 2 * sizeof(uint32_t) + sizeof(uint64_t));
+        std::memcpy(columns.data() + at, &type, sizeof(type));
+        std::memcpy(columns.data() + at + sizeof(uint32_t), &nameLength, sizeof(nameLength));
+        std::memcpy(columns.data() + at + 2 * sizeof(uint32_t), &byteSize, sizeof(byteSize));
+        columns.insert(columns.end(), column.name.begin(), column.name.end());
+        columns.insert(columns.end(), column.data.begin(), column.data.end());
+    }
+    writer.add(CacheSection::Columns, columns.data(), columns.size());
+    if (!_faces.empty()) {
+        writer.add(CacheSection::Faces, _faces.data(), _faces.size() * sizeof(uint32_t));
+    }
+
+    return writer.write(_path, _cacheKey, _pointsCount, _pointsBoundMin, _pointsBoundMax);
+}
+
+void PointCloud::reorderMorton()
+{
+    QElapsedTimer timer;
+    timer.start();
+    const size_t count = _pointsCount;
+    const unsigned blocks = workerCount();
+
+    // codes of the current rows, sorted
+    const MortonGrid grid(_pointsBoundMin, _pointsBoundMax);
+    std::vector<MortonKey> keys(count);
+    parallelBlocks(count, blocks, [&](size_t begin, size_t end, unsigned) {
+        for (size_t i = begin; i < end; ++i) {
+            keys[i].code = grid.code(getPoint(i));
+            keys[i].row = static_cast<uint32_t>(i);
+        }
+    });
+    sortMorton(keys);
+
+    // gather positions and columns in the new order, from wherever they are now
+    if (isQuantized()) {
+        std::vector<uint16_t> quantized(count * QUANTIZED_STRIDE);
+        parallelBlocks(count, blocks, [&](size_t begin, size_t end, unsigned) {
+            for (size_t i = begin; i < end; ++i) {
+                std::memcpy(&quantized[i * QUANTIZED_STRIDE], &_quantized[keys[i].row * QUANTIZED_STRIDE],
+                            QUANTIZED_STRIDE * sizeof(uint16_t));
+            }
+        });
+        _quantized.swap(quantized);
+    } else {
+        QVector<float> points;
+        resizePointData(points, count);
+        float* data = points.data();
+        parallelBlocks(count, blocks, [&](size_t begin, size_t end, unsigned) {
+            for (size_t i = begin; i < end; ++i) {
+                const QVector3D point = _view.point(keys[i].row);
+                data[i * POINT_STRIDE + 0] = point.x();
+                data[i * POINT_STRIDE + 1] = point.y();
+                data[i * POINT_STRIDE + 2] = point.z();
+            }
+        });
+        unmap();
+        _pointsData = std::move(points);
+        setDataView();
+    }
+    for (PointColumn& column : _columns) {
+        const size_t size = plyTypeSize(column.type);
+        std::vector<uchar> data(column.data.size());
+        parallelBlocks(count, blocks, [&](size_t begin, size_t end, unsigned) {
+            for (size_t i = begin; i < end; ++i) {
+                std::memcpy(&data[i * size], &column.data[keys[i].row * size], size);
+            }
+        });
+        column.data.swap(data);
+    }
+
+    // faces refer to the new rows, ids keep referring to the file
+    if (!_faces.empty()) {
+        std::vector<uint32_t> newRow(count);
+        for (size_t i = 0; i < count; ++i) {
+            newRow[keys[i].row] = static_cast<uint32_t>(i);
+        }
+        parallelBlocks(_faces.size(), blocks, [&](size_t begin, size_t end, unsigned) {
+            for (size_t i = begin; i < end; ++i) {
+                _faces[i] = newRow[_faces[i]];
+            }
+        });
+    }
+    std::vector<uint32_t> originalRows(count);
+    for (size_t i = 0; i < count; ++i) {
+        originalRows[i] = static_cast<uint32_t>(getOriginalRow(keys[i].row));
+    }
+    _originalRows.swap(originalRows);
+
+    std::cout << "reordered " << count << " points in Morton order in " << timer.elapsed() << " ms" << std::endl;
+}
+
+QVector3D PointCloud::quantize()
+{
+    if (isQuantized()) {
+        return _quantizeStep / 2;
+    }
+
+    // 65535 steps across the AABB per axis, a flat axis keeps step 0 and is exact
+    const QVector3D extent = _pointsBoundMax - _pointsBoundMin;
+    _quantizeStep = extent / QUANTIZED_MAX;
+    double scale[3];
+    for (int k = 0; k < 3; ++k) {
+        scale[k] = _quantizeStep[k] > 0 ? 1.0 / _quantizeStep[k] : 0.0;
+    }
+
+    std::vector<uint16_t> quantized(_pointsCount * QUANTIZED_STRIDE);
+    QVector3D maxError;
+    for (size_t i = 0; i < _pointsCount; ++i) {
+        const QVector3D point = _view.point(i);
+        uint16_t* q = quantized.data() + i * QUANTIZED_STRIDE;
+        for (int k = 0; k < 3; ++k) {
+            const double steps = (static_cast<double>(point[k]) - _pointsBoundMin[k]) * scale[k];
+            q[k] = static_cast<uint16_t>(std::min<double>(QUANTIZED_MAX, std::max(0.0, std::round(steps))));
+            const float decoded = _pointsBoundMin[k] + q[k] * _quantizeStep[k];
+            maxError[k] = std::max(maxError[k], std::abs(decoded - point[k]));
+        }
+    }
+
+    // the floats are not needed anymore, neither in memory nor mapped
+    unmap();
+    _pointsData.clear();
+    _pointsData.squeeze();
+    _quantized.swap(quantized);
+
+    std::cout << "quantized " << _pointsCount << " points to 16 bit, max error "
+              << maxError.x() << " " << maxError.y() << " " << maxError.z() << std::endl;
+    return maxError;
+}
+
+bool PointCloud::loadPLY(const QString& filePath, const LoadProgress& progress)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    // open stream, binary mode so the header length is a byte offset
+    std::ifstream is(filePath.toStdString().c_str(), std::ios::in | std::ios::binary);
+    if (!is.is_open()) {
+        throw std::runtime_error("could not open ply file");
+        return false;
+    }
+
+    // the key of the file as it is parsed, a later change must not match the cache written for it
+    const CacheKey key = cacheKeyFor(filePath);
+
+    // parse header, throws on files that are not ply
+    const PlyHeader header = parsePlyHeader(is);
+
+    // drop the previous cloud
+    clear();
+    _path = filePath;
+    _cacheKey = key;
+
+    // an up to date cache replaces the parse
+    std::unique_ptr<CloudCache> cache(new CloudCache());
+    if (cache->open(filePath, key) && loadCache(std::move(cache))) {
+        if (progress && _pointsCount > 0 && !progress(0, _pointsCount)) {
+            clear();
+            std::cout << "ply loading aborted" << std::endl;
+            return false;
+        }
+        _tiles.push_back({ filePath, 0, _pointsCount, _pointsBoundMin, _pointsBoundMax });
+        std::cout << "number of points: " + std::to_string(_pointsCount) << std::endl;
+        std::cout << "ply loaded from cache in " << timer.elapsed() << " ms" << std::endl;
+        return true;
+    }
+
+    _pointsCount = header.vertexCount;
+    const float inf = std::numeric_limits<float>::max();
+    _pointsBoundMin = QVector3D(inf, inf, inf);
+    _pointsBoundMax = QVector3D(-inf, -inf, -inf);
+
     if (_pointsCount > 0) {
-      _pointsData.resize(_pointsCount * POINT_STRIDE);
-
-      std::stringstream ss;
-      std::string line;
-      float *p = _pointsData.data();
-      for (size_t i = 0; is.good() && i < _pointsCount; ++i) {
-        std::getline(is, line);
-        ss.str(line);
-        float x, y, z;
-        ss >> x >> y >> z;
-
-        *p++ = x;
-        *p++ = y;
-        *p++ = z;
-        *p++ = i;
-
-        // updates for AABB
-        _pointsBoundMax[0] = std::max(x, _pointsBoundMax[0]);
-        _pointsBoundMax[1] = std::max(y, _pointsBoundMax[1]);
-        _pointsBoundMax[2] = std::max(z, _pointsBoundMax[2]);
-        _pointsBoundMin[0] = std::min(x, _pointsBoundMin[0]);
-        _pointsBoundMin[1] = std::min(y, _pointsBoundMin[1]);
-        _pointsBoundMin[2] = std::min(z, _pointsBoundMin[2]);
-      }
-
-      // basic validation
-      if (p - _pointsData.data() < _pointsData.size()) {
+        if (header.propertyIndex("x") < 0 || header.propertyIndex("y") < 0 || header.propertyIndex("z") < 0) {
+            throw std::runtime_error("ply file without x, y, z vertex properties");
+            return false;
+        }
+
+        is.close();
+        bool loaded = false;
+        try {
+            loaded = header.format == PlyFormat::Ascii
+                    ? loadASCII(filePath, header, progress)
+                    : loadBinary(filePath, header, progress);
+        } catch (...) {
+            // no half loaded cloud or mapping is left behind
+            clear();
+            throw;
+        }
+        if (!loaded) {
+            clear();
+            std::cout << "ply loading aborted" << std::endl;
+            return false;
+        }
+
+        if (_pointsBoundMin.x() > _pointsBoundMax.x()) {
+            // not a single finite point
+            _pointsBoundMin = QVector3D();
+            _pointsBoundMax = QVector3D();
+        }
+        std::cout << "number of points: " + std::to_string(_pointsCount) << std::endl;
+        if (!_faces.empty()) {
+            std::cout << "number of triangles: " + std::to_string(getFaceCount()) << std::endl;
+        }
+    } else {
+        _pointsBoundMin = QVector3D();
+        _pointsBoundMax = QVector3D();
+    }
+
+    _tiles.push_back({ filePath, 0, _pointsCount, _pointsBoundMin, _pointsBoundMax });
+    std::cout << "ply loaded in " << timer.elapsed() << " ms" << (isMapped() ? " (mapped)" : "") << std::endl;
+    return true;
+}
+
+QStringList PointCloud::tilePaths(const QString& path)
+{
+    if (!QFileInfo(path).isDir()) {
+        return QStringList(path);
+    }
+    const QDir dir(path);
+    QStringList paths;
+    for (const QString& name : dir.entryList(QStringList("*.ply"), QDir::Files, QDir::Name)) {
+        paths.append(dir.filePath(name));
+    }
+    return paths;
+}
+
+bool PointCloud::loadPLYVoxels(const QStringList& paths, int resolution, const LoadProgress& progress)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    QStringList filePaths;
+    for (const QString& path : paths) {
+        filePaths.append(tilePaths(path));
+    }
+    if (filePaths.isEmpty()) {
+        throw std::runtime_error("no ply files to load");
+        return false;
+    }
+    clear();
+    _path.clear();
+
+    // a first pass for the AABB the grid is laid over
+    size_t read = 0;
+    size_t finite = 0;
+    QVector3D low, high;
+    for (const QString& filePath : filePaths) {
+        const PlyStatistics statistics = plyStatistics(filePath);
+        read += statistics.count;
+        if (statistics.finite == 0) {
+            continue;
+        }
+        for (int k = 0; k < 3; ++k) {
+            low[k] = finite == 0 ? statistics.min[k] : std::min(low[k], statistics.min[k]);
+            high[k] = finite == 0 ? statistics.max[k] : std::max(high[k], statistics.max[k]);
+        }
+        finite += statistics.finite;
+        if (progress && !progress(0, 0)) {
+            std::cout << "ply loading aborted" << std::endl;
+            return false;
+        }
+    }
+
+    // then the points of every occupied cell are summed up, chunk by chunk
+    const uint64_t cells = static_cast<uint64_t>(std::min(std::max(resolution, 1), 1 << 21));
+    const QVector3D extent = high - low;
+    const float side = std::max(extent.x(), std::max(extent.y(), extent.z()));
+    const double scale = side > 0 ? cells / static_cast<double>(side) : 0;
+    struct VoxelSum
+    {
+        double x, y, z;
+        size_t count;
+    };
+    std::unordered_map<uint64_t, uint32_t> voxelOf;
+    std::vector<VoxelSum> sums;
+    for (const QString& filePath : filePaths) {
+        PlyStreamReader reader(filePath);
+        PointChunk chunk;
+        while (finite > 0 && reader.next(chunk)) {
+            const float* p = chunk.points.data();
+            for (size_t i = 0; i < chunk.count; ++i, p += 3) {
+                if (!std::isfinite(p[0]) || !std::isfinite(p[1]) || !std::isfinite(p[2])) {
+                    continue;
+                }
+                uint64_t key = 0;
+                for (int k = 0; k < 3; ++k) {
+                    const double cell = std::floor((p[k] - low[k]) * scale);
+                    key |= std::min(static_cast<uint64_t>(std::max(cell, 0.0)), cells - 1) << (21 * k);
+                }
+                // find first, emplace would allocate a node for every point
+                auto voxel = voxelOf.find(key);
+                if (voxel == voxelOf.end()) {
+                    voxel = voxelOf.emplace(key, static_cast<uint32_t>(sums.size())).first;
+                    sums.push_back({ 0, 0, 0, 0 });
+                }
+                VoxelSum& sum = sums[voxel->second];
+                sum.x += p[0];
+                sum.y += p[1];
+                sum.z += p[2];
+                ++sum.count;
+            }
+            // no row is final before the last chunk, the callback may only abort
+            if (progress && !progress(0, 0)) {
+                std::cout << "ply loading aborted" << std::endl;
+                return false;
+            }
+        }
+    }
+    std::unordered_map<uint64_t, uint32_t>().swap(voxelOf);
+
+    _pointsCount = sums.size();
+    const float inf = std::numeric_limits<float>::max();
+    _pointsBoundMin = QVector3D(inf, inf, inf);
+    _pointsBoundMax = QVector3D(-inf, -inf, -inf);
+    resizePointData(_pointsData, _pointsCount);
+    float* p = _pointsData.data();
+    for (const VoxelSum& sum : sums) {
+        const double n = static_cast<double>(sum.count);
+        *p++ = static_cast<float>(sum.x / n);
+        *p++ = static_cast<float>(sum.y / n);
+        *p++ = static_cast<float>(sum.z / n);
+        updateBounds(p[-3], p[-2], p[-1]);
+    }
+    setDataView();
+    if (_pointsCount == 0) {
+        _pointsBoundMin = QVector3D();
+        _pointsBoundMax = QVector3D();
+    }
+    _tiles.push_back({ filePaths.front(), 0, _pointsCount, _pointsBoundMin, _pointsBoundMax });
+
+    if (progress && _pointsCount > 0 && !progress(0, _pointsCount)) {
+        clear();
+        std::cout << "ply loading aborted" << std::endl;
+        return false;
+    }
+    std::cout << "number of points: " << read << " downsampled to " << _pointsCount << " in "
+              << timer.elapsed() << " ms" << std::endl;
+    return true;
+}
+
+bool PointCloud::loadPLYs(const QStringList& paths, const LoadProgress& progress)
+{
+    QStringList filePaths;
+    for (const QString& path : paths) {
+        filePaths.append(tilePaths(path));
+    }
+    if (filePaths.isEmpty()) {
+        throw std::runtime_error("no ply files to load");
+        return false;
+    }
+    // a single file keeps its cache and the mapped zero copy view
+    if (filePaths.size() == 1) {
+        return loadPLY(filePaths.front(), progress);
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    clear();
+    _path.clear();
+
+    // headers first, for the rows of every tile and the columns all tiles share
+    const size_t tileCount = static_cast<size_t>(filePaths.size());
+    std::vector<PlyHeader> headers(tileCount);
+    size_t first = 0;
+    for (size_t t = 0; t < tileCount; ++t) {
+        std::ifstream is(filePaths[static_cast<int>(t)].toStdString().c_str(), std::ios::in | std::ios::binary);
+        if (!is.is_open()) {
+            throw std::runtime_error("could not open ply file");
+            return false;
+        }
+        headers[t] = parsePlyHeader(is);
+        PointTile tile;
+        tile.path = filePaths[static_cast<int>(t)];
+        tile.first = first;
+        tile.count = headers[t].vertexCount;
+        _tiles.push_back(tile);
+        first += tile.count;
+    }
+    _pointsCount = first;
+
+    for (const PlyProperty& property : headers.front().vertexProperties) {
+        if (property.name == "x" || property.name == "y" || property.name == "z") {
+            continue;
+        }
+        bool shared = true;
+        for (const PlyHeader& header : headers) {
+            const int index = header.propertyIndex(property.name);
+            shared = shared && index >= 0 && header.vertexProperties[index].type == property.type;
+        }
+        if (!shared) {
+            std::cout << "property " << property.name << " is not in every tile, dropped" << std::endl;
+            continue;
+        }
+        PointColumn column;
+        column.name = property.name;
+        column.type = property.type;
+        column.data.resize(_pointsCount * plyTypeSize(property.type));
+        _columns.push_back(std::move(column));
+    }
+
+    resizePointData(_pointsData, _pointsCount);
+    setDataView();
+    float* data = _pointsData.data();
+
+    // tiles are loaded concurrently, each is copied to its rows and dropped right away.
+    // rows are reported in tile order, whoever completes the next tile in line reports it
+    // and every completed tile after it
+    std::mutex mutex;
+    std::vector<char> tileDone(tileCount, 0);
+    size_t reported = 0;
+    std::atomic<bool> aborted(false);
+    std::exception_ptr error;
+    std::vector<std::vector<uint32_t> > tileFaces(tileCount);
+    parallelFor(tileCount, [&](size_t t) {
+        if (aborted) {
+            return;
+        }
+        PointTile& target = _tiles[t];
+        try {
+            // every slab of the tile asks whether the load goes on
+            PointCloud tile;
+            const bool loaded = tile.loadPLY(target.path, [&](size_t, size_t) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!aborted && progress && !progress(0, 0)) {
+                    aborted = true;
+                }
+                return !aborted;
+            });
+            if (!loaded) {
+                aborted = true;
+                return;
+            }
+            if (tile.getCount() != target.count) {
+                throw std::runtime_error("ply file changed while loading");
+            }
+            float* point = data + target.first * POINT_STRIDE;
+            for (size_t i = 0; i < target.count; ++i) {
+                const QVector3D p = tile.getPoint(i);
+                *point++ = p.x();
+                *point++ = p.y();
+                *point++ = p.z();
+            }
+            for (PointColumn& column : _columns) {
+                const PointColumn* source = tile.getColumn(column.name);
+                std::memcpy(column.data.data() + target.first * plyTypeSize(column.type), source->data.data(), source->data.size());
+            }
+            // face indices move along with the rows of their tile
+            tileFaces[t] = tile.getFaces();
+            for (uint32_t& index : tileFaces[t]) {
+                index += static_cast<uint32_t>(target.first);
+            }
+            target.min = tile.getMin();
+            target.max = tile.getMax();
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!error) {
+                error = std::current_exception();
+            }
+            aborted = true;
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        tileDone[t] = 1;
+        while (reported < tileCount && tileDone[reported] && !aborted) {
+            const PointTile& ready = _tiles[reported++];
+            if (progress && ready.count > 0 && !progress(ready.first, ready.count)) {
+                aborted = true;
+            }
+        }
+    });
+
+    if (error) {
+        clear();
+        std::rethrow_exception(error);
+    }
+    if (aborted) {
+        clear();
+        std::cout << "ply loading aborted" << std::endl;
+        return false;
+    }
+
+    for (std::vector<uint32_t>& faces : tileFaces) {
+        _faces.insert(_faces.end(), faces.begin(), faces.end());
+        std::vector<uint32_t>().swap(faces);
+    }
+
+    // global AABB from the tiles, empty tiles have none
+    const float inf = std::numeric_limits<float>::max();
+    _pointsBoundMin = QVector3D(inf, inf, inf);
+    _pointsBoundMax = QVector3D(-inf, -inf, -inf);
+    for (const PointTile& tile : _tiles) {
+        if (tile.count > 0) {
+            updateBounds(tile.min.x(), tile.min.y(), tile.min.z());
+            updateBounds(tile.max.x(), tile.max.y(), tile.max.z());
+        }
+    }
+    if (_pointsCount == 0 || _pointsBoundMin.x() > _pointsBoundMax.x()) {
+        _pointsBoundMin = QVector3D();
+        _pointsBoundMax = QVector3D();
+    }
+
+    std::cout << "number of points: " + std::to_string(_pointsCount) << std::endl;
+    std::cout << tileCount << " ply tiles loaded in " << timer.elapsed() << " ms" << std::endl;
+    return true;
+}
+
+uchar* PointCloud::mapFile(const QString& filePath)
+{
+    _file.reset(new QFile(filePath));
+    if (!_file->open(QIODevice::ReadOnly)) {
+        _file.reset();
+        throw std::runtime_error("could not open ply file");
+    }
+    uchar* mapped = _file->map(0, _file->size());
+    if (!mapped) {
+        _file.reset();
+        throw std::runtime_error("could not map ply file");
+    }
+    return mapped;
+}
+
+// moves p past the lines of the elements between the vertices and the faces, a line holds one
+// record and has to hold all of its values. false if the file ends before
+static bool skipElementsASCII(const char*& p, const char* end, const PlyHeader& header)
+{
+    for (const PlyElement& element : header.skippedElements) {
+        for (size_t record = 0; record < element.count; ++record) {
+            if (p >= end) {
+                return false;
+            }
+            const char* lineEnd = static_cast<const char*>(std::memchr(p, '\n', end - p));
+            if (!lineEnd) {
+                lineEnd = end;
+            }
+            for (const PlyProperty& property : element.properties) {
+                double value;
+                p = plyParseValue(p, lineEnd, PlyType::Float64, reinterpret_cast<uchar*>(&value));
+                if (!p || (property.list && value < 0)) {
+                    return false;
+                }
+                const size_t count = property.list ? static_cast<size_t>(value) : 0;
+                for (size_t k = 0; k < count; ++k) {
+                    p = plyParseValue(p, lineEnd, PlyType::Float64, reinterpret_cast<uchar*>(&value));
+                    if (!p) {
+                        return false;
+                    }
+                }
+            }
+            p = lineEnd + 1;
+        }
+    }
+    return true;
+}
+
+// moves p past the records of the elements between the vertices and the faces, lists by the
+// count in front of them. false if the file ends before
+static bool skipElementsBinary(const uchar*& p, const uchar* end, const PlyHeader& header, bool swap)
+{
+    for (const PlyElement& element : header.skippedElements) {
+        for (size_t record = 0; record < element.count; ++record) {
+            for (const PlyProperty& property : element.properties) {
+                size_t count = 1;
+                if (property.list) {
+                    const size_t countSize = plyTypeSize(property.countType);
+                    if (static_cast<size_t>(end - p) < countSize) {
+                        return false;
+                    }
+                    const double value = plyReadValue(p, property.countType, swap);
+                    if (value < 0) {
+                        return false;
+                    }
+                    count = static_cast<size_t>(value);
+                    p += countSize;
+                }
+                if (static_cast<size_t>(end - p) / plyTypeSize(property.type) < count) {
+                    return false;
+                }
+                p += count * plyTypeSize(property.type);
+            }
+        }
+    }
+    return true;
+}
+
+bool PointCloud::loadASCII(const QString& filePath, const PlyHeader& header, const LoadProgress& progress)
+{
+    // read and parse 'element vertex' section straight from the mapped file
+    uchar* mapped = mapFile(filePath);
+    const char* body = reinterpret_cast<const char*>(mapped) + header.dataOffset;
+    const size_t bodySize = static_cast<size_t>(_file->size()) - header.dataOffset;
+
+    // slot of every property inside the point, x, y, z or the index into _columns
+    const std::vector<int> columnOf = initColumns(header);
+    const int valuesPerLine = static_cast<int>(header.vertexProperties.size());
+    std::vector<int> xyzOf(valuesPerLine, -1);
+    xyzOf[header.propertyIndex("x")] = 0;
+    xyzOf[header.propertyIndex("y")] = 1;
+    xyzOf[header.propertyIndex("z")] = 2;
+
+    // the view is valid from the start, reported rows can be read while the rest is parsed
+    resizePointData(_pointsData, _pointsCount);
+    setDataView();
+    float* data = _pointsData.data();
+
+    // the body is split into pieces, a wave of one piece per thread is parsed at a time,
+    // small files are not worth the threads, keep at least 1 MB per piece
+    const size_t pieces = std::max<size_t>((bodySize + ASCII_PIECE_SIZE - 1) / ASCII_PIECE_SIZE,
+                                           std::max<size_t>(1, std::min<size_t>(workerCount(), bodySize >> 20)));
+    const unsigned blocks = static_cast<unsigned>(std::min<size_t>(workerCount(), pieces));
+    auto pieceBegin = [&](size_t piece) { return bodySize / pieces * piece + std::min(piece, bodySize % pieces); };
+
+    // pass 1: newlines per piece, so every piece knows the row index of its first line
+    std::vector<size_t> newlines(pieces, 0);
+    parallelBlocks(pieces, blocks, [&](size_t first, size_t last, unsigned) {
+        for (size_t piece = first; piece < last; ++piece) {
+            newlines[piece] = std::count(body + pieceBegin(piece), body + pieceBegin(piece + 1), '\n');
+        }
+    });
+    std::vector<size_t> newlinesBefore(pieces + 1, 0);
+    for (size_t piece = 0; piece < pieces; ++piece) {
+        newlinesBefore[piece + 1] = newlinesBefore[piece] + newlines[piece];
+    }
+
+    // every line belongs to the piece its first character lies in, so the first line
+    // of a piece has the row index of the number of lines starting before the piece
+    auto linesBefore = [&](size_t piece) -> size_t {
+        const size_t begin = pieceBegin(piece);
+        if (begin == 0) {
+            return 0;
+        }
+        return newlinesBefore[piece] + (body[begin - 1] == '\n' ? 0 : 1);
+    };
+    const size_t linesInFile = linesBefore(pieces);
+
+    // pass 2: parse the vertex lines of every piece, with one AABB per piece
+    std::vector<QVector3D> pieceMin(pieces, _pointsBoundMin);
+    std::vector<QVector3D> pieceMax(pieces, _pointsBoundMax);
+    std::vector<char> pieceBroken(pieces, 0);
+    auto parsePiece = [&](size_t piece) {
+        const size_t end = pieceBegin(piece + 1);
+        size_t pos = pieceBegin(piece);
+        size_t row = linesBefore(piece);
+        if (pos > 0 && body[pos - 1] != '\n') {
+            const char* newline = static_cast<const char*>(std::memchr(body + pos, '\n', bodySize - pos));
+            if (!newline) {
+                return;
+            }
+            pos = static_cast<size_t>(newline - body) + 1;
+        }
+
+        QVector3D& min = pieceMin[piece];
+        QVector3D& max = pieceMax[piece];
+        while (pos < end && row < _pointsCount) {
+            const char* lineEnd = static_cast<const char*>(std::memchr(body + pos, '\n', bodySize - pos));
+            if (!lineEnd) {
+                lineEnd = body + bodySize;
+            }
+
+            // one pass over the line, every value goes straight to its column
+            float* point = data + row * POINT_STRIDE;
+            const char* p = body + pos;
+            for (int v = 0; v < valuesPerLine && p; ++v) {
+                if (xyzOf[v] >= 0) {
+                    p = plyParseFloat(p, lineEnd, point[xyzOf[v]]);
+                } else {
+                    PointColumn& column = _columns[columnOf[v]];
+                    p = plyParseValue(p, lineEnd, column.type, column.data.data() + row * plyTypeSize(column.type));
+                }
+            }
+            if (!p) {
+                pieceBroken[piece] = 1;
+                return;
+            }
+
+            // updates for AABB, of finite points only as in updateBounds
+            if (std::isfinite(point[0]) && std::isfinite(point[1]) && std::isfinite(point[2])) {
+                for (int k = 0; k < 3; ++k) {
+                    min[k] = std::min(point[k], min[k]);
+                    max[k] = std::max(point[k], max[k]);
+                }
+            }
+
+            pos = static_cast<size_t>(lineEnd - body) + 1;
+            ++row;
+        }
+    };
+
+    bool broken = linesInFile < _pointsCount;
+    bool aborted = false;
+    size_t reported = 0;
+    for (size_t wave = 0; wave < pieces && !broken && !aborted; wave += blocks) {
+        const size_t waveEnd = std::min(pieces, wave + blocks);
+        parallelBlocks(waveEnd - wave, blocks, [&](size_t first, size_t last, unsigned) {
+            for (size_t piece = wave + first; piece < wave + last; ++piece) {
+                parsePiece(piece);
+            }
+        });
+        broken = std::count(pieceBroken.begin() + wave, pieceBroken.begin() + waveEnd, 1) > 0;
+
+        // all lines starting before the next wave are done
+        const size_t done = std::min(_pointsCount, linesBefore(waveEnd));
+        if (!broken && progress && done > reported) {
+            aborted = !progress(reported, done - reported);
+            reported = done;
+        }
+    }
+
+    // faces start behind the newline of the last vertex line and the lines of the elements in between
+    if (!broken && !aborted && header.faceCount > 0) {
+        const size_t piece = std::upper_bound(newlinesBefore.begin(), newlinesBefore.end(), _pointsCount - 1)
+                - newlinesBefore.begin() - 1;
+        if (newlinesBefore[pieces] < _pointsCount) {
+            broken = true;
+        } else {
+            const char* p = body + pieceBegin(piece);
+            for (size_t line = newlinesBefore[piece]; line < _pointsCount; ++line) {
+                p = static_cast<const char*>(std::memchr(p, '\n', body + bodySize - p)) + 1;
+            }
+            broken = !skipElementsASCII(p, body + bodySize, header) || !loadFacesASCII(p, body + bodySize, header);
+        }
+    }
+
+    _file->unmap(mapped);
+    _file.reset();
+
+    // basic validation
+    if (broken) {
+      throw std::runtime_error("broken ply file");
+    }
+    if (aborted) {
+        return false;
+    }
+
+    for (size_t piece = 0; piece < pieces; ++piece) {
+        updateBounds(pieceMin[piece].x(), pieceMin[piece].y(), pieceMin[piece].z());
+        updateBounds(pieceMax[piece].x(), pieceMax[piece].y(), pieceMax[piece].z());
+    }
+    return true;
+}
+
+bool PointCloud::loadBinary(const QString& filePath, const PlyHeader& header, const LoadProgress& progress)
+{
+    uchar* mapped = mapFile(filePath);
+
+    // basic validation
+    const qint64 required = static_cast<qint64>(header.dataOffset + _pointsCount * header.vertexStride);
+    if (_file->size() < required) {
+        _file->unmap(mapped);
+        _file.reset();
+        throw std::runtime_error("broken ply file");
+    }
+    const uchar* vertices = mapped + header.dataOffset;
+
+    const PlyProperty& px = header.vertexProperties[header.propertyIndex("x")];
+    const PlyProperty& py = header.vertexProperties[header.propertyIndex("y")];
+    const PlyProperty& pz = header.vertexProperties[header.propertyIndex("z")];
+
+    const bool fileLittleEndian = header.format == PlyFormat::BinaryLittleEndian;
+    const bool hostLittleEndian = Q_BYTE_ORDER == Q_LITTLE_ENDIAN;
+    const bool swap = fileLittleEndian != hostLittleEndian;
+
+    // copies a single property value of a record into its column, in host byte order
+    const std::vector<int> columnOf = initColumns(header);
+    auto copyColumns = [&](const uchar* record, size_t row) {
+        for (size_t v = 0; v < columnOf.size(); ++v) {
+            if (columnOf[v] < 0) {
+                continue;
+            }
+            PointColumn& column = _columns[columnOf[v]];
+            const size_t size = plyTypeSize(column.type);
+            uchar* dst = column.data.data() + row * size;
+            std::memcpy(dst, record + header.vertexProperties[v].offset, size);
+            if (swap) {
+                std::reverse(dst, dst + size);
+            }
+        }
+    };
+
+    // x, y, z as consecutive native floats can be used in place, no parse and no copy
+    const bool zeroCopy = !swap
+            && px.type == PlyType::Float32 && py.type == PlyType::Float32 && pz.type == PlyType::Float32
+            && py.offset == px.offset + sizeof(float) && pz.offset == px.offset + 2 * sizeof(float);
+
+    if (zeroCopy) {
+        _mapped = mapped;
+        _view.data = vertices;
+        _view.stride = header.vertexStride;
+        _view.offset = px.offset;
+        _view.count = _pointsCount;
+    } else {
+        // otherwise decode x, y, z into _pointsData
+        resizePointData(_pointsData, _pointsCount);
+        setDataView();
+    }
+
+    // one pass for the AABB, the remaining columns and the decode, a slab at a time
+    float *p = _pointsData.data();
+    const uchar* record = vertices;
+    bool aborted = false;
+    for (size_t first = 0; first < _pointsCount && !aborted; first += BINARY_SLAB_ROWS) {
+        const size_t last = std::min(_pointsCount, first + BINARY_SLAB_ROWS);
+        for (size_t i = first; i < last; ++i, record += header.vertexStride) {
+            if (zeroCopy) {
+                const QVector3D point = _view.point(i);
+                updateBounds(point.x(), point.y(), point.z());
+            } else {
+                const float x = static_cast<float>(plyReadValue(record + px.offset, px.type, swap));
+                const float y = static_cast<float>(plyReadValue(record + py.offset, py.type, swap));
+                const float z = static_cast<float>(plyReadValue(record + pz.offset, pz.type, swap));
+
+                *p++ = x;
+                *p++ = y;
+                *p++ = z;
+
+                updateBounds(x, y, z);
+            }
+            copyColumns(record, i);
+        }
+        aborted = progress && !progress(first, last - first);
+    }
+
+    // faces follow the last vertex record and the records of the elements in between
+    bool broken = false;
+    if (!aborted && header.faceCount > 0) {
+        const uchar* faces = vertices + _pointsCount * header.vertexStride;
+        broken = !skipElementsBinary(faces, mapped + _file->size(), header, swap)
+                || !loadFacesBinary(faces, mapped + _file->size(), header, swap);
+    }
+
+    if (!zeroCopy) {
+        _file->unmap(mapped);
+        _file.reset();
+    }
+    if (broken) {
+        // a zero-copy view must not outlive the failed load
+        clear();
         throw std::runtime_error("broken ply file");
-          return false;
-      }
+    }
+    return !aborted;
+}
+
+void PointCloud::addPolygon(const std::vector<uint32_t>& polygon)
+{
+    // a fan around the first vertex, exact for the convex polygons of common meshes
+    for (size_t k = 2; k < polygon.size(); ++k) {
+        _faces.push_back(polygon[0]);
+        _faces.push_back(polygon[k - 1]);
+        _faces.push_back(polygon[k]);
+    }
+}
 
-      std::cout << "number of points: " + std::to_string(_pointsCount) << std::endl;
+bool PointCloud::loadFacesASCII(const char* p, const char* end, const PlyHeader& header)
+{
+    _faces.reserve(header.faceCount * FACE_STRIDE);
+    std::vector<uint32_t> polygon;
+    for (size_t face = 0; face < header.faceCount; ++face) {
+        if (p >= end) {
+            return false;
+        }
+        const char* lineEnd = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        if (!lineEnd) {
+            lineEnd = end;
+        }
 
+        // every property of the face in order, only the vertex indices are kept
+        for (size_t v = 0; v < header.faceProperties.size(); ++v) {
+            const PlyProperty& property = header.faceProperties[v];
+            double value;
+            p = plyParseValue(p, lineEnd, PlyType::Float64, reinterpret_cast<uchar*>(&value));
+            if (!p) {
+                return false;
+            }
+            if (!property.list) {
+                continue;
+            }
+            if (value < 0) {
+                return false;
+            }
+            const size_t count = static_cast<size_t>(value);
+            const bool indices = static_cast<int>(v) == header.faceIndices;
+            polygon.clear();
+            for (size_t k = 0; k < count; ++k) {
+                p = plyParseValue(p, lineEnd, PlyType::Float64, reinterpret_cast<uchar*>(&value));
+                if (!p) {
+                    return false;
+                }
+                if (indices) {
+                    if (value < 0 || value >= _pointsCount) {
+                        return false;
+                    }
+                    polygon.push_back(static_cast<uint32_t>(value));
+                }
+            }
+            if (indices) {
+                addPolygon(polygon);
+            }
+        }
+        p = lineEnd + 1;
+    }
+    return true;
+}
+
+bool PointCloud::loadFacesBinary(const uchar* p, const uchar* end, const PlyHeader& header, bool swap)
+{
+    _faces.reserve(header.faceCount * FACE_STRIDE);
+    std::vector<uint32_t> polygon;
+    for (size_t face = 0; face < header.faceCount; ++face) {
+        // records have no fixed size, every list is preceded by its length
+        for (size_t v = 0; v < header.faceProperties.size(); ++v) {
+            const PlyProperty& property = header.faceProperties[v];
+            size_t count = 1;
+            if (property.list) {
+                const size_t countSize = plyTypeSize(property.countType);
+                if (static_cast<size_t>(end - p) < countSize) {
+                    return false;
+                }
+                const double value = plyReadValue(p, property.countType, swap);
+                if (value < 0) {
+                    return false;
+                }
+                count = static_cast<size_t>(value);
+                p += countSize;
+            }
+            const size_t size = plyTypeSize(property.type);
+            if (static_cast<size_t>(end - p) < count * size) {
+                return false;
+            }
+            if (static_cast<int>(v) == header.faceIndices) {
+                polygon.clear();
+                for (size_t k = 0; k < count; ++k) {
+                    const double index = plyReadValue(p + k * size, property.type, swap);
+                    if (index < 0 || index >= _pointsCount) {
+                        return false;
+                    }
+                    polygon.push_back(static_cast<uint32_t>(index));
+                }
+                addPolygon(polygon);
+            }
+            p += count * size;
+        }
     }
     return true;
 }
@@ -2,11 +2,70 @@
 #define POINTCLOUD_H
 
 #include <QString>
+#include <QStringList>
 #include <QVector>
 #include <QVector3D>
+#include <QFile>
 
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
 
-static const size_t POINT_STRIDE = 4; // x, y, z, index
+#include "plyheader.h"
+#include "cloudcache.h"
+
+
+static const size_t POINT_STRIDE = 3; // x, y, z
+static const size_t QUANTIZED_STRIDE = 3; // x, y, z as uint16 relative to the AABB
+static const float QUANTIZED_MAX = 65535.0f;
+static const size_t FACE_STRIDE = 3; // vertex indices of a triangle
+
+// one contiguous typed array for an additional ply vertex property (normals, colors, intensity, ...)
+struct PointColumn
+{
+    std::string name;
+    PlyType type;
+    std::vector<uchar> data; // getCount() values in host byte order
+
+    template <typename T>
+    const T* values() const { return reinterpret_cast<const T*>(data.data()); }
+    double value(size_t i) const { return plyReadValue(data.data() + i * plyTypeSize(type), type, false); }
+};
+
+// strided, non-owning view on the x, y, z floats of all points
+struct PointView
+{
+    const uchar* data = nullptr; // start of the first point record
+    size_t stride = 0;           // bytes between two point records
+    size_t offset = 0;           // byte offset of x inside a record, y and z follow
+    size_t count = 0;
+
+    QVector3D point(size_t i) const
+    {
+        // memcpy, records inside a mapped file are not necessarily float aligned
+        float p[3];
+        std::memcpy(p, data + i * stride + offset, sizeof(p));
+        return QVector3D(p[0], p[1], p[2]);
+    }
+};
+
+// one ply file of a cloud, its points are the rows [first, first + count) in file order
+struct PointTile
+{
+    QString path;
+    size_t first = 0;
+    size_t count = 0;
+    QVector3D min;
+    QVector3D max;
+};
+
+// called by PointCloud::loadPLY with rows [first, first + count) once they are final,
+// in order and from one thread at a time, returns false to abort the load. A count of 0
+// only asks whether to go on, while rows are parsed that are not final yet
+typedef std::function<bool(size_t first, size_t count)> LoadProgress;
 
 class PointCloud
 {
@@ -14,22 +73,122 @@ public:
     PointCloud();
     ~PointCloud();
 
-    bool loadPLY(const QString&);
+    // clouds own mapped files, they can be moved, e.g. out of a loader thread, but not copied
+    PointCloud(const PointCloud&) = delete;
+    PointCloud& operator=(const PointCloud&) = delete;
+    PointCloud& operator=(PointCloud&& other);
+
+    // false if the load was aborted by the progress callback, the cloud is empty then
+    bool loadPLY(const QString&, const LoadProgress& progress = LoadProgress());
+    // several files or directories of tiles as one cloud, loaded concurrently. the rows of
+    // a tile follow the rows of the tiles before it, so ids stay the same between loads
+    bool loadPLYs(const QStringList& paths, const LoadProgress& progress = LoadProgress());
+    // the same files streamed through PlyStreamReader and thinned to the mean of the points
+    // in every occupied cell of a grid with resolution cells along the longest side of the
+    // AABB. memory grows with the occupied cells, not with the files, so clouds larger than
+    // the RAM can be opened. rows are in grid order, the cloud has no columns, faces or cache
+    bool loadPLYVoxels(const QStringList& paths, int resolution, const LoadProgress& progress = LoadProgress());
+    // the ply files of a directory sorted by name, or the path itself if it is a file
+    static QStringList tilePaths(const QString& path);
+
+    // adds points and columns to the writer and writes the sidecar cache of the loaded file
+    bool writeCache(CloudCacheWriter& writer) const;
+
+    // sorts the points along a Z curve through the AABB, so points that are close in space
+    // are mostly close in memory. columns and faces move along, getOriginalRow() maps a row
+    // back to the file order. a mapped file or cache is released
+    void reorderMorton();
+
+    // replaces the float positions by 3 x uint16 relative to the AABB, 6 instead of 12 bytes
+    // per point, the floats and a mapped file are released. returns the largest error per axis
+    QVector3D quantize();
 
 private:
+    uchar* mapFile(const QString& filePath);
+    bool loadASCII(const QString& filePath, const PlyHeader& header, const LoadProgress& progress);
+    bool loadBinary(const QString& filePath, const PlyHeader& header, const LoadProgress& progress);
+    bool loadFacesASCII(const char* p, const char* end, const PlyHeader& header);
+    bool loadFacesBinary(const uchar* p, const uchar* end, const PlyHeader& header, bool swap);
+    void addPolygon(const std::vector<uint32_t>& polygon);
+    std::vector<int> initColumns(const PlyHeader& header);
+    void setDataView();
+    void updateBounds(float x, float y, float z);
+    void unmap();
+    void clear();
+    bool loadCache(std::unique_ptr<CloudCache> cache);
 
     size_t _pointsCount=0;
     QVector3D _pointsBoundMin;
     QVector3D _pointsBoundMax;
 
+    // memory mapped file for zero copy access of binary vertex blocks
+    std::unique_ptr<QFile> _file;
+    uchar* _mapped = nullptr;
+    PointView _view;
+
+    std::vector<PointColumn> _columns;
+    std::vector<PointTile> _tiles;
+
+    // triangles, FACE_STRIDE vertex indices each
+    std::vector<uint32_t> _faces;
+
+    // file row of every row, empty while the rows are in file order
+    std::vector<uint32_t> _originalRows;
+
+    // quantized positions, empty unless quantize() was called
+    std::vector<uint16_t> _quantized;
+    QVector3D _quantizeStep;
+
+    QString _path;
+    // key of the file at _path before it was parsed, the cache is written for it
+    CacheKey _cacheKey;
+    std::unique_ptr<CloudCache> _cache;
+
 public:
     size_t getCount() const { return _pointsCount; }
     QVector3D getMin() const { return _pointsBoundMin; }
     QVector3D getMax() const { return _pointsBoundMax; }
 
+    // true if the points are read directly from the mapped ply or cache file and _pointsData is empty
+    bool isMapped() const { return _mapped != nullptr || _cache != nullptr; }
+    const PointView& getView() const { return _view; }
+    QVector3D getPoint(size_t i) const { return _quantized.empty() ? _view.point(i) : dequantize(i); }
+
+    // quantized clouds have an empty view, positions are QUANTIZED_STRIDE uint16 per point,
+    // a position is getMin() + q * getQuantizeStep() and off by at most half a step
+    bool isQuantized() const { return !_quantized.empty(); }
+    const std::vector<uint16_t>& getQuantized() const { return _quantized; }
+    QVector3D getQuantizeStep() const { return _quantizeStep; }
+    QVector3D dequantize(size_t i) const
+    {
+        const uint16_t* q = _quantized.data() + i * QUANTIZED_STRIDE;
+        return _pointsBoundMin + QVector3D(q[0], q[1], q[2]) * _quantizeStep;
+    }
+
+    // all vertex properties besides x, y, z, one column each
+    const std::vector<PointColumn>& getColumns() const { return _columns; }
+    const PointColumn* getColumn(const std::string& name) const;
+
+    // triangles of a mesh as FACE_STRIDE vertex indices each, polygons are split into fans
+    // around their first vertex. empty for plain point clouds
+    const std::vector<uint32_t>& getFaces() const { return _faces; }
+    size_t getFaceCount() const { return _faces.size() / FACE_STRIDE; }
+
+    // ids for anything shown or exported refer to the file order
+    bool isReordered() const { return !_originalRows.empty(); }
+    const std::vector<uint32_t>& getOriginalRows() const { return _originalRows; }
+    size_t getOriginalRow(size_t i) const { return _originalRows.empty() ? i : _originalRows[i]; }
+
+    // the files the cloud was loaded from with their rows and AABBs, one for a single file
+    const std::vector<PointTile>& getTiles() const { return _tiles; }
+
     QVector<float> _pointsData;
     const QVector<float>& getData() const { return _pointsData; }
 
+    const QString& getPath() const { return _path; }
+    // the cache the cloud was loaded from, nullptr after a parse
+    const CloudCache* getCache() const { return _cache.get(); }
+
 };
 
 #endif // POINTCLOUD_H
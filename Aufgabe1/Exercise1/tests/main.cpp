@@ -0,0 +1,65 @@
+//
+// Checks of the loaders and spatial indexes, run as: tests [name]
+//
+
+#include <cstdio>
+#include <cstring>
+
+#include "bench.h"
+#include "parallel.h"
+#include "tests.h"
+
+struct Test
+{
+    const char* name;
+    bool (*run)();
+};
+
+static const Test tests[] = {
+    { "octtree_repaint_memory", testOcttreeRepaintMemory },
+    { "octtree_parallel_build", testOcttreeParallelBuild },
+    { "octtree_queries", testOcttreeQueries },
+    { "octtree_limits", testOcttreeLimits },
+    { "octtree_insert_remove", testOcttreeInsertRemove },
+    { "octtree_serialize", testOcttreeSerialize },
+    { "octtree_lod", testOcttreeLod },
+    { "octtree_frustum", testOcttreeFrustum },
+    { "octtree_wireframe", testOcttreeWireframe },
+    { "octtree_non_finite", testOcttreeNonFinite },
+    { "tree_knn", testTreeKnn },
+    { "tree_non_finite", testTreeNonFinite },
+    { "tree_range_queries", testTreeRangeQueries },
+    { "forest_knn", testForestKnn },
+    { "morton_codes", testMortonCodes },
+    { "point_blocks_kernels", testPointBlocksKernels },
+    { "ply_ascii", testPlyAscii },
+    { "ply_faces", testPlyFaces },
+    { "cache_round_trip", testCacheRoundTrip },
+};
+
+int main(int argc, char* argv[])
+{
+    int failed = 0;
+    int ran = 0;
+    for (const Test& test : tests) {
+        if (argc > 1 && std::strcmp(argv[1], test.name) != 0) {
+            continue;
+        }
+        std::printf("%s\n", test.name);
+        const double start = benchNow();
+        const bool passed = test.run();
+        workerLimit() = 0;
+        std::printf("%s %s, %.0f ms\n", passed ? "PASS" : "FAIL", test.name, benchNow() - start);
+        failed += passed ? 0 : 1;
+        ++ran;
+    }
+    if (ran == 0) {
+        std::printf("usage: tests [name]\n");
+        for (const Test& test : tests) {
+            std::printf("  %s\n", test.name);
+        }
+        return 1;
+    }
+    std::printf("%d of %d tests passed\n", ran - failed, ran);
+    return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,176 @@
+#include "tests.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "cloudcache.h"
+#include "octtree.h"
+#include "pointcloud.h"
+#include "tree.h"
+
+// the section table of a cache file follows its 72 byte header, entries of id, reserved,
+// offset and size
+static const size_t CACHE_TABLE_OFFSET = 72;
+static const size_t CACHE_ENTRY_SIZE = 24;
+
+static std::string readFile(const QString& path)
+{
+    std::ifstream is(path.toStdString().c_str(), std::ios::in | std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>());
+}
+
+// the bunny as ascii with a red column and its triangles
+static std::string bunnyWithColumn(const PointCloud& bunny)
+{
+    std::string contents = "ply\nformat ascii 1.0\nelement vertex " + std::to_string(bunny.getCount())
+            + "\nproperty float x\nproperty float y\nproperty float z\nproperty uchar red\nelement face "
+            + std::to_string(bunny.getFaceCount())
+            + "\nproperty list uchar int vertex_indices\nend_header\n";
+    char line[128];
+    for (size_t i = 0; i < bunny.getCount(); ++i) {
+        const QVector3D point = bunny.getPoint(i);
+        std::snprintf(line, sizeof(line), "%.9g %.9g %.9g %u\n", point.x(), point.y(), point.z(),
+                      static_cast<unsigned>(i % 256));
+        contents += line;
+    }
+    const std::vector<uint32_t>& faces = bunny.getFaces();
+    for (size_t f = 0; f < faces.size(); f += 3) {
+        std::snprintf(line, sizeof(line), "3 %u %u %u\n", faces[f], faces[f + 1], faces[f + 2]);
+        contents += line;
+    }
+    return contents;
+}
+
+// the cloud has the points, columns and faces of the parsed one
+static bool sameCloud(const PointCloud& cloud, const PointCloud& parsed)
+{
+    TEST_CHECK(cloud.getCount() == parsed.getCount());
+    TEST_CHECK(cloud.getMin() == parsed.getMin() && cloud.getMax() == parsed.getMax());
+    for (size_t i = 0; i < cloud.getCount(); ++i) {
+        TEST_CHECK(cloud.getPoint(i) == parsed.getPoint(i));
+    }
+    TEST_CHECK(cloud.getColumns().size() == parsed.getColumns().size());
+    for (size_t c = 0; c < cloud.getColumns().size(); ++c) {
+        TEST_CHECK(cloud.getColumns()[c].name == parsed.getColumns()[c].name);
+        TEST_CHECK(cloud.getColumns()[c].type == parsed.getColumns()[c].type);
+        TEST_CHECK(cloud.getColumns()[c].data == parsed.getColumns()[c].data);
+    }
+    TEST_CHECK(cloud.getFaces() == parsed.getFaces());
+    return true;
+}
+
+// a written cache loads the cloud and both indexes as they were built. A cut off cache, a
+// section past the end, a wrapping section offset, a face of a missing point and a source
+// changed while it was parsed all fall back to the parse
+bool testCacheRoundTrip()
+{
+    PointCloud bunny;
+    TEST_CHECK(bunny.loadPLY(testData("bunny.ply")));
+    const std::string source = bunnyWithColumn(bunny);
+    const QString path = writeTestFile("test_cache.ply", source);
+    const QString cachePath = cachePathFor(path);
+    std::remove(cachePath.toStdString().c_str());
+
+    PointCloud parsed;
+    TEST_CHECK(parsed.loadPLY(path));
+    TEST_CHECK(!parsed.getCache() && parsed.getColumn("red") && parsed.getFaceCount() == bunny.getFaceCount());
+    Tree tree;
+    TEST_CHECK(tree.build(parsed));
+    Octtree octtree;
+    TEST_CHECK(octtree.build(parsed));
+    const std::vector<unsigned char> treeBytes = tree.serialize();
+    const std::vector<unsigned char> octtreeBytes = octtree.serialize();
+    CloudCacheWriter writer;
+    writer.add(CacheSection::KdTree, treeBytes.data(), treeBytes.size());
+    writer.add(CacheSection::Octree, octtreeBytes.data(), octtreeBytes.size());
+    TEST_CHECK(parsed.writeCache(writer));
+
+    {
+        PointCloud cached;
+        TEST_CHECK(cached.loadPLY(path));
+        TEST_CHECK(cached.getCache() != nullptr);
+        TEST_CHECK(sameCloud(cached, parsed));
+        size_t size = 0;
+        const uchar* section = cached.getCache()->section(CacheSection::KdTree, &size);
+        TEST_CHECK(section);
+        std::unique_ptr<Tree> cachedTree(Tree::deserialize(section, size));
+        TEST_CHECK(cachedTree && cachedTree->serialize() == treeBytes);
+        section = cached.getCache()->section(CacheSection::Octree, &size);
+        TEST_CHECK(section);
+        std::unique_ptr<Octtree> cachedOcttree(Octtree::deserialize(section, size));
+        TEST_CHECK(cachedOcttree && cachedOcttree->serialize() == octtreeBytes);
+    }
+
+    // every corruption of the cache is rejected and the ply parsed again
+    const std::string cache = readFile(cachePath);
+    uint32_t sectionCount;
+    std::memcpy(&sectionCount, cache.data() + 12, sizeof(sectionCount));
+    TEST_CHECK(sectionCount == 5);
+    std::vector<std::string> corrupt;
+    corrupt.push_back(cache.substr(0, cache.size() / 2));
+    for (uint32_t s = 0; s < sectionCount; ++s) {
+        const size_t entry = CACHE_TABLE_OFFSET + s * CACHE_ENTRY_SIZE;
+        uint32_t id;
+        uint64_t offset, size;
+        std::memcpy(&id, cache.data() + entry, sizeof(id));
+        std::memcpy(&offset, cache.data() + entry + 8, sizeof(offset));
+        std::memcpy(&size, cache.data() + entry + 16, sizeof(size));
+        if (id == static_cast<uint32_t>(CacheSection::Points)) {
+            // past the end, and an offset that wraps around with the size
+            std::string past = cache;
+            const uint64_t pastSize = cache.size() - offset + 16;
+            std::memcpy(&past[entry + 16], &pastSize, sizeof(pastSize));
+            corrupt.push_back(past);
+            std::string wrapped = cache;
+            const uint64_t wrappedOffset = ~0ull - 15;
+            std::memcpy(&wrapped[entry + 8], &wrappedOffset, sizeof(wrappedOffset));
+            corrupt.push_back(wrapped);
+        } else if (id == static_cast<uint32_t>(CacheSection::Faces)) {
+            std::string faces = cache;
+            const uint32_t missing = static_cast<uint32_t>(parsed.getCount());
+            std::memcpy(&faces[offset + size - sizeof(missing)], &missing, sizeof(missing));
+            corrupt.push_back(faces);
+        } else if (id == static_cast<uint32_t>(CacheSection::Columns)) {
+            // the byte size of the red column, behind the column count, type and name length
+            std::string columns = cache;
+            const uint64_t byteSize = parsed.getCount() - 1;
+            std::memcpy(&columns[offset + 12], &byteSize, sizeof(byteSize));
+            corrupt.push_back(columns);
+        }
+    }
+    TEST_CHECK(corrupt.size() == 5);
+    for (const std::string& contents : corrupt) {
+        writeTestFile(cachePath.toStdString().c_str(), contents);
+        PointCloud cloud;
+        TEST_CHECK(cloud.loadPLY(path));
+        TEST_CHECK(!cloud.getCache());
+        TEST_CHECK(sameCloud(cloud, parsed));
+    }
+
+    // the source changes while it is parsed, the cache written for the parsed contents must
+    // not be taken for the new ones
+    std::string changed = source;
+    const size_t firstPoint = changed.find("end_header\n") + 11;
+    TEST_CHECK(changed[firstPoint] == '-');
+    changed[firstPoint] = '+';
+    {
+        PointCloud cloud;
+        TEST_CHECK(cloud.loadPLY(path, [&](size_t, size_t) {
+            writeTestFile("test_cache.ply", changed);
+            return true;
+        }));
+        CloudCacheWriter changedWriter;
+        TEST_CHECK(cloud.writeCache(changedWriter));
+    }
+    PointCloud reloaded;
+    TEST_CHECK(reloaded.loadPLY(path));
+    TEST_CHECK(!reloaded.getCache());
+    TEST_CHECK(reloaded.getPoint(0).x() == -parsed.getPoint(0).x());
+    std::printf("  cloud, columns, faces, kd-tree and octtree through the cache, %zu corrupt caches and a "
+                "source changed during the parse rejected\n", corrupt.size());
+    return true;
+}
@@ -0,0 +1,87 @@
+#include "tests.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <set>
+#include <vector>
+
+#include "forest.h"
+#include "pointcloud.h"
+#include "tree.h"
+
+// the forest without a leaf budget is exact, with one it still returns k distinct rows at
+// their true distances, and eps keeps the k-th within 1 + eps of the true k-th
+bool testForestKnn()
+{
+    for (const char* fileName : { "bunny.ply", "fandisk.ply" }) {
+        PointCloud cloud;
+        TEST_CHECK(cloud.loadPLY(testData(fileName)));
+        Forest forest(4);
+        forest.build(cloud);
+        const std::vector<QVector3D> queries = testQueries(cloud, 200);
+        const int k = 8;
+
+        std::vector<uint32_t> rows;
+        std::vector<float> distances;
+        size_t hits = 0;
+        for (const QVector3D& query : queries) {
+            const std::vector<std::pair<float, uint32_t>> all = bruteForce(cloud, query);
+            forest.knn(query, k, rows, distances, TreeApproximation());
+            TEST_CHECK(rows.size() == static_cast<size_t>(k));
+            for (int j = 0; j < k; ++j) {
+                TEST_CHECK(nearlyEqual(distances[j], std::sqrt(all[j].first)));
+            }
+
+            TreeApproximation approximation;
+            approximation.eps = 0.5f;
+            approximation.max_leaves = 4;
+            forest.knn(query, k, rows, distances, approximation);
+            TEST_CHECK(rows.size() == static_cast<size_t>(k));
+            TEST_CHECK(std::set<uint32_t>(rows.begin(), rows.end()).size() == rows.size());
+            for (int j = 0; j < k; ++j) {
+                TEST_CHECK(nearlyEqual(distances[j], (cloud.getPoint(rows[j]) - query).length()));
+                TEST_CHECK(j == 0 || distances[j - 1] <= distances[j]);
+                hits += distances[j] <= std::sqrt(all[k - 1].first) ? 1 : 0;
+            }
+
+            approximation.max_leaves = 0;
+            forest.knn(query, k, rows, distances, approximation);
+            TEST_CHECK(distances[k - 1] <= 1.5f * std::sqrt(all[k - 1].first) * (1 + 1e-5f));
+        }
+
+        // the batch gives the single results, with the row bitset of a thread reused
+        TreeApproximation approximation;
+        approximation.max_leaves = 4;
+        std::vector<uint32_t> batchRows;
+        std::vector<float> batchDistances;
+        forest.knn_batch(queries, k, batchRows, batchDistances, approximation);
+        for (size_t q = 0; q < queries.size(); ++q) {
+            forest.knn(queries[q], k, rows, distances, approximation);
+            for (int j = 0; j < k; ++j) {
+                TEST_CHECK(batchRows[q * k + j] == rows[j] && batchDistances[q * k + j] == distances[j]);
+            }
+        }
+        const double recall = double(hits) / (queries.size() * k);
+        std::printf("  %s: exact without a budget, recall %.2f with 4 leaves and eps 0.5\n", fileName, recall);
+        TEST_CHECK(recall > 0.5);
+    }
+
+    // rows of the cloud past the points of the trees, which leave out NaN and infinite points
+    PointCloud bunny;
+    TEST_CHECK(bunny.loadPLY(testData("bunny.ply")));
+    PointCloud cloud;
+    TEST_CHECK(cloud.loadPLY(writeTestPly("test_forest_non_finite.ply", nonFinitePoints(bunny))));
+    Forest forest(4);
+    forest.build(cloud);
+    std::vector<uint32_t> rows;
+    std::vector<float> distances;
+    for (const QVector3D& query : testQueries(bunny, 100)) {
+        const std::vector<std::pair<float, uint32_t>> all = bruteForce(cloud, query);
+        forest.knn(query, 8, rows, distances, TreeApproximation());
+        for (int j = 0; j < 8; ++j) {
+            TEST_CHECK(nearlyEqual(distances[j], std::sqrt(all[j].first)));
+            TEST_CHECK(nearlyEqual(distances[j], (cloud.getPoint(rows[j]) - query).length()));
+        }
+    }
+    return true;
+}
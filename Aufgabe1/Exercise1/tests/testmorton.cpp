@@ -0,0 +1,109 @@
+#include "tests.h"
+#include <algorithm>
+#include <cstdio>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "morton.h"
+#include "parallel.h"
+
+// the code of a cell bit by bit, x in the lowest bit of every 3 bit digit
+static uint64_t interleave(uint32_t x, uint32_t y, uint32_t z)
+{
+    uint64_t code = 0;
+    for (int bit = 0; bit < MORTON_BITS; ++bit) {
+        code |= static_cast<uint64_t>(x >> bit & 1) << (3 * bit);
+        code |= static_cast<uint64_t>(y >> bit & 1) << (3 * bit + 1);
+        code |= static_cast<uint64_t>(z >> bit & 1) << (3 * bit + 2);
+    }
+    return code;
+}
+
+// the cells of a point, decoded from its grid code
+static void cellOf(const MortonGrid& grid, const QVector3D& point, uint32_t cell[3])
+{
+    mortonDecode(grid.code(point), cell[0], cell[1], cell[2]);
+}
+
+// codes against a bit by bit interleave, decode and shared digits, sortMorton against
+// std::stable_sort on one and on all threads, and the grid on flat, NaN and outside points
+bool testMortonCodes()
+{
+    std::mt19937 random(7);
+    std::uniform_int_distribution<uint32_t> anyCell(0, MORTON_CELLS - 1);
+    for (int i = 0; i < 100000; ++i) {
+        uint32_t cell[3] = { anyCell(random), anyCell(random), anyCell(random) };
+        if (i < 8) {
+            for (int k = 0; k < 3; ++k) {
+                cell[k] = i >> k & 1 ? MORTON_CELLS - 1 : 0;
+            }
+        }
+        const uint64_t code = mortonEncode(cell[0], cell[1], cell[2]);
+        TEST_CHECK(code == interleave(cell[0], cell[1], cell[2]));
+        uint32_t x, y, z;
+        mortonDecode(code, x, y, z);
+        TEST_CHECK(x == cell[0] && y == cell[1] && z == cell[2]);
+
+        const uint64_t other = i % 3 == 0 ? code : code ^ (uint64_t(1) << (random() % (3 * MORTON_BITS)));
+        int shared = 0;
+        while (shared < MORTON_BITS && (code >> (3 * (MORTON_BITS - 1 - shared)) & 7)
+                                           == (other >> (3 * (MORTON_BITS - 1 - shared)) & 7)) {
+            ++shared;
+        }
+        TEST_CHECK(mortonSharedDigits(code, other) == shared);
+    }
+
+    // random codes, few distinct codes for the stability and a single code, below and above
+    // the size of the parallel sort
+    std::vector<MortonKey> keys;
+    std::vector<MortonKey> buffer;
+    for (size_t count : { size_t(0), size_t(1), size_t(1000), size_t(200000) }) {
+        for (int kind = 0; kind < 3; ++kind) {
+            keys.resize(count);
+            for (size_t i = 0; i < count; ++i) {
+                const uint64_t code = mortonEncode(anyCell(random), anyCell(random), anyCell(random));
+                keys[i].code = kind == 0 ? code : kind == 1 ? code % 17 << 40 : 12345;
+                keys[i].row = static_cast<uint32_t>(i);
+            }
+            std::vector<MortonKey> expected = keys;
+            std::stable_sort(expected.begin(), expected.end(),
+                             [](const MortonKey& a, const MortonKey& b) { return a.code < b.code; });
+            for (unsigned threads : { 1u, 4u }) {
+                std::vector<MortonKey> sorted = keys;
+                workerLimit() = threads;
+                sortMorton(sorted, buffer);
+                workerLimit() = 0;
+                for (size_t i = 0; i < count; ++i) {
+                    TEST_CHECK(sorted[i].code == expected[i].code && sorted[i].row == expected[i].row);
+                }
+            }
+        }
+    }
+
+    // a flat z keeps every point in z cell 0, the max corner is in the last cell, NaN and points
+    // below the grid go to cell 0 and points above it to the last cell
+    const MortonGrid grid(QVector3D(-1, 0, 5), QVector3D(3, 2, 5));
+    uint32_t cell[3];
+    cellOf(grid, QVector3D(3, 2, 5), cell);
+    TEST_CHECK(cell[0] == MORTON_CELLS - 1 && cell[1] == MORTON_CELLS - 1 && cell[2] == 0);
+    cellOf(grid, QVector3D(-1, 0, 5), cell);
+    TEST_CHECK(cell[0] == 0 && cell[1] == 0 && cell[2] == 0);
+    cellOf(grid, QVector3D(1, 1, 7), cell);
+    TEST_CHECK(cell[0] == MORTON_CELLS / 2 && cell[1] == MORTON_CELLS / 2 && cell[2] == 0);
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    const float inf = std::numeric_limits<float>::infinity();
+    cellOf(grid, QVector3D(nan, -inf, nan), cell);
+    TEST_CHECK(cell[0] == 0 && cell[1] == 0 && cell[2] == 0);
+    cellOf(grid, QVector3D(100, inf, -100), cell);
+    TEST_CHECK(cell[0] == MORTON_CELLS - 1 && cell[1] == MORTON_CELLS - 1 && cell[2] == 0);
+    TEST_CHECK(grid.cellSize().z() == 0);
+    cellOf(grid, grid.cellMin(12345, 678, 0) + grid.cellSize() * 0.5f, cell);
+    TEST_CHECK(cell[0] == 12345 && cell[1] == 678 && cell[2] == 0);
+    const MortonGrid flat(QVector3D(1, 1, 1), QVector3D(1, 1, 1));
+    TEST_CHECK(flat.code(QVector3D(1, 1, 1)) == 0 && flat.code(QVector3D(2, 0, nan)) == 0);
+
+    std::printf("  100000 codes as interleaved bits, sorts of up to 200000 keys as std::stable_sort, "
+                "flat, NaN and outside points in their cells\n");
+    return true;
+}
@@ -0,0 +1,648 @@
+#include "tests.h"
+#include <QMatrix4x4>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "bench.h"
+#include "octtree.h"
+#include "parallel.h"
+#include "pointcloud.h"
+
+static bool sameNodes(const std::vector<OcttreeNode>& a, const std::vector<OcttreeNode>& b)
+{
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].first_child != b[i].first_child || a[i].first != b[i].first || a[i].count != b[i].count
+                || a[i].child_mask != b[i].child_mask || a[i].depth != b[i].depth) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// the cpu side of GLWidget::paintGL with the octtree shown, over 1,000 frames of a camera
+// circling the bunny after 100 warmup frames, bench repaint runs it for 10,000. Every frame
+// rebuilds the tree, its samples and its lines, more than the widget does, which builds them
+// once per load. After the first frames have sized the arrays neither the tree nor the
+// resident memory of the process may grow
+bool testOcttreeRepaintMemory()
+{
+    PointCloud cloud;
+    TEST_CHECK(cloud.loadPLY(testData("bunny.ply")));
+
+    const int warmup = 100;
+    const int frames = warmup + 1000;
+    const QVector3D center = (cloud.getMin() + cloud.getMax()) / 2;
+    const float size = (cloud.getMax() - cloud.getMin()).length();
+    Octtree octtree;
+    std::vector<QVector3D> corners;
+    std::vector<uint32_t> indices;
+    std::vector<uint32_t> levelEnds;
+    std::vector<OcttreeRange> ranges;
+    size_t arrays = 0;
+    size_t resident = 0;
+    for (int frame = 0; frame < frames; ++frame) {
+        if (frame == warmup) {
+            arrays = octtree.memory_usage();
+            resident = currentMemory();
+        }
+        TEST_CHECK(octtree.build(cloud));
+        octtree.build_samples();
+        octtree.get_octtree_wireframe(5, corners, indices, levelEnds);
+        TEST_CHECK(!indices.empty());
+
+        QMatrix4x4 projection;
+        projection.perspective(45.0f, 4.0f / 3.0f, size * 0.01f, size * 10.0f);
+        QMatrix4x4 camera;
+        camera.translate(0, 0, -1.5f * size);
+        camera.rotate(frame * 0.036f, 0, 1, 0);
+        camera.translate(-center.x(), -center.y(), -center.z());
+        octtree.select_lod(projection * camera, projection(1, 1) * 600 / 2, 1.0f, ranges);
+        TEST_CHECK(!ranges.empty());
+    }
+
+    const size_t arraysAfter = octtree.memory_usage();
+    const size_t residentAfter = currentMemory();
+    std::printf("  tree arrays %zu kB after %d frames, %zu kB after %d\n",
+                arrays / 1024, warmup, arraysAfter / 1024, frames);
+    std::printf("  resident %zu kB after %d frames, %zu kB after %d\n",
+                resident / 1024, warmup, residentAfter / 1024, frames);
+    TEST_CHECK(arraysAfter == arrays);
+    // a little slack for the allocator and the stream buffers, a leak of a node or a line
+    // vector per frame would be megabytes
+    TEST_CHECK(resident == 0 || residentAfter <= resident + 512 * 1024);
+    return true;
+}
+
+// the parallel build splits the upper levels into tasks for the threads, with any number of
+// threads it has to give the nodes and rows of the serial build
+bool testOcttreeParallelBuild()
+{
+    PointCloud cloud;
+    TEST_CHECK(cloud.loadPLY(syntheticPly("test_synthetic_300k.ply", 300000)));
+    for (unsigned threads : { 1u, 2u, 3u, 16u }) {
+        workerLimit() = threads;
+        for (int capacity : { 1, 8, OCTTREE_LEAF_CAPACITY, 1000 }) {
+            Octtree expected(capacity);
+            Octtree octtree(capacity);
+            TEST_CHECK(expected.build(cloud, false));
+            TEST_CHECK(octtree.build(cloud, true));
+            TEST_CHECK(expected.get_nodes().size() > 1);
+            TEST_CHECK(octtree.get_rows() == expected.get_rows());
+            TEST_CHECK(sameNodes(octtree.get_nodes(), expected.get_nodes()));
+        }
+        std::printf("  %u threads: same trees as the serial build\n", threads);
+    }
+    return true;
+}
+
+// knn and radius search against the distances to all points, single and batched
+bool testOcttreeQueries()
+{
+    for (const char* fileName : { "bunny.ply", "fandisk.ply" }) {
+        PointCloud cloud;
+        TEST_CHECK(cloud.loadPLY(testData(fileName)));
+        Octtree octtree;
+        TEST_CHECK(octtree.build(cloud));
+        const std::vector<QVector3D> queries = testQueries(cloud, 300);
+        const float radius = (cloud.getMax() - cloud.getMin()).length() * 0.01f;
+
+        std::vector<OcttreeNeighbour> found;
+        for (const QVector3D& query : queries) {
+            const std::vector<std::pair<float, uint32_t>> all = bruteForce(cloud, query);
+            for (int k : { 1, 8, 32 }) {
+                octtree.knn(query, k, found);
+                TEST_CHECK(found.size() == static_cast<size_t>(k));
+                std::set<uint32_t> rows;
+                for (size_t j = 0; j < found.size(); ++j) {
+                    TEST_CHECK(nearlyEqual(found[j].distance, std::sqrt(all[j].first)));
+                    TEST_CHECK(nearlyEqual(found[j].distance, (cloud.getPoint(found[j].row) - query).length()));
+                    rows.insert(found[j].row);
+                }
+                TEST_CHECK(rows.size() == found.size());
+            }
+
+            // points on the sphere itself may go either way
+            octtree.radius_search(query, radius, found);
+            std::set<uint32_t> rows;
+            for (const OcttreeNeighbour& neighbour : found) {
+                TEST_CHECK(neighbour.distance <= radius * (1 + 1e-5f));
+                rows.insert(neighbour.row);
+            }
+            TEST_CHECK(rows.size() == found.size());
+            for (const std::pair<float, uint32_t>& point : all) {
+                if (std::sqrt(point.first) >= radius * (1 - 1e-5f)) {
+                    break;
+                }
+                TEST_CHECK(rows.count(point.second) == 1);
+            }
+        }
+
+        // the batches give what the single queries give
+        std::vector<OcttreeNeighbour> batch;
+        octtree.knn_batch(queries, 8, batch);
+        TEST_CHECK(batch.size() == queries.size() * 8);
+        std::vector<std::vector<OcttreeNeighbour>> lists;
+        octtree.radius_search_batch(queries, radius, lists);
+        TEST_CHECK(lists.size() == queries.size());
+        for (size_t q = 0; q < queries.size(); ++q) {
+            octtree.knn(queries[q], 8, found);
+            for (size_t j = 0; j < found.size(); ++j) {
+                TEST_CHECK(batch[q * 8 + j].row == found[j].row && batch[q * 8 + j].distance == found[j].distance);
+            }
+            octtree.radius_search(queries[q], radius, found);
+            TEST_CHECK(lists[q].size() == found.size());
+            for (size_t j = 0; j < found.size(); ++j) {
+                TEST_CHECK(lists[q][j].row == found[j].row);
+            }
+        }
+        std::printf("  %s: %zu queries, knn k = 1, 8, 32 and radius %g as brute force\n",
+                    fileName, queries.size(), radius);
+    }
+    return true;
+}
+
+// the tree holds exactly the points of expected, indexed by row, and every node is where
+// a build over the same codes puts it: children after their parent in octant order with
+// the ranges of their parent, inner nodes over the capacity and above the maximum depth
+static bool checkTree(const Octtree& octtree, const std::vector<QVector3D>& expected, const std::set<uint32_t>& rows)
+{
+    const std::vector<OcttreeNode>& nodes = octtree.get_nodes();
+    TEST_CHECK(octtree.get_rows().size() == rows.size());
+    TEST_CHECK(std::set<uint32_t>(octtree.get_rows().begin(), octtree.get_rows().end()) == rows);
+    for (size_t i = 0; i < octtree.get_rows().size(); ++i) {
+        TEST_CHECK(octtree.get_points()[i] == expected[octtree.get_rows()[i]]);
+    }
+    TEST_CHECK(nodes.empty() == rows.empty());
+
+    std::vector<QVector3D> corners(nodes.size());
+    if (!nodes.empty()) {
+        corners[0] = octtree.near_bot_left();
+        TEST_CHECK(nodes[0].first == 0 && nodes[0].count == rows.size() && nodes[0].depth == 0);
+    }
+    const float margin = octtree.length() * 1e-5f;
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        const OcttreeNode& node = nodes[i];
+        const float length = octtree.length() / static_cast<float>(1 << node.depth);
+        TEST_CHECK(node.count > 0);
+        TEST_CHECK(node.is_leaf() == (node.count <= static_cast<uint32_t>(octtree.leaf_capacity())
+                                      || node.depth >= octtree.max_depth()));
+        for (uint32_t j = node.first; j < node.first + node.count; ++j) {
+            const QVector3D point = octtree.get_points()[j];
+            for (int axis = 0; axis < 3; ++axis) {
+                TEST_CHECK(point[axis] >= corners[i][axis] - margin && point[axis] <= corners[i][axis] + length + margin);
+            }
+        }
+        if (node.is_leaf()) {
+            continue;
+        }
+        TEST_CHECK(node.first_child > i && node.first_child + node.child_count() <= nodes.size());
+        uint32_t first = node.first;
+        uint32_t child = node.first_child;
+        for (int octant = 0; octant < 8; ++octant) {
+            if (node.child_mask >> octant & 1) {
+                TEST_CHECK(nodes[child].depth == node.depth + 1 && nodes[child].first == first);
+                corners[child] = Octtree::child_near_bot_left(corners[i], length, octant);
+                first += nodes[child].count;
+                ++child;
+            }
+        }
+        TEST_CHECK(first == node.first + node.count);
+    }
+
+    // and finds the nearest of them
+    std::vector<OcttreeNeighbour> found;
+    for (uint32_t row : rows) {
+        if (row % 331 != 0) {
+            continue;
+        }
+        const QVector3D query = expected[row] + QVector3D(margin, -margin, margin) * 10;
+        std::vector<float> distances;
+        for (uint32_t other : rows) {
+            distances.push_back((expected[other] - query).length());
+        }
+        std::sort(distances.begin(), distances.end());
+        octtree.knn(query, 8, found);
+        TEST_CHECK(found.size() == std::min<size_t>(8, rows.size()));
+        for (size_t j = 0; j < found.size(); ++j) {
+            TEST_CHECK(nearlyEqual(found[j].distance, distances[j]));
+        }
+    }
+    return true;
+}
+
+// leaves of at most leaf_capacity points unless they are on max_depth, which is clamped to
+// MORTON_BITS, for the bunny and for a cloud of many equal points that no depth can split
+bool testOcttreeLimits()
+{
+    PointCloud bunny;
+    TEST_CHECK(bunny.loadPLY(testData("bunny.ply")));
+    std::vector<QVector3D> equal;
+    for (int i = 0; i < 2000; ++i) {
+        equal.push_back(i < 500 ? QVector3D(0.25f, 0.5f, 0.75f) : QVector3D(i % 10, i / 10 % 10, i / 100) * 0.1f);
+    }
+    PointCloud duplicates;
+    TEST_CHECK(duplicates.loadPLY(writeTestPly("test_octree_limits.ply", equal)));
+
+    for (const PointCloud* cloud : { &bunny, &duplicates }) {
+        std::vector<QVector3D> expected;
+        std::set<uint32_t> rows;
+        for (size_t i = 0; i < cloud->getCount(); ++i) {
+            expected.push_back(cloud->getPoint(i));
+            rows.insert(static_cast<uint32_t>(i));
+        }
+        for (int capacity : { 1, 3, OCTTREE_LEAF_CAPACITY, 1000 }) {
+            for (int maxDepth : { 0, 1, 4, OCTTREE_MAX_DEPTH, MORTON_BITS, 40 }) {
+                Octtree octtree(capacity, maxDepth);
+                TEST_CHECK(octtree.max_depth() == std::min(maxDepth, MORTON_BITS));
+                TEST_CHECK(octtree.build(*cloud));
+                TEST_CHECK(checkTree(octtree, expected, rows));
+                int depth = 0;
+                uint32_t largest = 0;
+                for (const OcttreeNode& node : octtree.get_nodes()) {
+                    depth = std::max<int>(depth, node.depth);
+                    largest = node.is_leaf() ? std::max(largest, node.count) : largest;
+                }
+                TEST_CHECK(depth <= octtree.max_depth());
+                // the equal points stay together in a leaf on the deepest level
+                if (cloud == &duplicates) {
+                    TEST_CHECK(largest >= 500 && (capacity >= 500 || depth == octtree.max_depth()));
+                }
+            }
+        }
+        std::printf("  %zu points: capacities 1 to 1000 and depths 0 to 40 within their limits\n",
+                    cloud->getCount());
+    }
+    return true;
+}
+
+// batches of points inserted into and removed from a built tree, some of them far outside
+// its root so that the root has to grow, with leaf capacities that split and merge often
+bool testOcttreeInsertRemove()
+{
+    PointCloud cloud;
+    TEST_CHECK(cloud.loadPLY(testData("bunny.ply")));
+    for (int capacity : { 1, 8, OCTTREE_LEAF_CAPACITY }) {
+        Octtree octtree(capacity, capacity == 1 ? 10 : OCTTREE_MAX_DEPTH);
+        TEST_CHECK(octtree.build(cloud));
+        std::vector<QVector3D> expected(cloud.getCount());
+        std::set<uint32_t> rows;
+        for (size_t i = 0; i < cloud.getCount(); ++i) {
+            expected[i] = cloud.getPoint(i);
+            rows.insert(static_cast<uint32_t>(i));
+        }
+        TEST_CHECK(checkTree(octtree, expected, rows));
+
+        // next to points of the cloud, then up to three times the extent of the cloud away
+        const QVector3D extent = cloud.getMax() - cloud.getMin();
+        const QVector3D oldLow = octtree.near_bot_left();
+        const QVector3D oldHigh = octtree.far_top_right();
+        std::mt19937 random(5);
+        std::uniform_real_distribution<float> far(-3.0f, 4.0f);
+        size_t outside = 0;
+        for (int batch = 0; batch < 2; ++batch) {
+            std::vector<QVector3D> points;
+            std::vector<uint32_t> added;
+            for (int i = 0; i < 1000; ++i) {
+                const QVector3D point = batch == 0
+                        ? cloud.getPoint(random() % cloud.getCount()) + extent * 1e-4f
+                        : cloud.getMin() + QVector3D(far(random) * extent.x(), far(random) * extent.y(), far(random) * extent.z());
+                bool inside = true;
+                for (int axis = 0; axis < 3; ++axis) {
+                    inside = inside && point[axis] >= oldLow[axis] && point[axis] <= oldHigh[axis];
+                }
+                outside += inside ? 0 : 1;
+                added.push_back(static_cast<uint32_t>(expected.size()));
+                rows.insert(added.back());
+                points.push_back(point);
+                expected.push_back(point);
+            }
+            octtree.insert(points, added);
+            TEST_CHECK(checkTree(octtree, expected, rows));
+        }
+        TEST_CHECK(outside > 500 && octtree.length() > 2 * extent.length());
+
+        // every third row out and back in, then the rest out
+        std::vector<uint32_t> removed;
+        std::vector<QVector3D> points;
+        for (uint32_t row = 0; row < expected.size(); row += 3) {
+            removed.push_back(row);
+            points.push_back(expected[row]);
+            rows.erase(row);
+        }
+        octtree.remove(removed);
+        TEST_CHECK(checkTree(octtree, expected, rows));
+        octtree.insert(points, removed);
+        rows.insert(removed.begin(), removed.end());
+        TEST_CHECK(checkTree(octtree, expected, rows));
+        octtree.remove(std::vector<uint32_t>(rows.begin(), rows.end()));
+        TEST_CHECK(checkTree(octtree, expected, std::set<uint32_t>()));
+        std::printf("  capacity %d: %zu points inserted, %zu of them outside the old root, root grew to %g\n",
+                    capacity, expected.size() - cloud.getCount(), outside, octtree.length());
+    }
+    return true;
+}
+
+// serialize and deserialize give the same tree, which answers the same queries, and bytes
+// with a child before or at its parent, children or points past the arrays or a wrong size
+// give no tree
+bool testOcttreeSerialize()
+{
+    PointCloud cloud;
+    TEST_CHECK(cloud.loadPLY(testData("bunny.ply")));
+    Octtree octtree;
+    TEST_CHECK(octtree.build(cloud));
+    const std::vector<unsigned char> bytes = octtree.serialize();
+    std::unique_ptr<Octtree> loaded(Octtree::deserialize(bytes.data(), bytes.size()));
+    TEST_CHECK(loaded);
+    TEST_CHECK(loaded->serialize() == bytes);
+    TEST_CHECK(sameNodes(loaded->get_nodes(), octtree.get_nodes()) && loaded->get_rows() == octtree.get_rows());
+    TEST_CHECK(loaded->near_bot_left() == octtree.near_bot_left() && loaded->length() == octtree.length());
+    TEST_CHECK(loaded->leaf_capacity() == octtree.leaf_capacity() && loaded->max_depth() == octtree.max_depth());
+    for (size_t i = 0; i < octtree.get_points().size(); ++i) {
+        TEST_CHECK(loaded->get_points()[i] == octtree.get_points()[i]);
+    }
+    std::vector<OcttreeNeighbour> expected;
+    std::vector<OcttreeNeighbour> found;
+    for (const QVector3D& query : testQueries(cloud, 100)) {
+        octtree.knn(query, 8, expected);
+        loaded->knn(query, 8, found);
+        TEST_CHECK(found.size() == expected.size());
+        for (size_t j = 0; j < found.size(); ++j) {
+            TEST_CHECK(found[j].row == expected[j].row && found[j].distance == expected[j].distance);
+        }
+    }
+    Octtree empty;
+    const std::vector<unsigned char> emptyBytes = empty.serialize();
+    std::unique_ptr<Octtree> emptyLoaded(Octtree::deserialize(emptyBytes.data(), emptyBytes.size()));
+    TEST_CHECK(emptyLoaded && emptyLoaded->get_nodes().empty());
+
+    // node records behind the bounds, the limits and the counts
+    const size_t nodesAt = 4 * sizeof(float) + 2 * sizeof(uint32_t) + 2 * sizeof(uint64_t);
+    size_t inner = 0;
+    while (octtree.get_nodes()[inner].child_count() < 2 || inner == 0) {
+        ++inner;
+    }
+    auto withField = [&](size_t node, size_t offset, uint32_t value) {
+        std::vector<unsigned char> broken = bytes;
+        std::memcpy(broken.data() + nodesAt + node * sizeof(OcttreeNode) + offset, &value, sizeof(value));
+        return broken;
+    };
+    const std::vector<std::vector<unsigned char>> broken = {
+        // a cycle through the root, a child pointing at itself and one at its parent
+        withField(inner, offsetof(OcttreeNode, first_child), 0),
+        withField(inner, offsetof(OcttreeNode, first_child), static_cast<uint32_t>(inner)),
+        withField(inner, offsetof(OcttreeNode, first_child), static_cast<uint32_t>(inner - 1)),
+        withField(inner, offsetof(OcttreeNode, first_child), static_cast<uint32_t>(octtree.get_nodes().size() - 1)),
+        withField(0, offsetof(OcttreeNode, count), static_cast<uint32_t>(cloud.getCount() + 1)),
+        withField(inner, offsetof(OcttreeNode, first), static_cast<uint32_t>(cloud.getCount())),
+        std::vector<unsigned char>(bytes.begin(), bytes.end() - 1),
+        std::vector<unsigned char>(bytes.begin(), bytes.begin() + nodesAt - 1),
+    };
+    for (const std::vector<unsigned char>& data : broken) {
+        TEST_CHECK(!std::unique_ptr<Octtree>(Octtree::deserialize(data.data(), data.size())));
+    }
+    std::printf("  %zu nodes through %zu bytes, the same knn, %zu broken trees rejected\n",
+                octtree.get_nodes().size(), bytes.size(), broken.size());
+    return true;
+}
+
+// the ranges of the level of detail: all points without a pixel error, none for a cloud
+// behind the camera, and further away fewer and fewer points in ranges of the draw order that
+// do not overlap
+bool testOcttreeLod()
+{
+    PointCloud cloud;
+    TEST_CHECK(cloud.loadPLY(testData("bunny.ply")));
+    Octtree octtree;
+    TEST_CHECK(octtree.build(cloud));
+    octtree.build_samples();
+    const size_t drawOrder = octtree.get_draw_order().size();
+
+    const QVector3D center = (cloud.getMin() + cloud.getMax()) / 2;
+    const float diagonal = (cloud.getMax() - cloud.getMin()).length();
+    QMatrix4x4 projection;
+    projection.perspective(70.0f, 16.0f / 9.0f, diagonal * 0.001f, diagonal * 1000.0f);
+    const float pixelsPerUnit = projection(1, 1) * 1080 / 2;
+    std::vector<OcttreeRange> ranges;
+    size_t previous = cloud.getCount();
+    for (float distance : { -2.0f, 2.0f, 20.0f, 200.0f }) {
+        QMatrix4x4 camera;
+        camera.translate(0, 0, -distance * diagonal);
+        camera.translate(-center.x(), -center.y(), -center.z());
+        octtree.select_lod(projection * camera, pixelsPerUnit, 0.0f, ranges);
+        if (distance < 0) {
+            TEST_CHECK(ranges.empty());
+            continue;
+        }
+        TEST_CHECK(ranges.size() == 1 && ranges[0].first == 0 && ranges[0].count == cloud.getCount());
+
+        octtree.select_lod(projection * camera, pixelsPerUnit, 1.0f, ranges);
+        std::vector<OcttreeRange> sorted(ranges);
+        std::sort(sorted.begin(), sorted.end(), [](const OcttreeRange& a, const OcttreeRange& b) {
+            return a.first < b.first;
+        });
+        size_t points = 0;
+        for (size_t i = 0; i < sorted.size(); ++i) {
+            TEST_CHECK(sorted[i].count > 0 && sorted[i].first + sorted[i].count <= drawOrder);
+            TEST_CHECK(i == 0 || sorted[i - 1].first + sorted[i - 1].count <= sorted[i].first);
+            points += sorted[i].count;
+        }
+        std::printf("  at %g diagonals %zu of %zu points in %zu ranges\n", distance, points, cloud.getCount(), ranges.size());
+        TEST_CHECK(points > 0 && points <= previous);
+        previous = points;
+    }
+    TEST_CHECK(previous < cloud.getCount() / 10);
+    return true;
+}
+
+// frustum culling against the clip space test of every point: select_lod without a pixel
+// error draws every point in the view once and, for a view of part of the cloud, leaves out
+// most of the others. The cameras look from inside and outside
+// the bunny in many directions with wide and narrow fields of view
+bool testOcttreeFrustum()
+{
+    PointCloud cloud;
+    TEST_CHECK(cloud.loadPLY(testData("bunny.ply")));
+    Octtree octtree;
+    TEST_CHECK(octtree.build(cloud));
+    octtree.build_samples();
+    const std::vector<uint32_t> drawOrder = octtree.get_draw_order();
+
+    const QVector3D center = (cloud.getMin() + cloud.getMax()) / 2;
+    const float diagonal = (cloud.getMax() - cloud.getMin()).length();
+    std::vector<OcttreeRange> ranges;
+    size_t views = 0;
+    size_t partial = 0;
+    for (float fov : { 10.0f, 45.0f, 100.0f }) {
+        QMatrix4x4 projection;
+        projection.perspective(fov, 4.0f / 3.0f, diagonal * 0.01f, diagonal * 2.0f);
+        const float pixelsPerUnit = projection(1, 1) * 600 / 2;
+        for (float distance : { 0.0f, 0.3f, 1.0f }) {
+            for (int turn = 0; turn < 12; ++turn) {
+                QMatrix4x4 camera;
+                camera.translate(0, 0, -distance * diagonal);
+                camera.rotate(turn * 30.0f, 0, 1, 0);
+                camera.rotate(turn * 17.0f, 1, 0, 0);
+                camera.translate(-center.x(), -center.y(), -center.z());
+                const QMatrix4x4 viewProjection = projection * camera;
+
+                std::vector<char> inside(cloud.getCount(), 0);
+                size_t expected = 0;
+                for (size_t row = 0; row < cloud.getCount(); ++row) {
+                    const QVector4D clip = viewProjection * QVector4D(cloud.getPoint(row), 1);
+                    bool in = true;
+                    for (int axis = 0; axis < 3; ++axis) {
+                        in = in && std::abs(clip[axis]) <= clip.w();
+                    }
+                    inside[row] = in;
+                    expected += in ? 1 : 0;
+                }
+
+                octtree.select_lod(viewProjection, pixelsPerUnit, 0.0f, ranges);
+                std::vector<char> drawn(cloud.getCount(), 0);
+                size_t count = 0;
+                for (const OcttreeRange& range : ranges) {
+                    TEST_CHECK(range.first + range.count <= octtree.get_rows().size());
+                    for (uint32_t i = range.first; i < range.first + range.count; ++i) {
+                        TEST_CHECK(!drawn[drawOrder[i]]);
+                        drawn[drawOrder[i]] = 1;
+                        ++count;
+                    }
+                }
+                for (size_t row = 0; row < cloud.getCount(); ++row) {
+                    TEST_CHECK(!inside[row] || drawn[row]);
+                }
+                if (expected < cloud.getCount() / 4) {
+                    TEST_CHECK(count < cloud.getCount() / 2);
+                    ++partial;
+                }
+                ++views;
+            }
+        }
+    }
+    TEST_CHECK(partial > 10);
+    std::printf("  %zu views, all points in view drawn, most others culled in the %zu views of less than "
+                "a quarter of the bunny\n", views, partial);
+    return true;
+}
+
+// the wireframe down to a depth has the root, then for every split node of the level above
+// its 8 octant cubes level by level, each as the 12 axis parallel edges of its length. The
+// lines of a smaller depth are the first level_ends of a larger one, so the widget draws any
+// depth from one buffer
+bool testOcttreeWireframe()
+{
+    PointCloud cloud;
+    TEST_CHECK(cloud.loadPLY(testData("bunny.ply")));
+    Octtree octtree;
+    TEST_CHECK(octtree.build(cloud));
+    int treeDepth = 0;
+    std::vector<size_t> splitAt(MORTON_BITS + 1, 0);
+    for (const OcttreeNode& node : octtree.get_nodes()) {
+        treeDepth = std::max<int>(treeDepth, node.depth);
+        splitAt[node.depth] += node.is_leaf() ? 0 : 1;
+    }
+
+    std::vector<QVector3D> deepCorners;
+    std::vector<uint32_t> deepIndices;
+    std::vector<uint32_t> deepEnds;
+    octtree.get_octtree_wireframe(treeDepth + 2, deepCorners, deepIndices, deepEnds);
+    // the level below the deepest leaves has no cubes
+    TEST_CHECK(deepEnds.size() == static_cast<size_t>(treeDepth) + 2 && deepEnds[treeDepth + 1] == deepEnds[treeDepth]);
+    TEST_CHECK(deepCorners.size() * 3 == deepIndices.size() && deepEnds.back() == deepIndices.size());
+    size_t cubes = 1;
+    for (int depth = 0; depth <= treeDepth; ++depth) {
+        if (depth > 0) {
+            cubes += 8 * splitAt[depth - 1];
+        }
+        TEST_CHECK(deepEnds[depth] == 24 * cubes);
+        const float length = octtree.length() / static_cast<float>(1 << depth);
+        for (uint32_t i = depth == 0 ? 0 : deepEnds[depth - 1]; i < deepEnds[depth]; i += 2) {
+            TEST_CHECK(deepIndices[i] < deepCorners.size() && deepIndices[i + 1] < deepCorners.size());
+            const QVector3D edge = deepCorners[deepIndices[i + 1]] - deepCorners[deepIndices[i]];
+            const int axis = edge.x() != 0 ? 0 : edge.y() != 0 ? 1 : 2;
+            TEST_CHECK(nearlyEqual(edge[axis], length) && edge.lengthSquared() == edge[axis] * edge[axis]);
+        }
+    }
+
+    std::vector<QVector3D> corners;
+    std::vector<uint32_t> indices;
+    std::vector<uint32_t> ends;
+    for (int depth = 0; depth <= treeDepth; ++depth) {
+        octtree.get_octtree_wireframe(depth, corners, indices, ends);
+        TEST_CHECK(ends.size() == static_cast<size_t>(depth) + 1);
+        TEST_CHECK(std::equal(ends.begin(), ends.end(), deepEnds.begin()));
+        TEST_CHECK(std::equal(indices.begin(), indices.end(), deepIndices.begin()) && indices.size() == ends.back());
+        TEST_CHECK(std::equal(corners.begin(), corners.end(), deepCorners.begin()));
+    }
+    Octtree empty;
+    empty.get_octtree_wireframe(4, corners, indices, ends);
+    TEST_CHECK(corners.empty() && indices.empty() && ends.empty());
+    std::printf("  %d levels, %zu cubes, every depth a prefix of the deepest\n", treeDepth + 1, cubes);
+    return true;
+}
+
+// a cloud with NaN and infinite points, reordered along the Morton curve after the build as
+// the loader does. knn and pick must return the rows of the reordered cloud
+bool testOcttreeNonFinite()
+{
+    PointCloud bunny;
+    TEST_CHECK(bunny.loadPLY(testData("bunny.ply")));
+    PointCloud cloud;
+    TEST_CHECK(cloud.loadPLY(writeTestPly("test_non_finite.ply", nonFinitePoints(bunny))));
+    Octtree octtree;
+    TEST_CHECK(octtree.build(cloud));
+    TEST_CHECK(octtree.get_rows().size() == bunny.getCount() && cloud.getCount() > bunny.getCount());
+    cloud.reorderMorton();
+    octtree.renumber_rows(cloud.getOriginalRows());
+    octtree.build_samples();
+
+    const std::vector<QVector3D> queries = testQueries(bunny, 200);
+    std::vector<OcttreeNeighbour> found;
+    for (const QVector3D& query : queries) {
+        const std::vector<std::pair<float, uint32_t>> all = bruteForce(cloud, query);
+        octtree.knn(query, 8, found);
+        TEST_CHECK(found.size() == 8);
+        for (size_t j = 0; j < found.size(); ++j) {
+            TEST_CHECK(nearlyEqual(found[j].distance, std::sqrt(all[j].first)));
+            TEST_CHECK(nearlyEqual(found[j].distance, (cloud.getPoint(found[j].row) - query).length()));
+        }
+    }
+
+    // rays from outside the cloud at its points, the nearest point in the cone by a scan
+    const float size = (cloud.getMax() - cloud.getMin()).length();
+    const float radius = size * 0.002f;
+    int hits = 0;
+    for (size_t q = 0; q < queries.size(); q += 3) {
+        const QVector3D origin = queries[q] + size * QVector3D(0.3f, 0.5f, 2.0f);
+        const QVector3D ray = (queries[q] - origin).normalized();
+        float best = std::numeric_limits<float>::max();
+        for (size_t i = 0; i < cloud.getCount(); ++i) {
+            const QVector3D to = cloud.getPoint(i) - origin;
+            const float t = QVector3D::dotProduct(to, ray);
+            if (std::isfinite(t) && t >= 0 && to.lengthSquared() - t * t <= radius * radius) {
+                best = std::min(best, t);
+            }
+        }
+        OcttreeNeighbour hit;
+        QVector3D point;
+        TEST_CHECK(octtree.pick(origin, ray, radius, 0, hit, point));
+        TEST_CHECK(nearlyEqual(hit.distance, best));
+        TEST_CHECK(cloud.getPoint(hit.row) == point);
+        ++hits;
+    }
+    std::printf("  %zu points, %zu of them not finite, knn and %d picks as brute force after the reorder\n",
+                cloud.getCount(), cloud.getCount() - bunny.getCount(), hits);
+    return true;
+}
@@ -0,0 +1,168 @@
+#include "tests.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "parallel.h"
+#include "pointcloud.h"
+
+// loadPLY of the file, false if it throws
+static bool loads(PointCloud& cloud, const QString& path)
+{
+    try {
+        return cloud.loadPLY(path);
+    } catch (const std::runtime_error&) {
+        return false;
+    }
+}
+
+// a small ascii ply with plus signs and without a newline after the last line loads as written,
+// a line with a value missing and a file with a row missing are broken, and the parallel parse
+// of a body of several pieces gives the serial one
+bool testPlyAscii()
+{
+    const std::string header = "ply\nformat ascii 1.0\nelement vertex 3\nproperty float x\nproperty float y\n"
+                               "property float z\nproperty uchar red\nend_header\n";
+    PointCloud cloud;
+    TEST_CHECK(cloud.loadPLY(writeTestFile("test_ply_ascii.ply",
+                                           header + "+1.5 -2 +0.25 +7\r\n0 1e+2 -1e-1 8\n+3 +4 +5 +9")));
+    TEST_CHECK(cloud.getCount() == 3);
+    TEST_CHECK(cloud.getPoint(0) == QVector3D(1.5f, -2, 0.25f));
+    TEST_CHECK(cloud.getPoint(1) == QVector3D(0, 100, -0.1f));
+    TEST_CHECK(cloud.getPoint(2) == QVector3D(3, 4, 5));
+    const PointColumn* red = cloud.getColumn("red");
+    TEST_CHECK(red && red->data.size() == 3);
+    TEST_CHECK(red->data[0] == 7 && red->data[1] == 8 && red->data[2] == 9);
+    TEST_CHECK(cloud.getMin() == QVector3D(0, -2, -0.1f) && cloud.getMax() == QVector3D(3, 100, 5));
+
+    // the last line ends in the middle of a point, or there is no third line
+    TEST_CHECK(!loads(cloud, writeTestFile("test_ply_ascii_truncated.ply", header + "1 2 3 4\n5 6 7 8\n9 10")));
+    TEST_CHECK(cloud.getCount() == 0);
+    TEST_CHECK(!loads(cloud, writeTestFile("test_ply_ascii_missing.ply", header + "1 2 3 4\n5 6 7 8\n")));
+    TEST_CHECK(cloud.getCount() == 0);
+
+    // about 4 MB of lines of different lengths, so the pieces start inside lines
+    const size_t count = 150000;
+    std::string body;
+    std::vector<float> expected;
+    char line[128];
+    uint32_t state = 12345;
+    for (size_t i = 0; i < count; ++i) {
+        float xyz[3];
+        for (float& value : xyz) {
+            state = state * 1664525u + 1013904223u;
+            value = (static_cast<int>(state >> 8) - (1 << 23)) / static_cast<float>(1 << (state % 20));
+        }
+        std::snprintf(line, sizeof(line), "%s%.9g %.7g %+.8g %u\n", i % 3 == 0 && xyz[0] >= 0 ? "+" : "",
+                      xyz[0], xyz[1], xyz[2], static_cast<unsigned>(i % 256));
+        body += line;
+        float parsed[3];
+        char* p = line + (line[0] == '+' ? 1 : 0);
+        for (float& value : parsed) {
+            value = std::strtof(p, &p);
+        }
+        expected.insert(expected.end(), parsed, parsed + 3);
+    }
+    const QString path = writeTestFile("test_ply_ascii_large.ply",
+            "ply\nformat ascii 1.0\nelement vertex " + std::to_string(count) + "\nproperty float x\n"
+            "property float y\nproperty float z\nproperty uchar red\nend_header\n" + body);
+
+    PointCloud serial;
+    workerLimit() = 1;
+    const bool serialLoaded = loads(serial, path);
+    workerLimit() = 0;
+    TEST_CHECK(serialLoaded && serial.getCount() == count);
+    for (size_t i = 0; i < count; ++i) {
+        const QVector3D point = serial.getPoint(i);
+        TEST_CHECK(point.x() == expected[3 * i] && point.y() == expected[3 * i + 1]
+                   && point.z() == expected[3 * i + 2]);
+        TEST_CHECK(serial.getColumn("red")->data[i] == i % 256);
+    }
+    for (unsigned workers : { 2u, 3u, 8u }) {
+        PointCloud parallel;
+        workerLimit() = workers;
+        const bool parallelLoaded = loads(parallel, path);
+        workerLimit() = 0;
+        TEST_CHECK(parallelLoaded && parallel.getCount() == count);
+        for (size_t i = 0; i < count; ++i) {
+            TEST_CHECK(parallel.getPoint(i) == serial.getPoint(i));
+        }
+        TEST_CHECK(parallel.getColumn("red")->data == serial.getColumn("red")->data);
+        TEST_CHECK(parallel.getMin() == serial.getMin() && parallel.getMax() == serial.getMax());
+    }
+    std::printf("  plus signs and a last line without newline load, truncated and missing rows throw, "
+                "%zu rows on 2, 3 and 8 threads as on 1\n", count);
+    return true;
+}
+
+// appends the bytes of value to a binary little endian body
+template <typename T>
+static void appendBinary(std::string& body, T value)
+{
+    body.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// faces behind other elements are read into the triangles of their polygons, as ascii and as
+// binary, directly behind the vertices as well, and an element cut off before the faces throws
+bool testPlyFaces()
+{
+    const std::vector<uint32_t> expected = { 0, 1, 2, 0, 2, 3, 3, 2, 1 };
+    const std::string vertices = "element vertex 4\nproperty float x\nproperty float y\nproperty float z\n";
+    const std::string between = "element edge 2\nproperty int vertex1\nproperty uchar vertex2\n"
+                                "element material 1\nproperty list uchar float weights\nproperty short id\n";
+    const std::string faces = "element face 2\nproperty uchar flags\nproperty list uchar int vertex_indices\n";
+    const std::string after = "element camera 1\nproperty float view_x\n";
+
+    const std::string asciiVertices = "0 0 0\n1 0 0\n1 1 0\n0 1 0\n";
+    const std::string asciiBetween = "0 1\n2 3\n3 0.5 0.25 +1 7\n";
+    const std::string asciiFaces = "1 4 0 1 2 3\n0 3 3 2 1\n";
+    PointCloud cloud;
+    TEST_CHECK(cloud.loadPLY(writeTestFile("test_ply_faces.ply",
+            "ply\nformat ascii 1.0\n" + vertices + between + faces + after + "end_header\n"
+            + asciiVertices + asciiBetween + asciiFaces + "2\n")));
+    TEST_CHECK(cloud.getCount() == 4 && cloud.getFaces() == expected);
+    TEST_CHECK(cloud.loadPLY(writeTestFile("test_ply_faces_direct.ply",
+            "ply\nformat ascii 1.0\n" + vertices + faces + "end_header\n" + asciiVertices + asciiFaces)));
+    TEST_CHECK(cloud.getCount() == 4 && cloud.getFaces() == expected);
+    TEST_CHECK(!loads(cloud, writeTestFile("test_ply_faces_truncated.ply",
+            "ply\nformat ascii 1.0\n" + vertices + between + faces + "end_header\n"
+            + asciiVertices + "0 1\n2 3\n3 0.5 0.25\n" + asciiFaces)));
+
+    std::string binary;
+    for (float value : { 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 1.f, 1.f, 0.f, 0.f, 1.f, 0.f }) {
+        appendBinary(binary, value);
+    }
+    appendBinary<int32_t>(binary, 0);
+    appendBinary<uint8_t>(binary, 1);
+    appendBinary<int32_t>(binary, 2);
+    appendBinary<uint8_t>(binary, 3);
+    appendBinary<uint8_t>(binary, 3);
+    for (float weight : { 0.5f, 0.25f, 1.f }) {
+        appendBinary(binary, weight);
+    }
+    appendBinary<int16_t>(binary, 7);
+    appendBinary<uint8_t>(binary, 1);
+    appendBinary<uint8_t>(binary, 4);
+    for (int32_t index : { 0, 1, 2, 3 }) {
+        appendBinary(binary, index);
+    }
+    appendBinary<uint8_t>(binary, 0);
+    appendBinary<uint8_t>(binary, 3);
+    for (int32_t index : { 3, 2, 1 }) {
+        appendBinary(binary, index);
+    }
+    appendBinary(binary, 2.f);
+    TEST_CHECK(cloud.loadPLY(writeTestFile("test_ply_faces_binary.ply",
+            "ply\nformat binary_little_endian 1.0\n" + vertices + between + faces + after + "end_header\n"
+            + binary)));
+    TEST_CHECK(cloud.getCount() == 4 && cloud.getFaces() == expected);
+    // a file that ends inside the edges
+    TEST_CHECK(!loads(cloud, writeTestFile("test_ply_faces_binary_truncated.ply",
+            "ply\nformat binary_little_endian 1.0\n" + vertices + between + faces + "end_header\n"
+            + binary.substr(0, 12 * sizeof(float) + 3))));
+    std::printf("  a quad and a triangle behind two other elements, as ascii and binary\n");
+    return true;
+}
@@ -0,0 +1,119 @@
+#include "tests.h"
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "forest.h"
+#include "octtree.h"
+#include "pointblocks.h"
+#include "pointcloud.h"
+#include "tree.h"
+
+// everything the kernels decide for one cloud: the octtree and kd-tree searches, the forest
+// with a leaf budget and the raw kernel output on blocks of every length
+struct KernelResults
+{
+    std::vector<uint32_t> rows;
+    std::vector<float> distances;
+    std::vector<uint32_t> masks;
+};
+
+static void appendNeighbours(KernelResults& results, const std::vector<OcttreeNeighbour>& found)
+{
+    for (const OcttreeNeighbour& neighbour : found) {
+        results.rows.push_back(neighbour.row);
+        results.distances.push_back(neighbour.distance);
+    }
+}
+
+static KernelResults kernelResults(const PointCloud& cloud, const Octtree& octtree, const Tree& tree,
+                                   const Forest& forest, const std::vector<QVector3D>& queries)
+{
+    KernelResults results;
+    const float radius = (cloud.getMax() - cloud.getMin()).length() * 0.02f;
+    std::vector<OcttreeNeighbour> found;
+    octtree.knn_batch(queries, 8, found);
+    appendNeighbours(results, found);
+    std::vector<std::vector<OcttreeNeighbour>> lists;
+    octtree.radius_search_batch(queries, radius, lists);
+    for (const std::vector<OcttreeNeighbour>& list : lists) {
+        appendNeighbours(results, list);
+    }
+
+    std::vector<uint32_t> rows;
+    std::vector<float> distances;
+    std::vector<uint32_t> first;
+    tree.knn_batch(queries, 8, rows, distances);
+    results.rows.insert(results.rows.end(), rows.begin(), rows.end());
+    results.distances.insert(results.distances.end(), distances.begin(), distances.end());
+    tree.radius_search_batch(queries, radius, first, rows, distances);
+    results.rows.insert(results.rows.end(), rows.begin(), rows.end());
+    results.distances.insert(results.distances.end(), distances.begin(), distances.end());
+    std::vector<TreeRange> ranges;
+    for (const QVector3D& query : queries) {
+        tree.box_search(query - QVector3D(radius, radius, radius), query + QVector3D(radius, radius, radius), ranges);
+        for (const TreeRange& range : ranges) {
+            results.rows.push_back(range.first);
+            results.rows.push_back(range.count);
+        }
+    }
+    TreeApproximation approximation;
+    approximation.max_leaves = 4;
+    forest.knn_batch(queries, 8, rows, distances, approximation);
+    results.rows.insert(results.rows.end(), rows.begin(), rows.end());
+    results.distances.insert(results.distances.end(), distances.begin(), distances.end());
+
+    // every start and length of a block, so the masks of the partial SIMD blocks are checked
+    const PointBlocks& points = tree.get_points();
+    float out[POINT_BLOCK];
+    for (size_t q = 0; q < 20; ++q) {
+        const size_t start = q * points.size() / 20;
+        for (uint32_t count = 1; count <= POINT_BLOCK && start + count <= points.size(); ++count) {
+            results.masks.push_back(points.squaredDistances(start, count, queries[q], radius * radius, out));
+            results.distances.insert(results.distances.end(), out, out + count);
+            results.masks.push_back(points.inside(start, count, queries[q] - QVector3D(radius, radius, radius),
+                                                  queries[q] + QVector3D(radius, radius, radius)));
+        }
+    }
+    return results;
+}
+
+// the scalar, SSE and AVX2 kernels of PointBlocks give the same neighbours and bit for bit
+// the same distances, on the kernels the cpu has
+bool testPointBlocksKernels()
+{
+    const std::string picked = PointBlocks::kernelName();
+    for (const char* fileName : { "bunny.ply", "fandisk.ply", "cube.ply" }) {
+        PointCloud cloud;
+        TEST_CHECK(cloud.loadPLY(testData(fileName)));
+        Octtree octtree;
+        octtree.build(cloud);
+        Tree tree;
+        TEST_CHECK(tree.build(cloud));
+        Forest forest(4);
+        forest.build(cloud);
+        const std::vector<QVector3D> queries = testQueries(cloud, 300);
+
+        TEST_CHECK(PointBlocks::setKernels("scalar"));
+        const KernelResults scalar = kernelResults(cloud, octtree, tree, forest, queries);
+        for (const char* name : { "sse", "avx2" }) {
+            if (!PointBlocks::setKernels(name)) {
+                std::printf("  %s: no %s kernels on this cpu\n", fileName, name);
+                continue;
+            }
+            const KernelResults results = kernelResults(cloud, octtree, tree, forest, queries);
+            TEST_CHECK(results.rows == scalar.rows && results.masks == scalar.masks);
+            TEST_CHECK(results.distances.size() == scalar.distances.size());
+            TEST_CHECK(std::memcmp(results.distances.data(), scalar.distances.data(),
+                                   scalar.distances.size() * sizeof(float)) == 0);
+            std::printf("  %s: %s and scalar agree on %zu rows and %zu distances\n", fileName, name,
+                        scalar.rows.size(), scalar.distances.size());
+        }
+        PointBlocks::setKernels(picked.c_str());
+    }
+    TEST_CHECK(std::string(PointBlocks::kernelName()) == picked);
+    TEST_CHECK(!PointBlocks::setKernels("avx512"));
+    return true;
+}
@@ -0,0 +1,91 @@
+#include "tests.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <random>
+#include <string>
+
+#include "pointcloud.h"
+
+QString testData(const char* fileName)
+{
+    return QString(TEST_DATA_DIR) + "/" + fileName;
+}
+
+std::vector<QVector3D> testQueries(const PointCloud& cloud, size_t count)
+{
+    std::vector<QVector3D> queries;
+    queries.reserve(count);
+    const QVector3D extent = cloud.getMax() - cloud.getMin();
+    const float jitter = extent.length() * 0.01f;
+    std::mt19937 random(7);
+    std::uniform_real_distribution<float> unit(-0.5f, 1.5f);
+    std::normal_distribution<float> normal(0.0f, jitter);
+    for (size_t i = 0; i < count; ++i) {
+        const QVector3D point = cloud.getPoint(random() % cloud.getCount());
+        if (i % 3 == 0) {
+            queries.push_back(point);
+        } else if (i % 3 == 1) {
+            queries.push_back(point + QVector3D(normal(random), normal(random), normal(random)));
+        } else {
+            queries.push_back(cloud.getMin() + QVector3D(unit(random) * extent.x(), unit(random) * extent.y(),
+                                                         unit(random) * extent.z()));
+        }
+    }
+    return queries;
+}
+
+std::vector<std::pair<float, uint32_t>> bruteForce(const PointCloud& cloud, const QVector3D& query)
+{
+    std::vector<std::pair<float, uint32_t>> all;
+    all.reserve(cloud.getCount());
+    for (size_t i = 0; i < cloud.getCount(); ++i) {
+        const QVector3D d = cloud.getPoint(i) - query;
+        const float distance2 = d.x() * d.x() + d.y() * d.y() + d.z() * d.z();
+        if (std::isfinite(distance2)) {
+            all.push_back({ distance2, static_cast<uint32_t>(i) });
+        }
+    }
+    std::sort(all.begin(), all.end());
+    return all;
+}
+
+bool nearlyEqual(float a, float b)
+{
+    return std::fabs(a - b) <= 1e-5f * std::max(std::fabs(a), std::fabs(b)) + 1e-12f;
+}
+
+QString writeTestFile(const char* fileName, const std::string& contents)
+{
+    std::ofstream os(fileName, std::ios::out | std::ios::binary);
+    os.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+    return QString(fileName);
+}
+
+QString writeTestPly(const char* fileName, const std::vector<QVector3D>& points)
+{
+    std::string contents = "ply\nformat binary_little_endian 1.0\nelement vertex " + std::to_string(points.size())
+            + "\nproperty float x\nproperty float y\nproperty float z\nend_header\n";
+    for (const QVector3D& point : points) {
+        const float xyz[3] = { point.x(), point.y(), point.z() };
+        contents.append(reinterpret_cast<const char*>(xyz), sizeof(xyz));
+    }
+    return writeTestFile(fileName, contents);
+}
+
+std::vector<QVector3D> nonFinitePoints(const PointCloud& cloud)
+{
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    const float inf = std::numeric_limits<float>::infinity();
+    std::vector<QVector3D> points;
+    for (size_t i = 0; i < cloud.getCount(); ++i) {
+        points.push_back(cloud.getPoint(i));
+        if (i % 97 == 0) {
+            points.push_back(QVector3D(nan, 0, 0));
+        } else if (i % 97 == 50) {
+            points.push_back(QVector3D(0, i % 2 ? inf : -inf, nan));
+        }
+    }
+    return points;
+}
@@ -0,0 +1,63 @@
+#ifndef TESTS_H
+#define TESTS_H
+
+#include <QString>
+#include <QVector3D>
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+class PointCloud;
+
+// fails the running test with the file and line if condition is false
+#define TEST_CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::printf("  %s:%d: %s\n", __FILE__, __LINE__, #condition); \
+            return false; \
+        } \
+    } while (false)
+
+// a ply of the data directory next to the exercises
+QString testData(const char* fileName);
+
+// count queries for the searches: every few points of the cloud, the same points moved a
+// little and points in and around the AABB, the same for the same cloud
+std::vector<QVector3D> testQueries(const PointCloud& cloud, size_t count);
+// squared distances and rows of all finite points of the cloud to query, nearest first
+std::vector<std::pair<float, uint32_t>> bruteForce(const PointCloud& cloud, const QVector3D& query);
+// a and b equal up to a relative error of a few float roundings
+bool nearlyEqual(float a, float b);
+
+// writes contents to a file of that name in the working directory, returns its path
+QString writeTestFile(const char* fileName, const std::string& contents);
+// the points as a binary little endian ply with x, y and z only
+QString writeTestPly(const char* fileName, const std::vector<QVector3D>& points);
+// the points of the cloud with a NaN or infinite point after every 50th or so
+std::vector<QVector3D> nonFinitePoints(const PointCloud& cloud);
+
+// every test prints what it measured to std::cout and returns false if a check failed
+bool testOcttreeRepaintMemory();
+bool testOcttreeParallelBuild();
+bool testOcttreeQueries();
+bool testOcttreeLimits();
+bool testOcttreeInsertRemove();
+bool testOcttreeSerialize();
+bool testOcttreeLod();
+bool testOcttreeFrustum();
+bool testOcttreeWireframe();
+bool testOcttreeNonFinite();
+bool testTreeKnn();
+bool testTreeNonFinite();
+bool testTreeRangeQueries();
+bool testForestKnn();
+bool testMortonCodes();
+bool testPointBlocksKernels();
+bool testPlyAscii();
+bool testPlyFaces();
+bool testCacheRoundTrip();
+
+#endif // TESTS_H
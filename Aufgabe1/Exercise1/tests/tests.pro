@@ -0,0 +1,46 @@
+# ----------------------------------------------------
+# Checks of the loaders and spatial indexes, built next to Exercise1.
+# Run as: tests [name], or make check. Exits with 1 if a check fails.
+# ----------------------------------------------------
+
+TEMPLATE = app
+TARGET = tests
+QT += core gui
+CONFIG += console c++17 testcase
+CONFIG -= app_bundle
+INCLUDEPATH += .. ../bench
+DEPENDPATH += .. ../bench
+DEFINES += TEST_DATA_DIR=\\\"$$PWD/../../data\\\"
+win32: LIBS += -lpsapi
+
+HEADERS += tests.h \
+    ../bench/bench.h \
+    ../cloudcache.h \
+    ../forest.h \
+    ../morton.h \
+    ../octtree.h \
+    ../parallel.h \
+    ../plyheader.h \
+    ../plystreamreader.h \
+    ../pointblocks.h \
+    ../pointcloud.h \
+    ../tree.h
+SOURCES += main.cpp \
+    tests.cpp \
+    testcache.cpp \
+    testforest.cpp \
+    testmorton.cpp \
+    testoctree.cpp \
+    testply.cpp \
+    testpointblocks.cpp \
+    testtree.cpp \
+    ../bench/bench.cpp \
+    ../cloudcache.cpp \
+    ../forest.cpp \
+    ../morton.cpp \
+    ../octtree.cpp \
+    ../plyheader.cpp \
+    ../plystreamreader.cpp \
+    ../pointblocks.cpp \
+    ../pointcloud.cpp \
+    ../tree.cpp
@@ -0,0 +1,192 @@
+#include "tests.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <set>
+#include <vector>
+
+#include "pointcloud.h"
+#include "tree.h"
+
+// the rows are distinct and lie at the distances next to them, which are those of brute force
+static bool sameAsBruteForce(const PointCloud& cloud, const QVector3D& query,
+                             const std::vector<std::pair<float, uint32_t>>& all,
+                             const uint32_t* rows, const float* distances, size_t k)
+{
+    std::set<uint32_t> seen(rows, rows + k);
+    TEST_CHECK(seen.size() == k);
+    for (size_t j = 0; j < k; ++j) {
+        TEST_CHECK(nearlyEqual(distances[j], std::sqrt(all[j].first)));
+        TEST_CHECK(nearlyEqual(distances[j], (cloud.getPoint(rows[j]) - query).length()));
+    }
+    return true;
+}
+
+// exact knn of the kd-tree against the distances to all points, single, batched and for all
+// points of the cloud
+bool testTreeKnn()
+{
+    for (const char* fileName : { "bunny.ply", "fandisk.ply", "cube.ply" }) {
+        PointCloud cloud;
+        TEST_CHECK(cloud.loadPLY(testData(fileName)));
+        Tree tree;
+        TEST_CHECK(tree.build(cloud));
+        const std::vector<QVector3D> queries = testQueries(cloud, 200);
+
+        std::vector<uint32_t> rows;
+        std::vector<float> distances;
+        for (size_t q = 0; q < queries.size(); ++q) {
+            const std::vector<std::pair<float, uint32_t>> all = bruteForce(cloud, queries[q]);
+            const size_t k = std::min<size_t>(1 + q % 40, cloud.getCount());
+            tree.knn(queries[q], static_cast<int>(k), rows, distances);
+            TEST_CHECK(rows.size() == k && distances.size() == k);
+            TEST_CHECK(sameAsBruteForce(cloud, queries[q], all, rows.data(), distances.data(), k));
+        }
+
+        // the batch and the pass over all points give the single results
+        const int k = 8;
+        const size_t per = std::min<size_t>(k, cloud.getCount());
+        std::vector<uint32_t> batchRows;
+        std::vector<float> batchDistances;
+        tree.knn_batch(queries, k, batchRows, batchDistances);
+        TEST_CHECK(batchRows.size() == queries.size() * per);
+        for (size_t q = 0; q < queries.size(); ++q) {
+            tree.knn(queries[q], k, rows, distances);
+            for (size_t j = 0; j < per; ++j) {
+                TEST_CHECK(batchRows[q * per + j] == rows[j] && batchDistances[q * per + j] == distances[j]);
+            }
+        }
+        tree.knn_all(k, batchRows, batchDistances);
+        TEST_CHECK(batchRows.size() == cloud.getCount() * per);
+        for (size_t row = 0; row < cloud.getCount(); row += 97) {
+            const std::vector<std::pair<float, uint32_t>> all = bruteForce(cloud, cloud.getPoint(row));
+            TEST_CHECK(sameAsBruteForce(cloud, cloud.getPoint(row), all, &batchRows[row * per],
+                                        &batchDistances[row * per], per));
+        }
+        std::printf("  %s: %zu queries with k = 1 to 40, batch and knn_all as brute force\n",
+                    fileName, queries.size());
+    }
+    return true;
+}
+
+// NaN and infinite points stay out of the kd-tree, so the splits order all points of a node
+// and the exact searches find every finite neighbour, before and after a Morton reorder
+bool testTreeNonFinite()
+{
+    PointCloud bunny;
+    TEST_CHECK(bunny.loadPLY(testData("bunny.ply")));
+    PointCloud cloud;
+    TEST_CHECK(cloud.loadPLY(writeTestPly("test_tree_non_finite.ply", nonFinitePoints(bunny))));
+    Tree tree;
+    TEST_CHECK(tree.build(cloud));
+    TEST_CHECK(tree.get_points().size() == bunny.getCount());
+    for (const TreeNode& node : tree.get_nodes()) {
+        if (node.is_leaf()) {
+            continue;
+        }
+        const TreeNode& right = tree.get_nodes()[node.right];
+        for (uint32_t i = node.first; i < right.first; ++i) {
+            TEST_CHECK(tree.get_points()[i][node.axis] <= node.split);
+        }
+        for (uint32_t i = right.first; i < node.first + node.count; ++i) {
+            TEST_CHECK(tree.get_points()[i][node.axis] >= node.split);
+        }
+    }
+
+    const std::vector<QVector3D> queries = testQueries(bunny, 200);
+    const float radius = (bunny.getMax() - bunny.getMin()).length() * 0.01f;
+    std::vector<uint32_t> rows;
+    std::vector<float> distances;
+    for (int pass = 0; pass < 2; ++pass) {
+        if (pass == 1) {
+            cloud.reorderMorton();
+            tree.renumber_rows(cloud.getOriginalRows());
+        }
+        for (const QVector3D& query : queries) {
+            const std::vector<std::pair<float, uint32_t>> all = bruteForce(cloud, query);
+            tree.knn(query, 8, rows, distances);
+            TEST_CHECK(rows.size() == 8);
+            TEST_CHECK(sameAsBruteForce(cloud, query, all, rows.data(), distances.data(), 8));
+            tree.radius_search(query, radius, rows, distances);
+            const std::set<uint32_t> inside(rows.begin(), rows.end());
+            TEST_CHECK(inside.size() == rows.size());
+            for (const std::pair<float, uint32_t>& point : all) {
+                if (std::sqrt(point.first) >= radius * (1 - 1e-5f)) {
+                    break;
+                }
+                TEST_CHECK(inside.count(point.second) == 1);
+            }
+        }
+    }
+    std::printf("  %zu points, %zu of them not finite, knn and radius as brute force before and after the reorder\n",
+                cloud.getCount(), cloud.getCount() - bunny.getCount());
+    return true;
+}
+
+// box_search against a scan of all points for boxes of many sizes, the ranges are in order and
+// merged, box_count is the sum of the ranges and radius_search_batch gives the single searches
+bool testTreeRangeQueries()
+{
+    for (const char* fileName : { "bunny.ply", "fandisk.ply", "cube.ply" }) {
+        PointCloud cloud;
+        TEST_CHECK(cloud.loadPLY(testData(fileName)));
+        Tree tree;
+        TEST_CHECK(tree.build(cloud));
+        const std::vector<QVector3D> queries = testQueries(cloud, 200);
+        const QVector3D extent = cloud.getMax() - cloud.getMin();
+
+        std::vector<TreeRange> ranges;
+        size_t found = 0;
+        for (size_t q = 0; q <= queries.size(); ++q) {
+            // the last box holds the whole cloud
+            const QVector3D half = extent * (q < queries.size() ? 0.002f * (1 + q % 50) : 1.0f);
+            const QVector3D center = q < queries.size() ? queries[q] : cloud.getMin() + extent * 0.5f;
+            const QVector3D min = center - half;
+            const QVector3D max = center + half;
+            std::set<uint32_t> expected;
+            for (uint32_t row = 0; row < cloud.getCount(); ++row) {
+                const QVector3D p = cloud.getPoint(row);
+                if (p.x() >= min.x() && p.y() >= min.y() && p.z() >= min.z()
+                        && p.x() <= max.x() && p.y() <= max.y() && p.z() <= max.z()) {
+                    expected.insert(row);
+                }
+            }
+
+            tree.box_search(min, max, ranges);
+            std::set<uint32_t> rows;
+            size_t count = 0;
+            for (size_t i = 0; i < ranges.size(); ++i) {
+                TEST_CHECK(ranges[i].count > 0);
+                TEST_CHECK(ranges[i].first + ranges[i].count <= tree.get_points().size());
+                TEST_CHECK(i == 0 || ranges[i - 1].first + ranges[i - 1].count < ranges[i].first);
+                for (uint32_t j = ranges[i].first; j < ranges[i].first + ranges[i].count; ++j) {
+                    rows.insert(tree.get_rows()[j]);
+                }
+                count += ranges[i].count;
+            }
+            TEST_CHECK(rows == expected);
+            TEST_CHECK(count == expected.size());
+            TEST_CHECK(tree.box_count(min, max) == count);
+            found += count;
+        }
+
+        const float radius = extent.length() * 0.02f;
+        std::vector<uint32_t> first;
+        std::vector<uint32_t> batchRows;
+        std::vector<float> batchDistances;
+        tree.radius_search_batch(queries, radius, first, batchRows, batchDistances);
+        TEST_CHECK(first.size() == queries.size() + 1 && first.front() == 0);
+        TEST_CHECK(first.back() == batchRows.size() && batchRows.size() == batchDistances.size());
+        std::vector<uint32_t> rows;
+        std::vector<float> distances;
+        for (size_t q = 0; q < queries.size(); ++q) {
+            tree.radius_search(queries[q], radius, rows, distances);
+            TEST_CHECK(first[q + 1] - first[q] == rows.size());
+            TEST_CHECK(std::equal(rows.begin(), rows.end(), batchRows.begin() + first[q]));
+            TEST_CHECK(std::equal(distances.begin(), distances.end(), batchDistances.begin() + first[q]));
+        }
+        std::printf("  %s: %zu boxes with %zu points as a scan, %zu points in %zu radius searches as single\n",
+                    fileName, queries.size() + 1, found, batchRows.size(), queries.size());
+    }
+    return true;
+}
@@ -1,6 +1,659 @@
 #include "tree.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "parallel.h"
 
-Tree::Tree()
+// below this many points the subtrees are not worth the threads
+static const size_t PARALLEL_TREE_POINTS = 1 << 16;
+
+Tree::Tree(int leaf_capacity, uint32_t seed)
+    : _leaf_capacity(std::max(1, leaf_capacity)),
+      _seed(seed)
+{}
+
+static bool is_finite(const QVector3D& point)
+{
+    return std::isfinite(point.x()) && std::isfinite(point.y()) && std::isfinite(point.z());
+}
+
+// a random bit per node of a seeded tree, the same for any number of threads
+static bool random_bit(uint32_t seed, uint32_t node)
+{
+    uint32_t x = seed ^ (node * 0x9e3779b9u);
+    x ^= x >> 16;
+    x *= 0x85ebca6bu;
+    x ^= x >> 13;
+    x *= 0xc2b2ae35u;
+    x ^= x >> 16;
+    return (x & 1) != 0;
+}
+
+size_t Tree::subtree_nodes(size_t count) const
+{
+    return std::lower_bound(_subtree_nodes.begin(), _subtree_nodes.end(), std::make_pair(count, size_t(0)))->second;
+}
+
+bool Tree::build(const PointCloud& cloud, bool parallel, const std::atomic<bool>* cancel)
+{
+    const size_t capacity = static_cast<size_t>(_leaf_capacity);
+    _nodes.clear();
+    _points.clear();
+    _rows.clear();
+    _subtree_nodes.clear();
+    _min = cloud.getMin();
+    _max = cloud.getMax();
+
+    std::vector<BuildPoint> build_points(cloud.getCount());
+    parallelBlocks(build_points.size(), workerCount(), [&](size_t begin, size_t end, unsigned) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            build_points[i] = { cloud.getPoint(i), static_cast<uint32_t>(i) };
+        }
+    });
+    // NaN is not ordered on a split axis and infinite points have no cell, both are left out
+    // of the tree like in the octtree
+    build_points.erase(std::remove_if(build_points.begin(), build_points.end(),
+                                      [](const BuildPoint& point) { return !is_finite(point.point); }),
+                       build_points.end());
+    const size_t count = build_points.size();
+    if (count == 0)
+    {
+        return true;
+    }
+
+    // the subtrees of a level have at most two sizes, so the layout of the whole tree follows
+    // from the node counts of a few sizes, smaller ones first
+    std::vector<size_t> level(1, count);
+    std::vector<size_t> sizes(level);
+    while (!level.empty())
+    {
+        std::vector<size_t> below;
+        for (size_t size : level)
+        {
+            if (size > capacity)
+            {
+                below.push_back(size / 2);
+                below.push_back(size - size / 2);
+            }
+        }
+        std::sort(below.begin(), below.end());
+        below.erase(std::unique(below.begin(), below.end()), below.end());
+        sizes.insert(sizes.end(), below.begin(), below.end());
+        level.swap(below);
+    }
+    std::sort(sizes.begin(), sizes.end());
+    sizes.erase(std::unique(sizes.begin(), sizes.end()), sizes.end());
+    for (size_t size : sizes)
+    {
+        const size_t nodes = size <= capacity ? 1 : 1 + subtree_nodes(size / 2) + subtree_nodes(size - size / 2);
+        _subtree_nodes.push_back(std::make_pair(size, nodes));
+    }
+
+    // the upper levels are split on this thread until there are enough subtrees for all
+    // threads, every subtree writes its own part of the node array
+    _nodes.resize(subtree_nodes(count));
+    _cancel = cancel;
+    const Subtree root = { 0, 0, count, _min, _max, 0 };
+    if (parallel && count >= PARALLEL_TREE_POINTS && workerCount() > 1)
+    {
+        int split_depth = 0;
+        while ((size_t(1) << split_depth) < 8 * workerCount())
+        {
+            ++split_depth;
+        }
+        std::vector<Subtree> subtrees;
+        build_node(build_points, root, split_depth, &subtrees);
+        parallelFor(subtrees.size(), [&](size_t i) {
+            build_node(build_points, subtrees[i], -1, nullptr);
+        });
+    }
+    else
+    {
+        build_node(build_points, root, -1, nullptr);
+    }
+    _cancel = nullptr;
+    if (cancel && *cancel)
+    {
+        _nodes.clear();
+        _subtree_nodes.clear();
+        return false;
+    }
+
+    _points.resize(count);
+    _rows.resize(count);
+    parallelBlocks(count, workerCount(), [&](size_t begin, size_t end, unsigned) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            _points.set(i, build_points[i].point);
+            _rows[i] = build_points[i].row;
+        }
+    });
+    return true;
+}
+
+void Tree::build_node(std::vector<BuildPoint>& build_points, const Subtree& subtree, int split_depth,
+                      std::vector<Subtree>* subtrees)
+{
+    if (subtrees && subtree.depth == split_depth)
+    {
+        subtrees->push_back(subtree);
+        return;
+    }
+    if (_cancel && _cancel->load(std::memory_order_relaxed))
+    {
+        return;
+    }
+    const size_t count = subtree.end - subtree.begin;
+    TreeNode& node = _nodes[subtree.node];
+    node = { 0, static_cast<uint32_t>(subtree.begin), static_cast<uint32_t>(count), 0, 0,
+             static_cast<uint8_t>(subtree.depth) };
+    if (count <= static_cast<size_t>(_leaf_capacity))
+    {
+        return;
+    }
+
+    // median along the longest side of the cell, or one of the two longest of a seeded tree
+    const QVector3D extent = subtree.max - subtree.min;
+    int axis = extent.x() >= extent.y() ? (extent.x() >= extent.z() ? 0 : 2) : (extent.y() >= extent.z() ? 1 : 2);
+    if (_seed != 0 && random_bit(_seed, subtree.node))
+    {
+        const int a = (axis + 1) % 3;
+        const int b = (axis + 2) % 3;
+        axis = extent[a] >= extent[b] ? a : b;
+    }
+    const size_t middle = subtree.begin + count / 2;
+    std::nth_element(build_points.begin() + subtree.begin, build_points.begin() + middle, build_points.begin() + subtree.end,
+                     [axis](const BuildPoint& a, const BuildPoint& b) { return a.point[axis] < b.point[axis]; });
+    const float split = build_points[middle].point[axis];
+    node.split = split;
+    node.axis = static_cast<uint8_t>(axis);
+    node.right = static_cast<uint32_t>(subtree.node + 1 + subtree_nodes(count / 2));
+
+    Subtree left = subtree;
+    left.node = subtree.node + 1;
+    left.end = middle;
+    left.max[axis] = split;
+    left.depth = subtree.depth + 1;
+    Subtree right = subtree;
+    right.node = node.right;
+    right.begin = middle;
+    right.min[axis] = split;
+    right.depth = subtree.depth + 1;
+    build_node(build_points, left, split_depth, subtrees);
+    build_node(build_points, right, split_depth, subtrees);
+}
+
+void Tree::knn(const QVector3D& query, int k, std::vector<uint32_t>& rows, std::vector<float>& distances,
+               const TreeApproximation& approximation) const
+{
+    std::vector<SearchEntry> nodes;
+    std::vector<std::pair<float, uint32_t>> found;
+    const size_t per_query = std::min(static_cast<size_t>(std::max(0, k)), _points.size());
+    rows.resize(per_query);
+    distances.resize(per_query);
+    knn(query, per_query, rows.data(), distances.data(), approximation, nodes, found);
+}
+
+void Tree::knn_batch(const std::vector<QVector3D>& queries, int k, std::vector<uint32_t>& rows,
+                     std::vector<float>& distances, const TreeApproximation& approximation) const
+{
+    const size_t per_query = std::min(static_cast<size_t>(std::max(0, k)), _points.size());
+    rows.resize(queries.size() * per_query);
+    distances.resize(queries.size() * per_query);
+    parallelBlocks(queries.size(), workerCount(), [&](size_t begin, size_t end, unsigned) {
+        std::vector<SearchEntry> nodes;
+        std::vector<std::pair<float, uint32_t>> found;
+        for (size_t q = begin; q < end; ++q)
+        {
+            knn(queries[q], per_query, rows.data() + q * per_query, distances.data() + q * per_query, approximation,
+                nodes, found);
+        }
+    });
+}
+
+void Tree::knn_all(int k, std::vector<uint32_t>& rows, std::vector<float>& distances,
+                   const TreeApproximation& approximation) const
+{
+    const size_t per_query = std::min(static_cast<size_t>(std::max(0, k)), _points.size());
+    rows.resize(_points.size() * per_query);
+    distances.resize(_points.size() * per_query);
+    parallelBlocks(_points.size(), workerCount(), [&](size_t begin, size_t end, unsigned) {
+        std::vector<SearchEntry> nodes;
+        std::vector<std::pair<float, uint32_t>> found;
+        for (size_t i = begin; i < end; ++i)
+        {
+            const size_t at = _rows[i] * per_query;
+            knn(_points[i], per_query, rows.data() + at, distances.data() + at, approximation, nodes, found);
+        }
+    });
+}
+
+size_t Tree::knn(const QVector3D& query, size_t k, uint32_t* rows, float* distances,
+                 const TreeApproximation& approximation, std::vector<SearchEntry>& nodes,
+                 std::vector<std::pair<float, uint32_t>>& found) const
+{
+    k = std::min(k, _points.size());
+    if (k == 0)
+    {
+        return 0;
+    }
+
+    // nodes is a stack, or a heap with the nearest cell on top for a limited number of leaves,
+    // found a heap with the furthest point on top. The offset of a far child along the split
+    // axis becomes the distance of the query to the split plane, its squared distance changes
+    // by the same, so it is the distance to the cell without a loop over axes. Cells are
+    // compared to the k-th point shrunk by 1 + eps
+    const bool best_first = approximation.max_leaves > 0;
+    const float shrink = 1 / ((1 + approximation.eps) * (1 + approximation.eps));
+    auto nearer_entry = [](const SearchEntry& a, const SearchEntry& b) { return a.distance2 > b.distance2; };
+    int leaves = 0;
+    nodes.clear();
+    found.clear();
+    nodes.push_back({ 0, 0, QVector3D(0, 0, 0) });
+    while (!nodes.empty())
+    {
+        if (best_first)
+        {
+            std::pop_heap(nodes.begin(), nodes.end(), nearer_entry);
+        }
+        const SearchEntry entry = nodes.back();
+        nodes.pop_back();
+        if (found.size() == k && entry.distance2 > found.front().first * shrink)
+        {
+            if (best_first)
+            {
+                break;
+            }
+            continue;
+        }
+
+        // down to the leaf on the side of the query, the other children wait
+        uint32_t index = entry.node;
+        while (!_nodes[index].is_leaf())
+        {
+            const TreeNode& node = _nodes[index];
+            const float offset = query[node.axis] - node.split;
+            SearchEntry far = entry;
+            far.offset[node.axis] = offset;
+            far.distance2 = entry.distance2 - entry.offset[node.axis] * entry.offset[node.axis] + offset * offset;
+            if (offset <= 0)
+            {
+                far.node = node.right;
+                index = index + 1;
+            }
+            else
+            {
+                far.node = index + 1;
+                index = node.right;
+            }
+            if (found.size() < k || far.distance2 <= found.front().first * shrink)
+            {
+                nodes.push_back(far);
+                if (best_first)
+                {
+                    std::push_heap(nodes.begin(), nodes.end(), nearer_entry);
+                }
+            }
+        }
+
+        // only the points of a block nearer than the k-th at its start can enter the heap
+        const TreeNode& leaf = _nodes[index];
+        float block[POINT_BLOCK];
+        for (uint32_t first = leaf.first; first < leaf.first + leaf.count; first += POINT_BLOCK)
+        {
+            const uint32_t count = std::min(leaf.first + leaf.count - first, POINT_BLOCK);
+            const bool filling = found.size() < k;
+            uint32_t mask = _points.squaredDistances(first, count, query, filling ? 0 : found.front().first, block);
+            if (filling)
+            {
+                mask = blockMask(count);
+            }
+            while (mask != 0)
+            {
+                const int j = lowestBit(mask);
+                mask &= mask - 1;
+                const uint32_t i = first + j;
+                const float distance2 = block[j];
+                if (found.size() < k)
+                {
+                    found.push_back(std::make_pair(distance2, i));
+                    std::push_heap(found.begin(), found.end());
+                }
+                else if (distance2 < found.front().first)
+                {
+                    std::pop_heap(found.begin(), found.end());
+                    found.back() = std::make_pair(distance2, i);
+                    std::push_heap(found.begin(), found.end());
+                }
+            }
+        }
+        if (best_first && ++leaves >= approximation.max_leaves && found.size() == k)
+        {
+            break;
+        }
+    }
+
+    std::sort_heap(found.begin(), found.end());
+    for (size_t i = 0; i < found.size(); ++i)
+    {
+        rows[i] = _rows[found[i].second];
+        distances[i] = std::sqrt(found[i].first);
+    }
+    return found.size();
+}
+
+void Tree::radius_search(const QVector3D& query, float radius, std::vector<uint32_t>& rows,
+                         std::vector<float>& distances) const
+{
+    std::vector<SearchEntry> nodes;
+    radius_search(query, radius, rows, distances, nodes);
+}
+
+void Tree::radius_search_batch(const std::vector<QVector3D>& queries, float radius, std::vector<uint32_t>& first,
+                               std::vector<uint32_t>& rows, std::vector<float>& distances) const
+{
+    // every block collects its points on its own, they are copied together once all are counted
+    const unsigned blocks = workerCount();
+    std::vector<std::vector<uint32_t>> block_rows(blocks);
+    std::vector<std::vector<float>> block_distances(blocks);
+    first.assign(queries.size() + 1, 0);
+    parallelBlocks(queries.size(), blocks, [&](size_t begin, size_t end, unsigned block) {
+        std::vector<SearchEntry> nodes;
+        std::vector<uint32_t> found_rows;
+        std::vector<float> found_distances;
+        for (size_t q = begin; q < end; ++q)
+        {
+            radius_search(queries[q], radius, found_rows, found_distances, nodes);
+            first[q + 1] = static_cast<uint32_t>(found_rows.size());
+            block_rows[block].insert(block_rows[block].end(), found_rows.begin(), found_rows.end());
+            block_distances[block].insert(block_distances[block].end(), found_distances.begin(), found_distances.end());
+        }
+    });
+    for (size_t q = 0; q < queries.size(); ++q)
+    {
+        first[q + 1] += first[q];
+    }
+    rows.resize(first.back());
+    distances.resize(first.back());
+    parallelBlocks(queries.size(), blocks, [&](size_t begin, size_t, unsigned block) {
+        std::copy(block_rows[block].begin(), block_rows[block].end(), rows.begin() + first[begin]);
+        std::copy(block_distances[block].begin(), block_distances[block].end(), distances.begin() + first[begin]);
+    });
+}
+
+void Tree::radius_search(const QVector3D& query, float radius, std::vector<uint32_t>& rows,
+                         std::vector<float>& distances, std::vector<SearchEntry>& nodes) const
+{
+    rows.clear();
+    distances.clear();
+    if (_nodes.empty() || radius < 0)
+    {
+        return;
+    }
+
+    // left children first, so the points come in tree order
+    const float radius2 = radius * radius;
+    nodes.clear();
+    nodes.push_back({ 0, 0, QVector3D(0, 0, 0) });
+    while (!nodes.empty())
+    {
+        const SearchEntry entry = nodes.back();
+        nodes.pop_back();
+        const TreeNode& node = _nodes[entry.node];
+        if (node.is_leaf())
+        {
+            float block[POINT_BLOCK];
+            for (uint32_t first = node.first; first < node.first + node.count; first += POINT_BLOCK)
+            {
+                const uint32_t count = std::min(node.first + node.count - first, POINT_BLOCK);
+                uint32_t mask = _points.squaredDistances(first, count, query, radius2, block);
+                while (mask != 0)
+                {
+                    const int j = lowestBit(mask);
+                    mask &= mask - 1;
+                    rows.push_back(_rows[first + j]);
+                    distances.push_back(std::sqrt(block[j]));
+                }
+            }
+            continue;
+        }
+
+        const float offset = query[node.axis] - node.split;
+        SearchEntry far = entry;
+        far.offset[node.axis] = offset;
+        far.distance2 = entry.distance2 - entry.offset[node.axis] * entry.offset[node.axis] + offset * offset;
+        SearchEntry left = offset <= 0 ? entry : far;
+        SearchEntry right = offset <= 0 ? far : entry;
+        left.node = entry.node + 1;
+        right.node = node.right;
+        if (right.distance2 <= radius2)
+        {
+            nodes.push_back(right);
+        }
+        if (left.distance2 <= radius2)
+        {
+            nodes.push_back(left);
+        }
+    }
+}
+
+void Tree::box_search(const QVector3D& min, const QVector3D& max, std::vector<TreeRange>& ranges) const
+{
+    box_query(min, max, &ranges);
+}
+
+size_t Tree::box_count(const QVector3D& min, const QVector3D& max) const
+{
+    return box_query(min, max, nullptr);
+}
+
+size_t Tree::box_query(const QVector3D& min, const QVector3D& max, std::vector<TreeRange>* ranges) const
+{
+    if (ranges)
+    {
+        ranges->clear();
+    }
+    auto add = [ranges](uint32_t first, uint32_t count) {
+        if (!ranges->empty() && ranges->back().first + ranges->back().count == first)
+        {
+            ranges->back().count += count;
+        }
+        else
+        {
+            ranges->push_back({ first, count });
+        }
+    };
+
+    // a node with its cell, left children first so the ranges come in order
+    struct BoxEntry
+    {
+        uint32_t node;
+        QVector3D min;
+        QVector3D max;
+    };
+    size_t found = 0;
+    std::vector<BoxEntry> nodes;
+    if (!_nodes.empty())
+    {
+        nodes.push_back({ 0, _min, _max });
+    }
+    while (!nodes.empty())
+    {
+        const BoxEntry entry = nodes.back();
+        nodes.pop_back();
+        if (entry.max.x() < min.x() || entry.max.y() < min.y() || entry.max.z() < min.z()
+                || entry.min.x() > max.x() || entry.min.y() > max.y() || entry.min.z() > max.z())
+        {
+            continue;
+        }
+        const TreeNode& node = _nodes[entry.node];
+        if (entry.min.x() >= min.x() && entry.min.y() >= min.y() && entry.min.z() >= min.z()
+                && entry.max.x() <= max.x() && entry.max.y() <= max.y() && entry.max.z() <= max.z())
+        {
+            found += node.count;
+            if (ranges)
+            {
+                add(node.first, node.count);
+            }
+            continue;
+        }
+        if (node.is_leaf())
+        {
+            for (uint32_t first = node.first; first < node.first + node.count; first += POINT_BLOCK)
+            {
+                const uint32_t count = std::min(node.first + node.count - first, POINT_BLOCK);
+                uint32_t mask = _points.inside(first, count, min, max);
+                while (mask != 0)
+                {
+                    const int j = lowestBit(mask);
+                    mask &= mask - 1;
+                    ++found;
+                    if (ranges)
+                    {
+                        add(first + j, 1);
+                    }
+                }
+            }
+            continue;
+        }
+
+        BoxEntry left = entry;
+        BoxEntry right = entry;
+        left.node = entry.node + 1;
+        left.max[node.axis] = node.split;
+        right.node = node.right;
+        right.min[node.axis] = node.split;
+        nodes.push_back(right);
+        nodes.push_back(left);
+    }
+    return found;
+}
+
+void Tree::renumber_rows(const std::vector<uint32_t>& original_rows)
+{
+    // the map covers the whole cloud, rows of non-finite points are not in the tree
+    std::vector<uint32_t> now_at(original_rows.size());
+    for (size_t i = 0; i < original_rows.size(); ++i)
+    {
+        now_at[original_rows[i]] = static_cast<uint32_t>(i);
+    }
+    for (uint32_t& row : _rows)
+    {
+        row = row < now_at.size() ? now_at[row] : row;
+    }
+}
+
+void Tree::get_tree_lines(std::vector<std::pair<QVector3D, QColor>>& lines,
+                          std::vector<std::pair<QVector3D, QColor>>& points, int depth) const
 {
+    if (_nodes.empty())
+    {
+        return;
+    }
+    std::vector<uint32_t> stack(1, 0);
+    while (!stack.empty())
+    {
+        const TreeNode& node = _nodes[stack.back()];
+        const uint32_t index = stack.back();
+        stack.pop_back();
+        if (node.is_leaf() || node.depth >= depth)
+        {
+            continue;
+        }
+
+        const QVector3D median = _points[node.first + node.count / 2];
+        points.push_back(std::make_pair(median, QColor(0, 1, 1)));
+        // splits on x green along y, on y red along x, on z blue along y
+        if (node.axis == 0)
+        {
+            lines.push_back(std::make_pair(QVector3D(median.x(), _min.y(), median.z()), QColor(0, 1, 0)));
+            lines.push_back(std::make_pair(QVector3D(median.x(), _max.y(), median.z()), QColor(0, 1, 0)));
+        }
+        else if (node.axis == 1)
+        {
+            lines.push_back(std::make_pair(QVector3D(_min.x(), median.y(), median.z()), QColor(1, 0, 0)));
+            lines.push_back(std::make_pair(QVector3D(_max.x(), median.y(), median.z()), QColor(1, 0, 0)));
+        }
+        else
+        {
+            lines.push_back(std::make_pair(QVector3D(median.x(), _min.y(), median.z()), QColor(0, 0, 1)));
+            lines.push_back(std::make_pair(QVector3D(median.x(), _max.y(), median.z()), QColor(0, 0, 1)));
+        }
+        stack.push_back(node.right);
+        stack.push_back(index + 1);
+    }
+}
+
+// serialized form: bounds, leaf capacity, node and point count, then the arrays as they are
+static_assert(sizeof(QVector3D) == 3 * sizeof(float), "points are serialized as packed floats");
+
+static void append_bytes(std::vector<unsigned char>& out, const void* data, size_t size)
+{
+    const size_t at = out.size();
+    out.resize(at + size);
+    std::memcpy(out.data() + at, data, size);
+}
+
+std::vector<unsigned char> Tree::serialize() const
+{
+    std::vector<unsigned char> out;
+    const float bounds[6] = { _min.x(), _min.y(), _min.z(), _max.x(), _max.y(), _max.z() };
+    const uint32_t capacity = static_cast<uint32_t>(_leaf_capacity);
+    const uint64_t counts[2] = { _nodes.size(), _points.size() };
+    append_bytes(out, bounds, sizeof(bounds));
+    append_bytes(out, &capacity, sizeof(capacity));
+    append_bytes(out, counts, sizeof(counts));
+    append_bytes(out, _nodes.data(), _nodes.size() * sizeof(TreeNode));
+    append_bytes(out, _rows.data(), _rows.size() * sizeof(uint32_t));
+    const size_t points_at = out.size();
+    out.resize(points_at + _points.size() * sizeof(QVector3D));
+    _points.save(out.data() + points_at);
+    return out;
+}
+
+Tree* Tree::deserialize(const unsigned char* data, size_t size)
+{
+    float bounds[6];
+    uint32_t capacity;
+    uint64_t counts[2];
+    const size_t header = sizeof(bounds) + sizeof(capacity) + sizeof(counts);
+    if (size < header)
+    {
+        return nullptr;
+    }
+    std::memcpy(bounds, data, sizeof(bounds));
+    std::memcpy(&capacity, data + sizeof(bounds), sizeof(capacity));
+    std::memcpy(counts, data + sizeof(bounds) + sizeof(capacity), sizeof(counts));
+    const unsigned char* p = data + header;
+    const uint64_t rest = size - header;
+    if (counts[0] > rest / sizeof(TreeNode) || counts[1] > rest
+            || rest != counts[0] * sizeof(TreeNode) + counts[1] * (sizeof(uint32_t) + sizeof(QVector3D)))
+    {
+        return nullptr;
+    }
+
+    Tree* tree = new Tree(static_cast<int>(capacity));
+    tree->_min = QVector3D(bounds[0], bounds[1], bounds[2]);
+    tree->_max = QVector3D(bounds[3], bounds[4], bounds[5]);
+    tree->_nodes.resize(counts[0]);
+    tree->_rows.resize(counts[1]);
+    std::memcpy(tree->_nodes.data(), p, counts[0] * sizeof(TreeNode));
+    p += counts[0] * sizeof(TreeNode);
+    std::memcpy(tree->_rows.data(), p, counts[1] * sizeof(uint32_t));
+    p += counts[1] * sizeof(uint32_t);
+    tree->_points.load(p, counts[1]);
 
+    // a broken cache must not send a traversal outside the arrays
+    for (size_t i = 0; i < tree->_nodes.size(); ++i)
+    {
+        const TreeNode& node = tree->_nodes[i];
+        if (static_cast<uint64_t>(node.first) + node.count > counts[1]
+                || (!node.is_leaf() && (node.axis > 2 || node.right <= i + 1 || node.right >= counts[0])))
+        {
+            delete tree;
+            return nullptr;
+        }
+    }
+    return tree;
 }
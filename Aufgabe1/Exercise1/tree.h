@@ -1,16 +1,174 @@
 #ifndef TREE_H
 #define TREE_H
 #include <QVector3D>
+#include <QColor>
+#include <atomic>
+#include <cstdint>
+#include <utility>
+#include <vector>
 
+#include "pointblocks.h"
+#include "pointcloud.h"
+
+// one node of the kd-tree. Nodes are stored depth first: the left child follows its parent,
+// the right child is at right
+struct TreeNode
+{
+    float split;       // points of the left child are <= split on axis, of the right child >=
+    uint32_t first;    // the points of the node are [first, first + count) of Tree::get_points()
+    uint32_t count;
+    uint32_t right;    // index of the right child, 0 for leaves
+    uint8_t axis;      // 0, 1, 2 for x, y, z
+    uint8_t depth;     // 0 for the root
+    bool is_leaf() const { return right == 0; }
+};
+
+// a range of Tree::get_points() and get_rows()
+struct TreeRange
+{
+    uint32_t first;
+    uint32_t count;
+};
+
+// limits of an approximate search. Cells further than the k-th point found divided by
+// 1 + eps are skipped, so every point returned is at most 1 + eps times further than the
+// true one of its rank. With max_leaves the nearest cells are visited first and the search
+// stops after that many leaves once it has k points, 0 for no limit. The default is an exact
+// search
+struct TreeApproximation
+{
+    float eps = 0;
+    int max_leaves = 0;
+};
+
+// leaves hold at most this many points, at least half of it
+static const int TREE_LEAF_CAPACITY = 16;
+
+// Balanced kd-tree over a cloud in one node array. Every node splits its points at their
+// median along the longest side of its cell, so a node of n points has children of n / 2 and
+// n - n / 2 points and the shape of the tree only depends on the point count. Points are
+// stored in tree order, every node covers one range of them. A tree with a seed splits on
+// one of the two longest sides at random instead, for the trees of a Forest.
 class Tree
 {
 public:
-    Tree();
-    Tree * left;
-    Tree * right;
-    std::string split;
-    int level;
-    QVector3D data;
+    Tree(int leaf_capacity = TREE_LEAF_CAPACITY, uint32_t seed = 0);
+    Tree(const Tree&) = delete;
+    Tree& operator=(const Tree&) = delete;
+
+    // builds the tree top down with nth_element, parallel builds the subtrees below the
+    // upper levels on all threads, the tree is the same either way. Once cancel is set the
+    // build stops at its next node and returns false with an empty tree. NaN and infinite
+    // points are left out, get_points() may be shorter than the cloud
+    bool build(const PointCloud& cloud, bool parallel = true, const std::atomic<bool>* cancel = nullptr);
+
+    // bounds of the root cell, the AABB of the cloud
+    QVector3D get_min() const { return _min; }
+    QVector3D get_max() const { return _max; }
+    int leaf_capacity() const { return _leaf_capacity; }
+
+    // root first, empty for an empty cloud
+    const std::vector<TreeNode>& get_nodes() const { return _nodes; }
+    // the points in tree order and the cloud row each of them came from
+    const PointBlocks& get_points() const { return _points; }
+    const std::vector<uint32_t>& get_rows() const { return _rows; }
+
+    // the k points nearest to query, nearest first, with their cloud rows and distances, fewer
+    // if the cloud is smaller. The search descends to the side of the query first, the other
+    // child is skipped once its cell is further than the k-th point found
+    void knn(const QVector3D& query, int k, std::vector<uint32_t>& rows, std::vector<float>& distances,
+             const TreeApproximation& approximation = TreeApproximation()) const;
+    // the same for many queries on all threads, every thread with its own heaps. The
+    // min(k, points) nearest of query q are written from q * min(k, points) on
+    void knn_batch(const std::vector<QVector3D>& queries, int k, std::vector<uint32_t>& rows,
+                   std::vector<float>& distances, const TreeApproximation& approximation = TreeApproximation()) const;
+    // the nearest of every point of the cloud, those of row r from r * min(k, points) on. The
+    // points are searched in tree order, neighbouring queries find the same nodes in the cache
+    void knn_all(int k, std::vector<uint32_t>& rows, std::vector<float>& distances,
+                 const TreeApproximation& approximation = TreeApproximation()) const;
+
+    // all points within radius of query with their rows and distances, in tree order
+    void radius_search(const QVector3D& query, float radius, std::vector<uint32_t>& rows,
+                       std::vector<float>& distances) const;
+    // the same for many queries on all threads, first gets queries + 1 entries and the points of
+    // query q are [first[q], first[q + 1]) of rows and distances
+    void radius_search_batch(const std::vector<QVector3D>& queries, float radius, std::vector<uint32_t>& first,
+                             std::vector<uint32_t>& rows, std::vector<float>& distances) const;
+
+    // the points in the box from min to max as ranges of get_points(), no point is copied. A
+    // node whose cell is in the box is one range, the points of other leaves are tested one by
+    // one, ranges that follow each other are merged
+    void box_search(const QVector3D& min, const QVector3D& max, std::vector<TreeRange>& ranges) const;
+    // the number of points in the box, nodes whose cell is in the box count without a descent
+    size_t box_count(const QVector3D& min, const QVector3D& max) const;
+
+    // the cloud was reordered after the build, original_rows[i] is the build row now at row i.
+    // rows past the end of original_rows stay as they are
+    void renumber_rows(const std::vector<uint32_t>& original_rows);
+
+    // the median points of the nodes above depth and a line through each of them in its
+    // split plane, across the whole cloud
+    void get_tree_lines(std::vector<std::pair<QVector3D, QColor>>& lines,
+                        std::vector<std::pair<QVector3D, QColor>>& points, int depth) const;
+
+    // nodes, rows and points for the cloud cache
+    std::vector<unsigned char> serialize() const;
+    static Tree* deserialize(const unsigned char* data, size_t size);
+
+private:
+    // a point with its row while the tree is built
+    struct BuildPoint
+    {
+        QVector3D point;
+        uint32_t row;
+    };
+    // a subtree that is built on its own
+    struct Subtree
+    {
+        uint32_t node;
+        size_t begin;
+        size_t end;
+        QVector3D min;
+        QVector3D max;
+        int depth;
+    };
+    // a child waiting in a search, with the offsets of the query from its cell along each axis
+    // and their squared sum
+    struct SearchEntry
+    {
+        float distance2;
+        uint32_t node;
+        QVector3D offset;
+    };
+    // writes the nearest of query to rows and distances, returns how many, with the nodes and
+    // heap of the caller
+    size_t knn(const QVector3D& query, size_t k, uint32_t* rows, float* distances,
+               const TreeApproximation& approximation, std::vector<SearchEntry>& nodes,
+               std::vector<std::pair<float, uint32_t>>& found) const;
+
+    void radius_search(const QVector3D& query, float radius, std::vector<uint32_t>& rows,
+                       std::vector<float>& distances, std::vector<SearchEntry>& nodes) const;
+    // the nodes of box_search and box_count, ranges is null for a count
+    size_t box_query(const QVector3D& min, const QVector3D& max, std::vector<TreeRange>* ranges) const;
+
+    // number of nodes of a subtree over count points
+    size_t subtree_nodes(size_t count) const;
+    // writes the subtree at node over points [begin, end) of build_points, subtrees on
+    // split_depth are added to subtrees instead if it is not null
+    void build_node(std::vector<BuildPoint>& build_points, const Subtree& subtree, int split_depth,
+                    std::vector<Subtree>* subtrees);
+
+    std::vector<TreeNode> _nodes;
+    PointBlocks _points;
+    std::vector<uint32_t> _rows;
+    // (count, nodes) of every subtree size of the last build, sorted by count
+    std::vector<std::pair<size_t, size_t>> _subtree_nodes;
+    // cancel flag of the running build
+    const std::atomic<bool>* _cancel = nullptr;
+    QVector3D _min;
+    QVector3D _max;
+    int _leaf_capacity;
+    uint32_t _seed;
 };
 
 #endif // TREE_H
@@ -1,19 +1,39 @@
 #version 120
+#extension GL_EXT_gpu_shader4 : require
 
 uniform float pointSize;
 uniform mat4 viewMatrix;
+uniform float quantized;
+uniform vec3 quantizeMin;
+uniform vec3 quantizeExtent;
+uniform float reordered;
 
 attribute vec4 vertex;
-attribute float pointRowIndex;
+attribute float red;
+attribute float green;
+attribute float blue;
+attribute float row;
 
 varying float pointIdx;
 varying vec3 vert;
+varying vec3 color;
 
 void main() {
-  gl_Position = viewMatrix * vertex;
+  // quantized positions arrive normalized to [0, 1] inside the AABB
+  vec4 position = vertex;
+  if (quantized == 1.0) {
+    position.xyz = quantizeMin + vertex.xyz * quantizeExtent;
+  }
+  gl_Position = viewMatrix * position;
   gl_PointSize  = pointSize;
 
-  // for use in fragment shader
-  pointIdx = pointRowIndex;
-  vert = vertex.xyz;
+  // for use in fragment shader, the row index is the vertex id
+  // so it does not have to be stored next to the position,
+  // unless the points were reordered and the file row comes along
+  pointIdx = float(gl_VertexID);
+  if (reordered == 1.0) {
+    pointIdx = row;
+  }
+  vert = position.xyz;
+  color = vec3(red, green, blue);
 }